@@ -0,0 +1,291 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "chain.h"
+#include "chica_v2.h"
+
+/*******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+/* Frames a payload and hands it to the transport whole. The CRC is the v2 one,
+   taken over the header, length and payload */
+static bool chain_write_frame(chainLink *link, uint8_t header, const uint8_t *payload, unsigned int length)
+{
+	uint8_t frame[CHAIN_MAX_FRAME];
+	uint16_t crc = V2_CRC_INIT;
+	unsigned int size = 0;
+
+	frame[size++] = CHAIN_SYNC;
+	frame[size++] = header;
+	frame[size++] = (uint8_t)length;
+	for (unsigned int byte = 0; byte < length; byte++)
+	{
+		frame[size++] = payload[byte];
+	}
+	for (unsigned int byte = 1; byte < size; byte++)
+	{
+		crc = chica_v2_crc_update(crc, frame[byte]);
+	}
+	frame[size++] = crc & 0xFF;
+	frame[size++] = crc >> 8;
+
+	if (link->downstream.write == nullptr || !link->downstream.write(link->downstream.context, frame, size))
+	{
+		link->stats.dropped++;
+		return false;
+	}
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Sends one node's slice of a SET or KEY, with its indexes made local to that node */
+static bool chain_write_slice(chainLink *link, unsigned int node, const cmdPkt *pkt, unsigned int first,
+							  unsigned int count)
+{
+	uint8_t payload[CHAIN_MAX_PAYLOAD];
+	unsigned int length = 0;
+	uint8_t type = (pkt->cmd == key) ? CHAIN_TYPE_KEY : CHAIN_TYPE_SET;
+
+	payload[length++] = (pkt->startIdx + first) % CHAIN_NODE_PINS;
+	payload[length++] = (uint8_t)count;
+	if (type == CHAIN_TYPE_KEY)
+	{
+		payload[length++] = (uint8_t)pkt->easing;
+		payload[length++] = pkt->durationMs & 0xFF;
+		payload[length++] = (pkt->durationMs >> 8) & 0xFF;
+	}
+	for (unsigned int idx = first; idx < first + count; idx++)
+	{
+		payload[length++] = pkt->valueBuff[idx] & 0xFF;
+		payload[length++] = (pkt->valueBuff[idx] >> 8) & 0xFF;
+	}
+
+	return chain_write_frame(link, (uint8_t)((node << 4) | type), payload, length);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Turns a frame addressed to this node back into the packet the master split it from */
+static bool chain_decode(const chainLink *link, cmdPkt *pkt_out)
+{
+	uint8_t type = link->header & 0x0F;
+	unsigned int valuesIdx = (type == CHAIN_TYPE_KEY) ? 5 : 2;
+
+	if ((type != CHAIN_TYPE_SET && type != CHAIN_TYPE_KEY) || link->length < valuesIdx ||
+		link->length != valuesIdx + (2 * link->payload[1]))
+	{
+		return false;
+	}
+
+	pkt_out->cmd = (type == CHAIN_TYPE_KEY) ? key : set;
+	pkt_out->startIdx = link->payload[0];
+	pkt_out->count = link->payload[1];
+	if (type == CHAIN_TYPE_KEY)
+	{
+		pkt_out->easing = link->payload[2];
+		pkt_out->durationMs = link->payload[3] | (link->payload[4] << 8);
+	}
+	for (unsigned int idx = 0; idx < pkt_out->count; idx++)
+	{
+		const uint8_t *value = &link->payload[valuesIdx + (2 * idx)];
+		pkt_out->valueBuff[idx] = value[0] | (value[1] << 8);
+	}
+	pkt_out->protocol = CHICA_PROTOCOL_V2;
+	pkt_out->batchMore = false;
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+static bool chain_loopback_write(void *context, const uint8_t *data, unsigned int size)
+{
+	chainLoopback *loop = (chainLoopback *)context;
+
+	if (CHAIN_LOOPBACK_SIZE - (loop->head - loop->tail) < size)
+	{
+		return false;
+	}
+	for (unsigned int byte = 0; byte < size; byte++)
+	{
+		loop->data[loop->head++ & (CHAIN_LOOPBACK_SIZE - 1)] = data[byte];
+	}
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+static bool chain_loopback_read(void *context, uint8_t *byte)
+{
+	chainLoopback *loop = (chainLoopback *)context;
+
+	if (loop->head == loop->tail)
+	{
+		return false;
+	}
+	*byte = loop->data[loop->tail++ & (CHAIN_LOOPBACK_SIZE - 1)];
+	return true;
+}
+
+/*******************************************************************************
+ * Chain Functions
+ ******************************************************************************/
+/* Either transport may be left null, the master having no upstream and the
+   last slave no downstream */
+void chain_init(chainLink *link, const chainTransport *upstream, const chainTransport *downstream)
+{
+	link->upstream = (upstream != nullptr) ? *upstream : chainTransport{nullptr, nullptr, nullptr};
+	link->downstream = (downstream != nullptr) ? *downstream : chainTransport{nullptr, nullptr, nullptr};
+	link->state = CHAIN_WAIT_SYNC;
+	link->stats = {};
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Master only. Sends the slice of a SET or KEY belonging to each slave down the
+   chain, and trims the packet to the master's own slice, which may leave it with
+   no values. The packet is still run then, so a batch it ends is committed.
+   Returns the number of frames sent */
+unsigned int chain_forward(chainLink *link, cmdPkt *pkt)
+{
+	if (pkt->cmd != set && pkt->cmd != key)
+	{
+		return 0;
+	}
+
+	unsigned int frames = 0;
+	unsigned int localCount = 0;
+	unsigned int idx = 0;
+	while (idx < pkt->count)
+	{
+		// Indexes only go up through a packet, so a slice runs to the end of its node's range at most
+		unsigned int pin = pkt->startIdx + idx;
+		unsigned int node = pin / CHAIN_NODE_PINS;
+		unsigned int count = CHAIN_NODE_PINS - (pin % CHAIN_NODE_PINS);
+		if (count > pkt->count - idx)
+		{
+			count = pkt->count - idx;
+		}
+
+		if (node == 0)
+		{
+			localCount = count;
+		}
+		else if (node >= CHAIN_MAX_NODES)
+		{
+			link->stats.dropped++;
+		}
+		else if (chain_write_slice(link, node, pkt, idx, count))
+		{
+			link->stats.forwarded++;
+			frames++;
+		}
+		idx += count;
+	}
+
+	pkt->count = localCount;
+	return frames;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Slave only. Reads what the upstream link has without waiting, relaying frames
+   for later boards as they complete. Returns true as soon as a packet for this
+   board is decoded, so the caller can take it before reading on */
+bool chain_receive(chainLink *link, cmdPkt *pkt_out)
+{
+	uint8_t input;
+
+	while (link->upstream.read != nullptr && link->upstream.read(link->upstream.context, &input))
+	{
+		switch (link->state)
+		{
+		case CHAIN_WAIT_SYNC:
+			if (input == CHAIN_SYNC)
+			{
+				link->crc = V2_CRC_INIT;
+				link->state = CHAIN_HEADER;
+			}
+			break;
+
+		case CHAIN_HEADER:
+			link->header = input;
+			link->crc = chica_v2_crc_update(link->crc, input);
+			link->state = CHAIN_LENGTH;
+			break;
+
+		case CHAIN_LENGTH:
+			link->length = input;
+			link->payloadIdx = 0;
+			link->crc = chica_v2_crc_update(link->crc, input);
+			if (input > CHAIN_MAX_PAYLOAD)
+			{
+				link->state = CHAIN_WAIT_SYNC;
+			}
+			else
+			{
+				link->state = (input > 0) ? CHAIN_PAYLOAD : CHAIN_CRC_LO;
+			}
+			break;
+
+		case CHAIN_PAYLOAD:
+			link->payload[link->payloadIdx++] = input;
+			link->crc = chica_v2_crc_update(link->crc, input);
+			if (link->payloadIdx >= link->length)
+			{
+				link->state = CHAIN_CRC_LO;
+			}
+			break;
+
+		case CHAIN_CRC_LO:
+			if (input != (link->crc & 0xFF))
+			{
+				link->stats.crcErrors++;
+				link->state = CHAIN_WAIT_SYNC;
+			}
+			else
+			{
+				link->state = CHAIN_CRC_HI;
+			}
+			break;
+
+		case CHAIN_CRC_HI:
+		{
+			link->state = CHAIN_WAIT_SYNC;
+			if (input != (link->crc >> 8))
+			{
+				link->stats.crcErrors++;
+				break;
+			}
+
+			unsigned int hops = link->header >> 4;
+			if (hops > 1)
+			{
+				// For a board further down, which counts its hops from here
+				uint8_t header = (uint8_t)(((hops - 1) << 4) | (link->header & 0x0F));
+				if (chain_write_frame(link, header, link->payload, link->length))
+				{
+					link->stats.relayed++;
+				}
+			}
+			else if (hops == 1 && chain_decode(link, pkt_out))
+			{
+				link->stats.received++;
+				return true;
+			}
+			break;
+		}
+		}
+	}
+	return false;
+}
+
+/*******************************************************************************
+ * Loopback Functions
+ ******************************************************************************/
+/* A ring standing in for a UART, so the chain can run on a host without any
+   boards. The transport writes into the ring and reads back out of it */
+void chain_loopback_init(chainLoopback *loop, chainTransport *transport_out)
+{
+	loop->head = 0;
+	loop->tail = 0;
+	transport_out->write = chain_loopback_write;
+	transport_out->read = chain_loopback_read;
+	transport_out->context = loop;
+}
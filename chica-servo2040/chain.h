@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include "chica_parser.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Nodes */
+#define CHAIN_NODE_PINS		32		// Indexes each board owns, node n has n * 32 to n * 32 + 31
+#define CHAIN_MAX_NODES		8		// The master and 7 slaves, as far as a v2 startIdx reaches
+
+/* Framing: sync, hops << 4 | type, length, payload[length], CRC low, CRC high */
+#define CHAIN_SYNC			0xC5
+#define CHAIN_TYPE_SET		0x1		// startIdx, count, [value] x count
+#define CHAIN_TYPE_KEY		0x2		// startIdx, count, easing, duration, [pulse] x count
+#define CHAIN_MAX_PAYLOAD	(5 + (2 * CHAIN_NODE_PINS))
+#define CHAIN_MAX_FRAME		(5 + CHAIN_MAX_PAYLOAD)
+
+/* Loopback */
+#define CHAIN_LOOPBACK_SIZE	256		// Must be a power of 2
+
+/*******************************************************************************
+ * Enumerations
+ ******************************************************************************/
+typedef enum {
+	CHAIN_WAIT_SYNC,
+	CHAIN_HEADER,
+	CHAIN_LENGTH,
+	CHAIN_PAYLOAD,
+	CHAIN_CRC_LO,
+	CHAIN_CRC_HI
+} chainStates;
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+/* A byte link to the next board. Writes take a whole frame or none of it, and
+   reads never block, so the UART and the loopback can stand in for each other */
+typedef struct {
+	bool (*write)(void *context, const uint8_t *data, unsigned int size);
+	bool (*read)(void *context, uint8_t *byte);
+	void *context;
+} chainTransport;
+
+typedef struct {
+	uint32_t forwarded;		// Frames the master sent down the chain
+	uint32_t received;		// Frames for this slave
+	uint32_t relayed;		// Frames a slave passed on to the next board
+	uint32_t crcErrors;
+	uint32_t dropped;		// Slices past the last node, or frames the link had no room for
+} chainStats;
+
+/* The master only writes downstream. A slave reads upstream, and relays frames
+   for the boards after it downstream with one hop taken off */
+typedef struct {
+	chainTransport upstream;
+	chainTransport downstream;
+	chainStates state;
+	uint8_t header;
+	uint8_t length;
+	unsigned int payloadIdx;
+	uint16_t crc;
+	uint8_t payload[CHAIN_MAX_PAYLOAD];
+	chainStats stats;
+} chainLink;
+
+typedef struct {
+	uint8_t data[CHAIN_LOOPBACK_SIZE];
+	unsigned int head;		// Next index to write, free running
+	unsigned int tail;		// Next index to read, free running
+} chainLoopback;
+
+/*******************************************************************************
+ * Chain Functions
+ ******************************************************************************/
+void chain_init(
+chainLink *link,
+const chainTransport *upstream,
+const chainTransport *downstream
+);
+
+unsigned int chain_forward(
+chainLink *link,
+cmdPkt *pkt
+);
+
+bool chain_receive(
+chainLink *link,
+cmdPkt *pkt_out
+);
+
+/*******************************************************************************
+ * Loopback Functions
+ ******************************************************************************/
+void chain_loopback_init(
+chainLoopback *loop,
+chainTransport *transport_out
+);
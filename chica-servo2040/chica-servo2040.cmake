@@ -1,10 +1,27 @@
 set(OUTPUT_NAME chica-servo2040)
-add_executable(${OUTPUT_NAME} chica-servo2040.cpp)
+add_executable(${OUTPUT_NAME}
+        chain.cpp
+        chica-servo2040.cpp
+        chica_parser.cpp
+        chica_v2.cpp
+        gait.cpp
+        interpolator.cpp
+        kinematics.cpp
+        power_monitor.cpp
+        scheduler.cpp
+        target_buffer.cpp
+        vcp.cpp
+        )
+
+# The servo pins all fit in the compact PWM program's window, so stream one word per transition
+target_compile_definitions(${OUTPUT_NAME} PRIVATE PWM_CLUSTER_COMPACT)
 
 target_link_libraries(${OUTPUT_NAME}
         pico_stdlib
+        pico_multicore
         servo2040
         analogmux
+        analogmux_scanner
         analog
         button
         )
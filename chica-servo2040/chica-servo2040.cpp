@@ -8,11 +8,23 @@ using namespace plasma;
 using namespace servo;
 
 /////////////* Global Variables */////////////
-/* Create an array of servo pointers */
-const int START_PIN = servo2040::SERVO_1;
-const int END_PIN = servo2040::SERVO_18;
-const int NUM_SERVOS = (END_PIN - START_PIN) + 1;
-ServoCluster servos = ServoCluster(pio0, 0, START_PIN, NUM_SERVOS);
+/* The legs' servos, spread over pio0 state machines 0 to 2, six servos (two legs) on each.
+   Their frames are the ones the per-frame tasks count */
+ServoCluster servos = ServoCluster(pio0, 0, servo2040::SERVO_1, LEG_SERVOS, ANGULAR, ServoState::DEFAULT_FREQUENCY,
+								   true, LEG_SHARDS);
+
+#if AUX_SERVOS > 0
+/* The auxiliary servos, on pio1 State Machine 1 next to the LED bar. Its OUT window only
+   spans GPIO 19 to 21, so it leaves the LED bar's data pin on GPIO 18 to the WS2812. A PIO
+   cannot start its state machines in step with the other's, so their frames are not aligned
+   to the legs' */
+ServoCluster auxServos = ServoCluster(pio1, 1, servo2040::I2C_INT, AUX_SERVOS);
+
+/* Every cluster, in servo channel order */
+ServoCluster *const servoClusters[] = {&servos, &auxServos};
+#else
+ServoCluster *const servoClusters[] = {&servos};
+#endif
 
 /* Set up the shared analog inputs */
 Analog sen_adc = Analog(servo2040::SHARED_ADC);
@@ -24,24 +36,142 @@ Analog cur_adc = Analog(servo2040::SHARED_ADC, servo2040::CURRENT_GAIN,
 AnalogMux mux = AnalogMux(servo2040::ADC_ADDR_0, servo2040::ADC_ADDR_1, servo2040::ADC_ADDR_2,
 						  PIN_UNUSED, servo2040::SHARED_ADC);
 
+/* Scan every mux address in the background, so GETs answer from the latest readings */
+AnalogMuxScanner sensors = AnalogMuxScanner(mux, servo2040::SHARED_ADC, AnalogMuxScanner::MAX_ADDRESSES,
+											SENSOR_OVERSAMPLE, AnalogMuxScanner::DEFAULT_SETTLE_US,
+											SENSOR_SCAN_PERIOD_US);
+
 /* Create the LED bar, using PIO 1 and State Machine 0 */
 WS2812 led_bar(servo2040::NUM_LEDS, pio1, 0, servo2040::LED_DATA);
 
 uint servoEnabled = false;
 
+/* The motion packets of a v2 frame are staged as a batch, which can span several
+   passes of the main loop. Nothing is published until the batch's last packet, so
+   the gait and keyframes leave their steps staged for its commit while it is open */
+bool batchOpen = false;
+bool batchLoadPending = false;
+
+/* PWM sequences reloaded by the last SET packet or v2 batch, one for each leg shard
+   and auxiliary cluster it changed, so up to LEG_SHARDS + 1, and 0 if nothing did.
+   A chain master counts them at the frame sync that commits the packet */
+uint32_t set_reloadCount = 0;
+
+/* Continuous current monitoring and overcurrent protection, fed by the sensor scanner */
+powerMonitor power;
+volatile bool overcurrentPending = false;
+uint32_t power_lastFrame = 0;
+
+/* Resumable packet parsers, fed from the VCP receive ring on core 1. The legacy
+   parser is used until the host asks for v2 framing, and again once it disconnects */
+chicaParser parser;
+chicaV2Parser parserV2;
+uint chicaProtocol = CHICA_PROTOCOL_LEGACY;
+bool vcp_wasConnected = false;
+
+/* Decoded packets handed from core 1 to core 0. SET and KEY packets are queued
+   apart from GET packets, so core 0 can apply them ahead of, and in between
+   the reads of, a slow GET sweep */
+queue_t motionQueue;
+queue_t getQueue;
+
+/* Per core utilization, indexed by core number */
+coreUtilization coreUtil[2];
+
+/* Scheduled SETs waiting for the PWM frame they target */
+scheduler scheduled;
+uint32_t sched_lastFrame = 0;
+uint32_t framePeriod_us = 0;
+
+/* Onboard inverse kinematics. The pose and feet are kept, so the host only
+   needs to send whichever has changed */
+ikModel kinematics;
+ikPose bodyPose;
+ikVec feet[IK_LEGS];
+bool ikPending = false;
+
+/* Onboard gait generator, which walks the IK feet at the commanded velocity */
+gaitEngine gait;
+uint32_t gait_lastFrame = 0;
+uint64_t gait_last_us = 0;
+
+/* Servo targets, staged by every producer and published to the cluster as whole
+   snapshots. targets_applied is the cluster's reader, holding the last one it took */
+targetBuffer targets;
+targetReader targets_applied;
+
+/* Onboard keyframe interpolator, ticked once per PWM frame */
+interpolator interp;
+uint32_t interp_lastFrame = 0;
+
+#ifdef CHAIN_ENABLED
+/* The link to the other boards. The master sends each slave its slices, and holds
+   its own batch commits for the frame sync it pulses at the start of each frame */
+chainLink chain;
+
+/* Frames waiting for the chain's UART. The TX interrupt drains them on the core
+   that writes them, the master's core 0 or a slave's core 1, so a write never
+   waits on the line */
+uint8_t chain_txRing[CHAIN_TX_RING_SIZE];
+volatile uint32_t chain_txHead = 0;	// Next index to write, free running
+volatile uint32_t chain_txTail = 0;	// Next index to send, free running
+#endif
+#ifdef CHAIN_MASTER
+bool chain_commitPending = false;
+bool chain_stepPending = false;	// A gait or keyframe step, committed with the frame sync but not counted as a SET's reloads
+uint32_t chain_lastFrame = 0;
+#endif
+#ifdef CHAIN_SLAVE
+/* A slave's packets wait in chainQueue for the next frame sync. The sync interrupt
+   notes how many had arrived by the edge, and those are run as one batch */
+queue_t chainQueue;
+volatile uint32_t chain_syncCount = 0;
+volatile uint chain_syncPackets = 0;
+uint32_t chain_appliedSync = 0;
+#endif
+
+#if defined(PWM_TIMING_REPORT) || defined(CORE_UTILIZATION_REPORT) || defined(POWER_REPORT) || defined(SCHEDULE_REPORT) || \
+	defined(CALIBRATION_BENCH_REPORT)
+Button user_sw(servo2040::USER_SW);
+#endif
+
 int main()
 {
 	/*******************************************************************************
 	 * Initializations
 	 ******************************************************************************/
 	/* Initialize the servo cluster */
-	servos.init();
+	for (ServoCluster *cluster : servoClusters)
+	{
+#ifdef PWM_CHAINED_DMA
+		cluster->set_chained_dma(true);
+#endif
+		cluster->init();
+	}
+	framePeriod_us = (uint32_t)(1000000.0f / servos.frequency());
+	sched_reset(&scheduled);
+	interp_reset(&interp);
+	targets_init(&targets);
+	targets_reader_init(&targets_applied);
+
+	/* Start the IK with the body level and every foot at its neutral stance */
+	ik_init_default(&kinematics);
+	bodyPose = {{0, 0, 0}, 0, 0, 0};
+	for (uint leg = 0; leg < IK_LEGS; leg++)
+	{
+		ik_neutral_foot(&kinematics, leg, &feet[leg]);
+	}
+	gait_init(&gait, feet);
 
 	/* Initialize analog inputs with pull downs */
 	for (auto i = 0u; i < servo2040::NUM_SENSORS; i++)
 	{
 		mux.configure_pulls(servo2040::SENSOR_1_ADDR + i, false, true);
 	}
+	power_monitor_init(&power, CURRENT_LIMIT_A, CURRENT_FILTER_ALPHA);
+	sensors.set_reading_callback(sensor_reading_callback);
+	sensors.init();
+	sensors.start();
 
 	/* Initialize A0,A1,A2 */
 	gpio_init_mask(A0_GPIO_MASK | A1_GPIO_MASK | A3_GPIO_MASK);
@@ -50,10 +180,49 @@ int main()
 	gpio_put_masked(A0_GPIO_MASK | A1_GPIO_MASK | A3_GPIO_MASK,
 					GPIO_LOW_MASK); // Set LOW
 
+	chica_parser_reset(&parser);
+	chica_v2_reset(&parserV2);
+	queue_init(&motionQueue, sizeof(cmdPkt), MOTION_QUEUE_DEPTH);
+	queue_init(&getQueue, sizeof(cmdPkt), GET_QUEUE_DEPTH);
+	vcp_init();
+
+#ifdef CHAIN_ENABLED
+	/* The chain's UART carries frames one way, from the master to the last slave */
+	uart_init(CHAIN_UART, CHAIN_BAUD);
+	gpio_set_function(CHAIN_TX_PIN, GPIO_FUNC_UART);
+	gpio_set_function(CHAIN_RX_PIN, GPIO_FUNC_UART);
+	chainTransport chainUart = {chain_uart_write, chain_uart_read, nullptr};
+	gpio_init(CHAIN_SYNC_PIN);
+#ifdef CHAIN_MASTER
+	chain_init(&chain, nullptr, &chainUart);
+	chain_uart_tx_init();
+	gpio_set_dir(CHAIN_SYNC_PIN, GPIO_OUT);
+	gpio_put(CHAIN_SYNC_PIN, false);
+#else
+	chain_init(&chain, &chainUart, &chainUart);
+	queue_init(&chainQueue, sizeof(cmdPkt), CHAIN_QUEUE_DEPTH);
+	gpio_set_dir(CHAIN_SYNC_PIN, GPIO_IN);
+	gpio_pull_down(CHAIN_SYNC_PIN);
+	gpio_set_irq_enabled_with_callback(CHAIN_SYNC_PIN, GPIO_IRQ_EDGE_RISE, true, chain_sync_callback);
+#endif
+#endif
+
+	/* The USB stack is serviced in the background on this core, but all CDC
+	   reads, writes and parsing happen on core 1 */
 	stdio_init_all();
-	/* Wait for VCP/CDC connection */
+	core_utilization_reset(&coreUtil[0]);
+	core_utilization_reset(&coreUtil[1]);
+#ifdef CORE_UTILIZATION_REPORT
+	// The DMA interrupt runs on this core, where the clusters were initialised
+	PWMCluster::set_irq_timing(true);
+#endif
+	multicore_launch_core1(core1_entry);
+
+	/* Wait for VCP/CDC connection. A slave is driven over the chain instead */
 	led_bar.start();
+#ifndef CHAIN_SLAVE
 	while (!stdio_usb_connected()){pendingVCP_ledSequence();}
+#endif
 	led_bar.clear();
 
 	/*******************************************************************************
@@ -61,8 +230,51 @@ int main()
 	 ******************************************************************************/
 	while (1)
 	{
-		/* Monitor and parse serial data */
-		parse_and_command_task();
+		uint32_t start_us = time_us_32();
+
+		/* Act on any overcurrent first, and keep the per frame power telemetry */
+		bool busy = power_task();
+
+		/* Apply packets decoded by core 1 */
+		busy |= command_task();
+
+#ifdef CHAIN_ENABLED
+		/* Commit with the other boards at each frame sync */
+		busy |= chain_task();
+#endif
+
+		/* Commit scheduled SETs in time for the frame they target */
+		busy |= schedule_task();
+
+		/* Walk the feet at the commanded velocity */
+		busy |= gait_task();
+
+		/* Step any keyframes in progress */
+		busy |= interpolate_task();
+
+		core_utilization_update(&coreUtil[0], start_us, busy);
+
+#if defined(PWM_TIMING_REPORT) || defined(CORE_UTILIZATION_REPORT) || defined(POWER_REPORT) || defined(SCHEDULE_REPORT) || \
+	defined(CALIBRATION_BENCH_REPORT)
+		if (user_sw.read())
+		{
+#ifdef PWM_TIMING_REPORT
+			print_timing_report();
+#endif
+#ifdef CORE_UTILIZATION_REPORT
+			print_core_utilization();
+#endif
+#ifdef POWER_REPORT
+			print_power_report();
+#endif
+#ifdef SCHEDULE_REPORT
+			print_schedule_report();
+#endif
+#ifdef CALIBRATION_BENCH_REPORT
+			print_calibration_bench();
+#endif
+		}
+#endif
 
 	} // while(1)
 }
@@ -70,154 +282,866 @@ int main()
 /*******************************************************************************
  * Function Definitions
  ******************************************************************************/
+/*******************************************************************************
+ * Core 1 Functions
+ ******************************************************************************/
+void core1_entry(void)
+{
+#ifdef CHAIN_SLAVE
+	// A slave relays from this core, so its UART interrupt is taken here
+	chain_uart_tx_init();
+#endif
+	while (1)
+	{
+		uint32_t start_us = time_us_32();
+		bool busy = vcp_task();
+#ifdef CHAIN_SLAVE
+		busy |= chain_rx_task();
+#endif
+		core_utilization_update(&coreUtil[1], start_us, busy);
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool vcp_task(void)
+{
+	static cmdPkt curr_cmdPkt;	// Static to keep it off the small core 1 stack
+	uint8_t input;
+	bool busy = false;
+
+	/* Every new connection starts out in the legacy framing */
+	bool connected = stdio_usb_connected();
+	if (vcp_wasConnected && !connected)
+	{
+		chicaProtocol = CHICA_PROTOCOL_LEGACY;
+		chica_parser_reset(&parser);
+		chica_v2_reset(&parserV2);
+	}
+	vcp_wasConnected = connected;
+
+	/***************************** START OF PARSING *************************************/
+	// Pull whatever the host has sent into the ring, then parse it without ever waiting
+	// for the rest of a packet. Partial packets stay in the parser until the next call.
+	vcp_rx_drain();
+
+	while (vcp_rx_get(&input))
+	{
+		busy = true;
+		if (chicaProtocol == CHICA_PROTOCOL_V2)
+		{
+			if (chica_v2_feed(&parserV2, input))
+			{
+				queue_v2_frame();
+			}
+		}
+		else if (chica_parser_feed(&parser, input, &curr_cmdPkt))
+		{
+			queue_packet(curr_cmdPkt);
+		}
+	}
+	/***************************** END OF PARSING *************************************/
+
+	/* Write out any replies core 0 has finished */
+	if (vcp_tx_service() > 0)
+	{
+		busy = true;
+	}
+
+	return busy;
+}
+
+/*******************************************************************************
+ ******************************************************************************/
+/* Queue every sub-command of a v2 frame, or none of it if any is malformed */
+void queue_v2_frame(void)
+{
+	static cmdPkt curr_cmdPkt;	// Static to keep it off the small core 1 stack
+	unsigned int motionCount;
+	unsigned int offset = 0;
+
+	if (!chica_v2_validate(&parserV2, &motionCount))
+	{
+		return;
+	}
+
+	while (chica_v2_next(&parserV2, &offset, &curr_cmdPkt))
+	{
+		// Mark all but the frame's last motion sub-command, so core 0 commits them as one
+		if (is_batched_cmd(curr_cmdPkt.cmd))
+		{
+			motionCount--;
+			curr_cmdPkt.batchMore = (motionCount > 0);
+		}
+		queue_packet(curr_cmdPkt);
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+void queue_packet(cmdPkt &pkt)
+{
+	pkt.arrival_us = time_us_32();
+
+	if (pkt.cmd == proto)
+	{
+		// Switch framing straight away, as the host waits for the acknowledgement before
+		// using the new one. Anything unsupported leaves the framing as it is, and the
+		// acknowledgement tells the host which is in use.
+		if (pkt.valueBuff[0] == CHICA_PROTOCOL_LEGACY || pkt.valueBuff[0] == CHICA_PROTOCOL_V2)
+		{
+			chicaProtocol = pkt.valueBuff[0];
+		}
+		pkt.valueBuff[0] = chicaProtocol;
+	}
+
+	// If core 0 has fallen this far behind, hold off reading more from the host.
+	// Everything without a reply goes in the motion queue
+	bool motion = (pkt.cmd != get && pkt.cmd != clockSync && pkt.cmd != proto);
+	queue_add_blocking(motion ? &motionQueue : &getQueue, &pkt);
+}
+#ifdef CHAIN_SLAVE
+/*******************************************************************************
+ ******************************************************************************/
+/* Takes this board's packets off the chain, relaying the rest on as they come */
+bool chain_rx_task(void)
+{
+	static cmdPkt curr_cmdPkt;	// Static to keep it off the small core 1 stack
+	bool busy = false;
+
+	while (chain_receive(&chain, &curr_cmdPkt))
+	{
+		curr_cmdPkt.arrival_us = time_us_32();
+		queue_add_blocking(&chainQueue, &curr_cmdPkt);
+		busy = true;
+	}
+	return busy;
+}
+#endif
+
 /*******************************************************************************
  * Core Functions
  ******************************************************************************/
-void parse_and_command_task(void)
+bool command_task(void)
+{
+	static cmdPkt curr_cmdPkt;	// Static to keep it off the stack
+	bool busy = motion_task();
+
+	/* At most one GET per pass, so queued SETs are never left behind a run of GETs */
+	if (queue_try_remove(&getQueue, &curr_cmdPkt))
+	{
+		run_command(curr_cmdPkt);
+		busy = true;
+	}
+
+	return busy;
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool motion_task(void)
+{
+	static cmdPkt curr_cmdPkt;	// Static to keep it off the stack
+	bool busy = false;
+
+#ifdef CHAIN_MASTER
+	while (chain_tx_ready() && queue_try_remove(&motionQueue, &curr_cmdPkt))
+#else
+	while (queue_try_remove(&motionQueue, &curr_cmdPkt))
+#endif
+	{
+		run_command(curr_cmdPkt);
+		busy = true;
+	}
+
+	return busy;
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool schedule_task(void)
+{
+	static schedEntry entry;	// Static to keep it off the stack
+	static cmdPkt curr_cmdPkt;
+
+	// Check once per PWM frame, as counted by the DMA interrupt. A load now goes
+	// live at the start of the next frame, so that is the frame everything due
+	// before it is aiming for
+	uint32_t frame = servos.frame_count();
+	if (frame == sched_lastFrame)
+	{
+		return false;
+	}
+	sched_lastFrame = frame;
+	uint32_t nextFrame_us = time_us_32() + framePeriod_us;
+
+	/* Every entry due is applied as one batch of SETs, committed with a single load */
+	bool busy = false;
+#ifdef CHAIN_MASTER
+	while (chain_tx_ready() && sched_pop_due(&scheduled, nextFrame_us, &entry))
+#else
+	while (sched_pop_due(&scheduled, nextFrame_us, &entry))
+#endif
+	{
+		curr_cmdPkt.cmd = set;
+		curr_cmdPkt.protocol = CHICA_PROTOCOL_V2;
+		curr_cmdPkt.startIdx = entry.startIdx;
+		curr_cmdPkt.count = entry.count;
+		for (uint idx = 0; idx < entry.count; idx++)
+		{
+			curr_cmdPkt.valueBuff[idx] = entry.valueBuff[idx];
+		}
+		curr_cmdPkt.batchMore = sched_is_due(&scheduled, nextFrame_us);
+		run_command(curr_cmdPkt);
+		busy = true;
+	}
+
+	return busy;
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool gait_task(void)
+{
+	if (!gait_is_running(&gait))
+	{
+		return false;
+	}
+
+	// Step once per PWM frame, so each step goes live at the start of the following frame
+	uint32_t frame = servos.frame_count();
+	if (frame == gait_lastFrame)
+	{
+		return false;
+	}
+	gait_lastFrame = frame;
+
+	uint64_t now_us = time_us_64();
+	uint32_t dt_us = (uint32_t)MIN(now_us - gait_last_us, (uint64_t)GAIT_MAX_DT_US);
+	gait_last_us = now_us;
+
+	/* Each full cycle of the gait closes an energy measurement */
+	if (gait_update(&gait, dt_us, read_foot_contacts(), feet))
+	{
+		uint32_t save = save_and_disable_interrupts();
+		power_monitor_end_cycle(&power);
+		restore_interrupts(save);
+	}
+
+	commit_step(stage_ik_values());
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool interpolate_task(void)
+{
+	// Step once per PWM frame, as counted by the DMA interrupt, so each step is
+	// committed in time to go live at the start of the following frame
+	uint32_t frame = servos.frame_count();
+	if (frame == interp_lastFrame)
+	{
+		return false;
+	}
+	interp_lastFrame = frame;
+	uint64_t now_us = time_us_64();
+
+	/* Every servo's step is staged, then committed together for the next frame */
+	bool loadNeeded = false;
+	for (uint servo = 0; servo < SERVO_CHANNELS; servo++)
+	{
+		int32_t pulse;
+		if (interp_sample(&interp, servo, now_us, &pulse))
+		{
+			targets_set(&targets, servo, pulse);
+			loadNeeded |= servoEnabled;
+		}
+	}
+
+	commit_step(loadNeeded);
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool power_task(void)
+{
+	bool busy = false;
+
+	/* The relay was already dropped by the sensor interrupt, so finish the job by
+	   removing the PWM outputs and stopping any keyframes that would move them */
+	if (overcurrentPending)
+	{
+		overcurrentPending = false;
+		servoEnabled = false;
+		interp_reset(&interp);
+		sched_clear(&scheduled);
+		gait_stop(&gait);
+		enable_servos(false);
+		commit_servos();
+		busy = true;
+	}
+
+	/* Close the power telemetry at each PWM frame boundary */
+	uint32_t frame = servos.frame_count();
+	if (frame != power_lastFrame)
+	{
+		power_lastFrame = frame;
+		uint32_t save = save_and_disable_interrupts();
+		power_monitor_end_frame(&power);
+		restore_interrupts(save);
+		busy = true;
+	}
+
+	return busy;
+}
+#ifdef CHAIN_MASTER
+/*******************************************************************************
+ ******************************************************************************/
+/* Pulses the frame sync line at the start of each PWM frame, committing any batch
+   held for it on the same edge the slaves commit theirs on */
+bool chain_task(void)
+{
+	uint32_t frame = servos.frame_count();
+	if (frame == chain_lastFrame)
+	{
+		return false;
+	}
+
+	// Every slice sent before the edge has to have reached its slave by it. Rather
+	// than wait on the line the edge is held for a later pass, with no new packets
+	// forwarded until it goes out
+	if (!chain_uart_tx_idle())
+	{
+		return false;
+	}
+	chain_lastFrame = frame;
+
+	gpio_put(CHAIN_SYNC_PIN, true);
+	if (chain_commitPending || chain_stepPending)
+	{
+		uint32_t loadsBefore = servo_load_count();
+		publish_targets();
+		commit_servos();
+		if (chain_commitPending)
+		{
+			set_reloadCount = servo_load_count() - loadsBefore;
+		}
+		chain_commitPending = false;
+		chain_stepPending = false;
+	}
+	busy_wait_us_32(CHAIN_SYNC_PULSE_US);
+	gpio_put(CHAIN_SYNC_PIN, false);
+	return true;
+}
+#endif
+#ifdef CHAIN_SLAVE
+/*******************************************************************************
+ ******************************************************************************/
+/* Runs the packets that had arrived by the last frame sync as one batch */
+bool chain_task(void)
+{
+	static cmdPkt curr_cmdPkt;	// Static to keep it off the stack
+	uint32_t save = save_and_disable_interrupts();
+	uint32_t syncCount = chain_syncCount;
+	uint pending = chain_syncPackets;
+	restore_interrupts(save);
+
+	if (syncCount == chain_appliedSync)
+	{
+		return false;
+	}
+	chain_appliedSync = syncCount;
+
+	// Anything that arrived after the edge waits for the next one
+	for (uint idx = 0; idx < pending; idx++)
+	{
+		queue_remove_blocking(&chainQueue, &curr_cmdPkt);
+		curr_cmdPkt.batchMore = (idx + 1 < pending);
+		run_command(curr_cmdPkt);
+	}
+	return true;
+}
+#endif
+/*******************************************************************************
+ ******************************************************************************/
+void run_command(cmdPkt &curr_cmdPkt)
 {
-	cmdPkt curr_cmdPkt;
-	uint value = 0;
-	int input;
+	/* NOTE:
+		Servos do not move at all until A0 is SET to to enable by sending a nonzero number
+		to the pin. However, servo values are still saved even before they are enabled.
+		This way the servos will go to PWM values they are set to right after being enabled.
+		If no value was sent to the servo before being enabled, they will move to 1500.
+
+		Servos can be disabled be sending SET ZERO to A0. This will make A0 LOW as well
+		as disable the servoes in software by deasserting the PWM values.
+
+	*/
+	/* Every value in the packet is staged without reloading the PWM, then committed
+	   with a single load_pwm() once the whole packet is applied. The motion packets
+	   of a v2 frame are a batch, committed once after the last of them */
+#ifndef CHAIN_MASTER
+	static uint32_t loadsBefore = 0;
+#endif
 
-	input = getchar_timeout_us(GETC_TIMEOUT_US);
+	/***************************** RUN COMMAND *************************************/
+#ifdef CHAIN_MASTER
+	// The other boards' slices go down the chain first, leaving this board's own.
+	// Everything else addresses the master alone, the IK and gait included, as
+	// the legs are all on its pins
+	chain_forward(&chain, &curr_cmdPkt);
+#endif
 
-	while (input != PICO_ERROR_TIMEOUT)
+	if (is_batched_cmd(curr_cmdPkt.cmd) && !batchOpen)
 	{
-		/***************************** START OF PARSING *************************************/
-		// Check if command
-		if (input & 0x80) // Only start parsing if command detected
+		batchOpen = true;
+#ifndef CHAIN_MASTER
+		loadsBefore = servo_load_count();
+#endif
+	}
+
+	if (curr_cmdPkt.cmd == set || curr_cmdPkt.cmd == maskSet)
+	{
+		if (curr_cmdPkt.cmd == set)
+		{
+			for (uint idx = 0; idx < curr_cmdPkt.count; idx++, curr_cmdPkt.startIdx++)
+			{
+				batchLoadPending |= stage_cmdPin_value((cmdPins)curr_cmdPkt.startIdx, curr_cmdPkt.valueBuff[idx]);
+			}
+		}
+		else
+		{
+			// Values are packed in order of the mask's set bits, lowest first
+			uint32_t mask = curr_cmdPkt.mask;
+			for (uint idx = 0; mask != 0; idx++, mask &= mask - 1)
+			{
+				uint cmdPin = __builtin_ctz(mask);
+				batchLoadPending |= stage_cmdPin_value((cmdPins)cmdPin, curr_cmdPkt.valueBuff[idx]);
+			}
+		}
+	}	  // if (currCmd.cmd == set)
+	else if (curr_cmdPkt.cmd == key)
+	{
+		/* Each servo eases from wherever it is now to its target over the keyframe's
+		   duration. The steps themselves are applied by interpolate_task() */
+		uint64_t now_us = time_us_64();
+		uint32_t duration_us = curr_cmdPkt.durationMs * 1000;
+
+		for (uint idx = 0; idx < curr_cmdPkt.count; idx++, curr_cmdPkt.startIdx++)
 		{
-			curr_cmdPkt.startIdx = getchar_timeout_us(GETC_TIMEOUT_US);
-			curr_cmdPkt.count = getchar_timeout_us(GETC_TIMEOUT_US);
+			// Only servos can be keyframed
+			int servo = cmdPin_to_servo((cmdPins)curr_cmdPkt.startIdx);
+			if (servo >= 0)
+			{
+				// Clamped as a SET is, so an out of range target eases to the hard limit rather than to off
+				int32_t target = Calibration::pulse_us_to_q16(curr_cmdPkt.valueBuff[idx]);
+				int32_t current = targets_get(&targets, servo);
+
+				// A servo that has never had a pulse has nowhere to ease from, so jumps to the target
+				int32_t start = (current > 0) ? current : target;
+
+				interp_start(&interp, servo, start, target, now_us, duration_us, (easingTypes)curr_cmdPkt.easing);
+			}
+		}
+	}
+#ifdef CHAIN_MASTER
+	else if (curr_cmdPkt.cmd == get && curr_cmdPkt.startIdx + curr_cmdPkt.count > CHAIN_NODE_PINS)
+	{
+		/* The chain only carries frames away from the master, so a slave's pins
+		   cannot be read. A GET reaching past the master's own is refused whole,
+		   rather than answered with its values for pins that are not there */
+		vcp_tx_begin();
+		if (curr_cmdPkt.protocol == CHICA_PROTOCOL_V2)
+		{
+			uint8_t payload[4] = {V2_SUB_ERROR, V2_SUB_GET, (uint8_t)curr_cmdPkt.startIdx,
+								  (uint8_t)curr_cmdPkt.count};
+			vcp_transmit_v2(payload, 4);
+		}
+		else
+		{
+			// The Chica protocol has no error reply, so it gets a GET with nothing read
+			uint tx[3] = {GET_CMD, curr_cmdPkt.startIdx, 0};
+			vcp_transmit(tx, 3);
+		}
+		vcp_tx_flush();
+	}
+#endif
+	else if (curr_cmdPkt.cmd == get)
+	{
+		uint startIdx = curr_cmdPkt.startIdx;
+		uint values[MAX_COUNT_VALUE];
+		uint valueCount = 0;
+
+		for (uint idx = 0; idx < curr_cmdPkt.count; idx++, curr_cmdPkt.startIdx++)
+		{
+			// Apply any SETs that arrived during the sweep, so they are delayed by at most one read
+			motion_task();
+
+			// Legacy replies skip pins with nothing to read, v2 replies keep one value per index
+			uint value = 0;
+			if (get_cmdPin_value((cmdPins)curr_cmdPkt.startIdx, &value) ||
+				curr_cmdPkt.protocol == CHICA_PROTOCOL_V2)
+			{
+				values[valueCount++] = value;
+			}
+		}
 
-			if (input == SET_CMD)
+		/* The whole reply is assembled in the VCP transmit buffer and sent in one write */
+		vcp_tx_begin();
+		if (curr_cmdPkt.protocol == CHICA_PROTOCOL_V2)
+		{
+			uint8_t payload[3 + (2 * MAX_COUNT_VALUE)] = {V2_SUB_GET, (uint8_t)startIdx, (uint8_t)curr_cmdPkt.count};
+			for (uint idx = 0; idx < valueCount; idx++)
 			{
-				curr_cmdPkt.cmd = set;
+				payload[3 + (2 * idx)] = values[idx] & 0xFF;
+				payload[4 + (2 * idx)] = (values[idx] >> 8) & 0xFF;
 			}
-			else if (input == GET_CMD)
+			vcp_transmit_v2(payload, 3 + (2 * valueCount));
+		}
+		else
+		{
+			uint tx[3] = {GET_CMD, startIdx, curr_cmdPkt.count};
+			vcp_transmit(tx, 3);
+			for (uint idx = 0; idx < valueCount; idx++)
 			{
-				curr_cmdPkt.cmd = get;
+				tx[0] = values[idx] & 0x7F;
+				tx[1] = (values[idx] >> 7) & 0x7F;
+				vcp_transmit(tx, 2);
 			}
-			else {
-				break; // xxx: BAD COMMAND, makes compiler happy to avoid uninitalized curr_cmdPkt.cmd>:(
+		}
+		vcp_tx_flush();
+	}	  // else if (currCmd.cmd == get)
+	else if (curr_cmdPkt.cmd == poseSet)
+	{
+		/* The IK is solved once the whole batch is in, so a frame holding both the
+		   pose and the feet only solves once */
+		bodyPose.translation.x = (int32_t)curr_cmdPkt.valueBuff[0];
+		bodyPose.translation.y = (int32_t)curr_cmdPkt.valueBuff[1];
+		bodyPose.translation.z = (int32_t)curr_cmdPkt.valueBuff[2];
+		bodyPose.roll = (int32_t)curr_cmdPkt.valueBuff[3];
+		bodyPose.pitch = (int32_t)curr_cmdPkt.valueBuff[4];
+		bodyPose.yaw = (int32_t)curr_cmdPkt.valueBuff[5];
+		ikPending = true;
+	}
+	else if (curr_cmdPkt.cmd == feetSet)
+	{
+		uint idx = 0;
+		for (uint leg = 0; leg < IK_LEGS; leg++)
+		{
+			if (curr_cmdPkt.mask & (1u << leg))
+			{
+				feet[leg].x = (int32_t)curr_cmdPkt.valueBuff[idx++];
+				feet[leg].y = (int32_t)curr_cmdPkt.valueBuff[idx++];
+				feet[leg].z = (int32_t)curr_cmdPkt.valueBuff[idx++];
 			}
+		}
+		ikPending = true;
+	}
+	else if (curr_cmdPkt.cmd == legConfig)
+	{
+		ikLegConfig config;
+		const int32_t *words = (const int32_t *)curr_cmdPkt.valueBuff;
+		config.mount = {words[0], words[1], words[2]};
+		config.mountYaw = words[3];
+		for (uint joint = 0; joint < IK_JOINTS; joint++)
+		{
+			config.length[joint] = words[4 + joint];
+			config.zero[joint] = words[7 + joint];
+			config.direction[joint] = (curr_cmdPkt.valueBuff[V2_LEG_WORDS] & (1u << joint)) ? -1 : 1;
+		}
+		ik_set_leg(&kinematics, curr_cmdPkt.startIdx, &config);
+
+		// The gait steps around the new neutral stance
+		ikVec neutral;
+		ik_neutral_foot(&kinematics, curr_cmdPkt.startIdx, &neutral);
+		gait_set_neutral(&gait, curr_cmdPkt.startIdx, &neutral);
+	}
+	else if (curr_cmdPkt.cmd == walkSet)
+	{
+		/* The gait takes the feet over from here, stepping them each PWM frame */
+		if (!gait_is_running(&gait))
+		{
+			gait_last_us = time_us_64();
+		}
+		gait_set_velocity(&gait, (int32_t)curr_cmdPkt.valueBuff[0], (int32_t)curr_cmdPkt.valueBuff[1],
+						  (int32_t)curr_cmdPkt.valueBuff[2]);
+	}
+	else if (curr_cmdPkt.cmd == gaitConfig)
+	{
+		gait_configure(&gait, (gaitTypes)curr_cmdPkt.valueBuff[0], curr_cmdPkt.valueBuff[1],
+					   (int32_t)curr_cmdPkt.valueBuff[2]);
+	}
+	else if (curr_cmdPkt.cmd == schedule)
+	{
+		/* Held until schedule_task() finds it due. Rejected entries only show in the stats */
+		sched_push(&scheduled, curr_cmdPkt.due_us, curr_cmdPkt.arrival_us, curr_cmdPkt.startIdx,
+				   curr_cmdPkt.count, curr_cmdPkt.valueBuff);
+	}
+	else if (curr_cmdPkt.cmd == clockSync)
+	{
+		/* Reply with when the request arrived and when the reply left, so the host can
+		   take out the time spent on the device when working out the clock offset */
+		uint32_t tx_us = time_us_32();
+		uint8_t payload[9] = {V2_SUB_CLOCK};
+		for (uint byte = 0; byte < 4; byte++)
+		{
+			payload[1 + byte] = (curr_cmdPkt.arrival_us >> (8 * byte)) & 0xFF;
+			payload[5 + byte] = (tx_us >> (8 * byte)) & 0xFF;
+		}
+		vcp_tx_begin();
+		vcp_transmit_v2(payload, 9);
+		vcp_tx_flush();
+	}
+	else if (curr_cmdPkt.cmd == proto)
+	{
+		/* Acknowledge in the framing the request arrived in. Core 1 has already
+		   switched to the framing given in the acknowledgement */
+		vcp_tx_begin();
+		if (curr_cmdPkt.protocol == CHICA_PROTOCOL_V2)
+		{
+			uint8_t payload[2] = {V2_SUB_PROTO, (uint8_t)curr_cmdPkt.valueBuff[0]};
+			vcp_transmit_v2(payload, 2);
+		}
+		else
+		{
+			uint tx[2] = {PROTO_CMD, curr_cmdPkt.valueBuff[0]};
+			vcp_transmit(tx, 2);
+		}
+		vcp_tx_flush();
+	}
+
+	/* Commit the staged batch */
+	if (batchOpen && !curr_cmdPkt.batchMore && is_batched_cmd(curr_cmdPkt.cmd))
+	{
+		if (ikPending)
+		{
+			ikPending = false;
+			batchLoadPending |= stage_ik_values();
+		}
+#ifdef CHAIN_MASTER
+		// Held for the next frame sync, where the slaves commit their slices too. The
+		// reloads are counted there, as that is where they happen
+		chain_commitPending |= batchLoadPending;
+		if (!chain_commitPending)
+		{
+			set_reloadCount = 0;
+		}
+#else
+		publish_targets();
+		if (batchLoadPending)
+		{
+			commit_servos();
+		}
+		set_reloadCount = servo_load_count() - loadsBefore;
+#endif
+		batchOpen = false;
+		batchLoadPending = false;
+	}
 
-			if (curr_cmdPkt.cmd == set)
+
+	/***************************** COMMAND END *************************************/
+}
+/*******************************************************************************
+ ******************************************************************************/
+
+/*******************************************************************************
+ ******************************************************************************/
+/* Stages a SET of one pin without reloading the PWM. Returns true if a load is
+   needed for it to take effect */
+bool stage_cmdPin_value(cmdPins cmdPin, uint value)
+{
+	// cmdPin is servo
+	int servo = cmdPin_to_servo(cmdPin);
+	if (servo >= 0)
+	{
+		// A direct SET overrides any keyframe still running on this servo
+		interp_cancel(&interp, servo);
+
+		// Pulses arrive as whole microseconds, so stay in fixed point all the way to the PWM level
+		targets_set(&targets, servo, Calibration::pulse_us_to_q16(value));
+		return servoEnabled;
+	}
+	// cmdPin is A0/A1/A2
+	else if (cmdPin >= RELAY && cmdPin <= A2)
+	{
+		bool enableState = value ? true : false;
+
+		// Set physical pins
+		gpio_put(cmdPin_to_hardwarePin(cmdPin), enableState);
+
+		// Enable/disable PWM outputs
+		if (cmdPin == RELAY)
+		{
+			// Targets staged before the relay changes take effect before it, as they were sent
+			publish_targets();
+
+			servoEnabled = enableState;
+			if (enableState)
 			{
-				for (uint idx = 0; idx < curr_cmdPkt.count; idx++)
-				{
-					value = 0;
-					value = getchar_timeout_us(GETC_TIMEOUT_US) & 0x7F;
-					value |= (getchar_timeout_us(GETC_TIMEOUT_US) & 0x7F) << 7;
-					curr_cmdPkt.valueBuff[idx] = value;
-				}
+				// Re-enabling the relay is what re-arms the overcurrent protection
+				uint32_t save = save_and_disable_interrupts();
+				power_monitor_clear_trip(&power);
+				restore_interrupts(save);
 			}
-			/***************************** END OF PARSING *************************************/
+			enable_servos(enableState);
+			return true;
+		}
+	}
+	return false;
+}
 
-			/* NOTE:
-				Servos do not move at all until A0 is SET to to enable by sending a nonzero number
-				to the pin. However, servo values are still saved even before they are enabled.
-				This way the servos will go to PWM values they are set to right after being enabled.
-				If no value was sent to the servo before being enabled, they will move to 1500.
+/*******************************************************************************
+ ******************************************************************************/
+/* Solves the IK for the current pose and feet, and stages the joints of every
+   leg that could reach its foot. Returns true if a load is needed for them to
+   take effect */
+bool stage_ik_values(void)
+{
+	int32_t values[IK_LEGS * IK_JOINTS];
+	uint32_t solved = ik_solve(&kinematics, &bodyPose, feet, (1u << IK_LEGS) - 1, values);
+	bool loadNeeded = false;
 
-				Servos can be disabled be sending SET ZERO to A0. This will make A0 LOW as well
-				as disable the servoes in software by deasserting the PWM values.
+	for (uint leg = 0; leg < IK_LEGS; leg++)
+	{
+		if (!(solved & (1u << leg)))
+		{
+			continue;
+		}
+
+		for (uint joint = 0; joint < IK_JOINTS; joint++)
+		{
+			uint servo = (leg * IK_JOINTS) + joint;
 
-			*/
-			/***************************** RUN COMMAND *************************************/
-			if (curr_cmdPkt.cmd == set)
+			// The IK overrides any keyframe still running on this servo, as a SET would.
+			// The joint angle goes through the servo's calibration to become a pulse
+			interp_cancel(&interp, servo);
+			int32_t pulse, value;
+			const Calibration &calibration = servo_cluster(servo).calibration(servo_clusterIndex(servo));
+			if (!calibration.value_to_pulse_q16(values[servo], pulse, value))
 			{
-				for (uint idx = 0; idx < curr_cmdPkt.count; idx++, curr_cmdPkt.startIdx++)
-				{
-					// startIdx is servo
-					if (curr_cmdPkt.startIdx <= SERVO18)
-					{
-						servos.pulse(cmdPin_to_hardwarePin((cmdPins)curr_cmdPkt.startIdx),
-									 						curr_cmdPkt.valueBuff[idx], servoEnabled);
-					}
-					// startIdx is A0/A1/A2
-					else if (curr_cmdPkt.startIdx >= RELAY)
-					{
-						bool enableState = curr_cmdPkt.valueBuff[idx] ? true : false;
-
-						// Set physical pins
-						gpio_put(cmdPin_to_hardwarePin((cmdPins)curr_cmdPkt.startIdx), enableState);
-
-						// Enable/disable PWM outputs
-						if (curr_cmdPkt.startIdx == RELAY)
-						{
-							servoEnabled = enableState;
-							if (enableState)
-							{
-								servos.enable_all();
-							}
-							else
-							{
-								servos.disable_all();
-							}
-						}
-					}
-
-				} // for (auto idx = 0; idx < currCmd.count; idx++, currCmd.startIdx++)
-			}	  // if (currCmd.cmd == set)
-			else if (curr_cmdPkt.cmd == get)
+				// Fall back to the float version for calibrations the fixed point table cannot hold
+				// A calibration with no pairs at all turns the servo off, as value() would
+				float pulse_f, value_f;
+				bool valid = calibration.value_to_pulse((float)values[servo] / (float)Calibration::Q16_ONE, pulse_f, value_f);
+				pulse = valid ? (int32_t)(pulse_f * (float)Calibration::Q16_ONE) : 0;
+			}
+			targets_set(&targets, servo, pulse);
+			loadNeeded |= servoEnabled;
+		}
+	}
+	return loadNeeded;
+}
+
+/*******************************************************************************
+ ******************************************************************************/
+/* Publishes the staged targets, then has the cluster take the latest snapshot.
+   The cluster only ever reads whole snapshots, so the staging can move to
+   another core or a timer without a SET, keyframe or IK solve tearing */
+void publish_targets(void)
+{
+	targets_publish(&targets);
+	if (targets_read(&targets, &targets_applied))
+	{
+		const targetSnapshot &snapshot = targets_applied.snapshot;
+		for (uint servo = 0; servo < SERVO_CHANNELS; servo++)
+		{
+			if (snapshot.changed & (1u << servo))
 			{
-				uint tx[3] = {GET_CMD, curr_cmdPkt.startIdx, curr_cmdPkt.count};
-				vcp_transmit(tx, 3);
-
-				for (uint idx = 0; idx < curr_cmdPkt.count; idx++, curr_cmdPkt.startIdx++)
-				{
-					// startIdx is servo
-					if (curr_cmdPkt.startIdx <= SERVO18)
-					{
-						uint pwmValue = 0;
-						uint mappedPin = cmdPin_to_hardwarePin((cmdPins)curr_cmdPkt.startIdx);
-						pwmValue = servos.pulse(mappedPin);
-						tx[0] = pwmValue & 0x7F;
-						tx[1] = (pwmValue >> 7) & 0x7F;
-						vcp_transmit(tx, 2);
-					}
-					// startIdx is touch sensor
-					else if (curr_cmdPkt.startIdx <= TS6)
-					{
-						uint mappedPin = cmdPin_to_hardwarePin((cmdPins)curr_cmdPkt.startIdx);
-						float sensor_voltage = read_analogPin(mappedPin);
-						uint voltage_binary = round(sensor_voltage * b1024_3_3V_RATIO);// only send request pin voltage
-						tx[0] = voltage_binary & 0x7F;
-						tx[1] = (voltage_binary >> 7) & 0x7F;
-						vcp_transmit(tx, 2);
-					}
-					else if (curr_cmdPkt.startIdx == CURR)
-					{
-						float current_f = read_current();
-						uint current_binary = round(current_f / CURR_LSb) + 512;
-						tx[0] = current_binary & 0x7F;
-						tx[1] = (current_binary >> 7) & 0x7F;
-						vcp_transmit(tx, 2);
-					}
-					else if (curr_cmdPkt.startIdx == VOLT)
-					{
-						float voltage_f = read_voltage();
-						uint voltage_binary = round(voltage_f * b1024_3_3V_RATIO);
-						tx[0] = voltage_binary & 0x7F;
-						tx[1] = (voltage_binary >> 7) & 0x7F;
-						vcp_transmit(tx, 2);
-					}
-
-				} // for (auto idx = 0; idx < currCmd.count; idx++, currCmd.startIdx++)
-			}	  // else if (currCmd.cmd == get)
-
-			/***************************** COMMAND END *************************************/
-
-		} // if (input & 0x80)
-
-		/***************************** CHECK IF MORE DATA *************************************/
-
-		input = getchar_timeout_us(GETC_TIMEOUT_US);
-	} // while (input != PICO_ERROR_TIMEOUT)
+				servo_cluster(servo).pulse_q16(servo_clusterIndex(servo), snapshot.pulse[servo], false);
+			}
+		}
+	}
+}
+
+/*******************************************************************************
+ * Servo Support Functions
+ ******************************************************************************/
+/* The servo channel of a cmdPin, or -1 if it is not a servo. Channels count SERVO1
+   to SERVO21 from 0, so the legs' servos keep the same numbers as their cmdPins */
+int cmdPin_to_servo(cmdPins cmdPin)
+{
+	if (cmdPin <= SERVO18)
+	{
+		return cmdPin - SERVO1;
+	}
+	else if (cmdPin >= SERVO19 && cmdPin < SERVO19 + AUX_SERVOS)
+	{
+		return LEG_SERVOS + (cmdPin - SERVO19);
+	}
+	return -1;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* The cluster a servo channel is driven by */
+ServoCluster &servo_cluster(uint servo)
+{
+#if AUX_SERVOS > 0
+	return (servo < LEG_SERVOS) ? servos : auxServos;
+#else
+	return servos;
+#endif
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Which of its cluster's servos a servo channel is */
+uint servo_clusterIndex(uint servo)
+{
+	return (servo < LEG_SERVOS) ? servo : servo - LEG_SERVOS;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Loads everything staged on every cluster. Clusters with nothing changed skip their load */
+void commit_servos(void)
+{
+	for (ServoCluster *cluster : servoClusters)
+	{
+		cluster->commit();
+	}
 }
 /*******************************************************************************
  ******************************************************************************/
+/* Commits a gait or keyframe step staged for the next frame. A batch still open
+   takes the step with its own commit, so a frame is never loaded half applied,
+   and a chain master holds it for the frame sync the slaves commit on */
+void commit_step(bool loadNeeded)
+{
+	if (batchOpen)
+	{
+		batchLoadPending |= loadNeeded;
+		return;
+	}
+#ifdef CHAIN_MASTER
+	chain_stepPending |= loadNeeded;
+#else
+	publish_targets();
+	if (loadNeeded)
+	{
+		commit_servos();
+	}
+#endif
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* PWM sequences written across every cluster */
+uint32_t servo_load_count(void)
+{
+	uint32_t loads = 0;
+	for (ServoCluster *cluster : servoClusters)
+	{
+		loads += cluster->load_count();
+	}
+	return loads;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Stages every servo's PWM output on or off, for commit_servos() to apply */
+void enable_servos(bool enable)
+{
+	for (ServoCluster *cluster : servoClusters)
+	{
+		if (enable)
+		{
+			cluster->enable_all(false);
+		}
+		else
+		{
+			cluster->disable_all(false);
+		}
+	}
+}
 
 /*******************************************************************************
  * VCP/Parsing Support Functions
@@ -228,11 +1152,382 @@ uint cmdPin_to_hardwarePin(cmdPins cmdPin)
 }
 /*******************************************************************************
  ******************************************************************************/
+/* Packets that move the servos, and are committed together when they arrive in one frame */
+bool is_batched_cmd(hexapodCmds cmd)
+{
+	return (cmd == set || cmd == maskSet || cmd == key || cmd == poseSet || cmd == feetSet);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Reads the value a GET reports for a pin. Returns false for pins with nothing
+   to read, which are the outputs and anything past the end of the table */
+bool get_cmdPin_value(cmdPins cmdPin, uint *value_out)
+{
+	// cmdPin is servo
+	int servo = cmdPin_to_servo(cmdPin);
+	if (servo >= 0)
+	{
+		*value_out = servo_cluster(servo).pulse(servo_clusterIndex(servo));
+	}
+	// cmdPin is touch sensor, only send request pin voltage
+	else if (cmdPin <= TS6)
+	{
+		*value_out = round(read_analogPin(cmdPin_to_hardwarePin(cmdPin)) * b1024_3_3V_RATIO);
+	}
+	else if (cmdPin == CURR)
+	{
+		*value_out = round(read_current() / CURR_LSb) + 512;
+	}
+	else if (cmdPin == VOLT)
+	{
+		*value_out = round(read_voltage() * b1024_3_3V_RATIO);
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Queues bytes onto the reply being assembled, call vcp_tx_flush() to send them */
 void vcp_transmit(uint *txbuff, uint size)
 {
 	for (uint byte = 0; byte < size; byte++)
 	{
-		putchar_raw(txbuff[byte]);
+		vcp_tx_put(txbuff[byte]);
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Queues a payload onto the reply being assembled as a complete v2 frame */
+void vcp_transmit_v2(const uint8_t *payload, uint size)
+{
+	uint16_t crc = V2_CRC_INIT;
+	uint8_t len[2] = {(uint8_t)(size & 0xFF), (uint8_t)(size >> 8)};
+
+	vcp_tx_put(V2_SYNC0);
+	vcp_tx_put(V2_SYNC1);
+	for (uint byte = 0; byte < 2; byte++)
+	{
+		crc = chica_v2_crc_update(crc, len[byte]);
+		vcp_tx_put(len[byte]);
+	}
+	for (uint byte = 0; byte < size; byte++)
+	{
+		crc = chica_v2_crc_update(crc, payload[byte]);
+		vcp_tx_put(payload[byte]);
+	}
+	vcp_tx_put(crc & 0xFF);
+	vcp_tx_put(crc >> 8);
+}
+
+#ifdef PWM_TIMING_REPORT
+/*******************************************************************************
+ ******************************************************************************/
+void print_timing_report(void)
+{
+	ServoCluster::TimingReport reports[LEG_SERVOS];
+	float period_us;
+	uint first = 0;
+
+	/* Each cluster is reported in turn, with the servos numbered on from the last */
+	for (ServoCluster *cluster : servoClusters)
+	{
+		uint count = cluster->count();
+		if (!cluster->timing_report(reports, count, period_us))
+		{
+			printf("Timing report unavailable\r\n");
+			return;
+		}
+
+		printf("Period %.3fus (requested %.3fus)\r\n", period_us, 1000000.0f / cluster->frequency());
+		printf("Servo  Requested  Level  LevelPulse  Measured  Rise      Error\r\n");
+		for (uint servo = 0; servo < count; servo++)
+		{
+			ServoCluster::TimingReport &r = reports[servo];
+			printf("%5u  %9.3f  %5u  %10.3f  %8.3f  %8.1f  %+6.3f\r\n", first + servo + 1, r.requested_pulse,
+				   (uint)r.level, r.level_pulse, r.measured_pulse, r.rise_time, r.error);
+		}
+		first += count;
+	}
+}
+#endif
+
+#ifdef CORE_UTILIZATION_REPORT
+void print_core_utilization(void)
+{
+	uint32_t now_us = time_us_32();
+	for (uint core = 0; core < 2; core++)
+	{
+		coreUtilization &u = coreUtil[core];
+		uint32_t window_us = now_us - u.start_us;
+		float percent = (window_us > 0) ? (100.0f * (float)u.busy_us) / (float)window_us : 0.0f;
+		printf("Core %u: %6.2f%% busy, %u loops, longest busy pass %uus\r\n", core, percent,
+			   (uint)u.loops, (uint)u.maxBusy_us);
+	}
+
+	const vcpTxStats *tx = vcp_tx_get_stats();
+	uint32_t replyAverage = (tx->replyCount > 0) ? (uint32_t)(tx->total_us / tx->replyCount) : 0;
+	uint32_t replyMin = (tx->replyCount > 0) ? tx->min_us : 0;
+	printf("Replies %u, dropped %u, latency %uus last, %uus min, %uus average, %uus max\r\n", (uint)tx->replyCount,
+		   (uint)tx->droppedReplies, (uint)tx->last_us, (uint)replyMin, (uint)replyAverage, (uint)tx->max_us);
+
+	PWMCluster::IrqStats irq = PWMCluster::get_irq_stats();
+	uint32_t average = (irq.count > 0) ? (uint32_t)(irq.total_cycles / irq.count) : 0;
+	printf("PWM IRQ: %u taken, %u sequences, %u cycles average, %u max, DMA restarted within %u\r\n",
+		   (uint)irq.count, (uint)irq.sequences, (uint)average, (uint)irq.max_cycles, (uint)irq.max_restart_cycles);
+	PWMCluster::reset_irq_stats();
+	printf("Last SET reloaded %u PWM sequences\r\n", (uint)set_reloadCount);
+
+	core_utilization_reset(&coreUtil[0]);
+	core_utilization_reset(&coreUtil[1]);
+}
+#endif
+
+#ifdef POWER_REPORT
+void print_power_report(void)
+{
+	powerMonitor snapshot;
+	uint32_t save = save_and_disable_interrupts();
+	snapshot = power;
+	restore_interrupts(save);
+
+	printf("Current %.3fA (limit %.3fA), supply %.2fV\r\n", snapshot.filtered_A, snapshot.limit_A, snapshot.voltage_V);
+	printf("Last frame: peak %.3fA, rms %.3fA, %.4fJ over %u samples\r\n", snapshot.lastFrame.peak_A,
+		   snapshot.lastFrame.rms_A, snapshot.lastFrame.energy_J, (uint)snapshot.lastFrame.samples);
+	printf("Energy: %.3fJ total, %.3fJ last cycle (%u cycles)\r\n", snapshot.totalEnergy_J,
+		   snapshot.lastCycleEnergy_J, (uint)snapshot.cycleCount);
+	printf("Trips: %u%s, last at %.3fA\r\n", (uint)snapshot.tripCount, snapshot.tripped ? " (tripped)" : "",
+		   snapshot.tripCurrent_A);
+}
+#endif
+
+#ifdef SCHEDULE_REPORT
+void print_schedule_report(void)
+{
+	const schedStats &s = scheduled.stats;
+	int32_t avgLead_us = (s.accepted > 0) ? (int32_t)(s.totalLead_us / s.accepted) : 0;
+
+	printf("Scheduled: %u accepted, %u applied, %u late, %u rejected, %u waiting\r\n", (uint)s.accepted,
+		   (uint)s.applied, (uint)s.late, (uint)s.rejected, scheduled.size);
+	printf("Lead: last %dus, min %dus, avg %dus, max %dus\r\n", (int)s.lastLead_us, (int)s.minLead_us,
+		   (int)avgLead_us, (int)s.maxLead_us);
+
+	sched_reset_stats(&scheduled);
+}
+#endif
+
+#ifdef CALIBRATION_BENCH_REPORT
+/*******************************************************************************
+ ******************************************************************************/
+/* Times the first servo's calibration from value to pulse to PWM level, in float and
+   in Q16.16, over a sweep of its range. Interrupts stay on, so the quickest of a few
+   runs is the one reported */
+void print_calibration_bench(void)
+{
+	const uint CONVERSIONS = 1000;
+	const uint RUNS = 4;
+
+	const Calibration &calibration = servos.calibration(0);
+	float freq = servos.frequency();
+	uint32_t period, div256;
+	if (calibration.size() < 2 || !PWMCluster::calculate_pwm_factors(freq, period, div256))
+	{
+		printf("Calibration bench unavailable\r\n");
+		return;
+	}
+	uint32_t levelScale = ServoState::level_scale_q24(period, freq);
+
+	float minValue = calibration.first().value;
+	float step = (calibration.last().value - minValue) / (float)CONVERSIONS;
+	int32_t minValue_q16 = (int32_t)(minValue * (float)Calibration::Q16_ONE);
+	int32_t step_q16 = (int32_t)(step * (float)Calibration::Q16_ONE);
+
+	volatile uint32_t sink = 0;	// Keeps the conversions from being optimised away
+	uint64_t floatBest_us = UINT64_MAX;
+	uint64_t fixedBest_us = UINT64_MAX;
+	for (uint run = 0; run < RUNS; run++)
+	{
+		uint64_t start_us = time_us_64();
+		for (uint i = 0; i < CONVERSIONS; i++)
+		{
+			float pulse, value;
+			calibration.value_to_pulse(minValue + ((float)i * step), pulse, value);
+			sink = ServoState::pulse_to_level(pulse, period, freq);
+		}
+		floatBest_us = MIN(floatBest_us, time_us_64() - start_us);
+
+		start_us = time_us_64();
+		for (uint i = 0; i < CONVERSIONS; i++)
+		{
+			int32_t pulse, value;
+			calibration.value_to_pulse_q16(minValue_q16 + ((int32_t)i * step_q16), pulse, value);
+			sink = ServoState::pulse_q16_to_level(pulse, levelScale);
+		}
+		fixedBest_us = MIN(fixedBest_us, time_us_64() - start_us);
+	}
+	(void)sink;
+
+	float cyclesPerUs = (float)clock_get_hz(clk_sys) / 1000000.0f;
+	float floatCycles = ((float)floatBest_us * cyclesPerUs) / (float)CONVERSIONS;
+	float fixedCycles = ((float)fixedBest_us * cyclesPerUs) / (float)CONVERSIONS;
+	printf("Calibration, value to level: float %.1f cycles, Q16.16 %.1f cycles, %.2fx\r\n", floatCycles, fixedCycles,
+		   (fixedCycles > 0.0f) ? floatCycles / fixedCycles : 0.0f);
+}
+#endif
+
+#ifdef CHAIN_ENABLED
+/*******************************************************************************
+ * Chain Support Functions
+ ******************************************************************************/
+/* The chain's transport over the UART. A write queues the whole frame for the TX
+   interrupt, or none of it when the ring is too full, which the link counts as
+   dropped */
+bool chain_uart_write(void *context, const uint8_t *data, unsigned int size)
+{
+	if (chain_uart_tx_free() < size)
+	{
+		return false;
+	}
+
+	uint32_t head = chain_txHead;
+	for (unsigned int byte = 0; byte < size; byte++)
+	{
+		chain_txRing[head++ & (CHAIN_TX_RING_SIZE - 1)] = data[byte];
+	}
+	chain_txHead = head;
+
+	// Start it sending. The interrupt is on this core, so masking it here keeps it
+	// out of the FIFO until the fill is done
+	irq_set_enabled(CHAIN_UART_IRQ, false);
+	chain_uart_tx_fill();
+	irq_set_enabled(CHAIN_UART_IRQ, true);
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool chain_uart_read(void *context, uint8_t *byte)
+{
+	if (!uart_is_readable(CHAIN_UART))
+	{
+		return false;
+	}
+	*byte = (uint8_t)uart_getc(CHAIN_UART);
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Takes the UART's interrupt on the calling core, which must be the one that
+   writes to the chain */
+void chain_uart_tx_init(void)
+{
+	irq_set_exclusive_handler(CHAIN_UART_IRQ, chain_uart_irq_handler);
+	irq_set_enabled(CHAIN_UART_IRQ, true);
+}
+/*******************************************************************************
+ ******************************************************************************/
+uint32_t chain_uart_tx_free(void)
+{
+	return CHAIN_TX_RING_SIZE - (chain_txHead - chain_txTail);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Whether everything written has left the UART, its last stop bit included */
+bool chain_uart_tx_idle(void)
+{
+	return (chain_txHead == chain_txTail) && !(uart_get_hw(CHAIN_UART)->fr & UART_UARTFR_BUSY_BITS);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Moves as much of the ring into the TX FIFO as it takes, leaving the TX
+   interrupt on only while there is more to send */
+void chain_uart_tx_fill(void)
+{
+	uint32_t tail = chain_txTail;
+	while (tail != chain_txHead && uart_is_writable(CHAIN_UART))
+	{
+		uart_putc_raw(CHAIN_UART, (char)chain_txRing[tail++ & (CHAIN_TX_RING_SIZE - 1)]);
+	}
+	chain_txTail = tail;
+	uart_set_irq_enables(CHAIN_UART, false, tail != chain_txHead);
+}
+/*******************************************************************************
+ ******************************************************************************/
+void chain_uart_irq_handler(void)
+{
+	chain_uart_tx_fill();
+}
+#endif
+#ifdef CHAIN_MASTER
+/*******************************************************************************
+ ******************************************************************************/
+/* Whether a packet can be forwarded with room for all its slices. Until then
+   packets wait in their queues, which back up to the host. They also wait while
+   a frame sync is held for the line to drain, so new slices cannot hold it off */
+bool chain_tx_ready(void)
+{
+	return (chain_uart_tx_free() >= CHAIN_TX_RESERVE) && (servos.frame_count() == chain_lastFrame);
+}
+#endif
+#ifdef CHAIN_SLAVE
+/*******************************************************************************
+ ******************************************************************************/
+/* The master's frame sync edge. Only the packets queued by now belong to it */
+void chain_sync_callback(uint gpio, uint32_t events)
+{
+	if (gpio == CHAIN_SYNC_PIN && (events & GPIO_IRQ_EDGE_RISE))
+	{
+		chain_syncPackets = queue_get_level(&chainQueue);
+		chain_syncCount++;
+	}
+}
+#endif
+
+/*******************************************************************************
+ * Sensor Support Functions
+ ******************************************************************************/
+/* Runs in the scanner's DMA interrupt, as each reading completes */
+void sensor_reading_callback(uint8_t address, const AnalogMuxScanner::Reading &reading, void *context)
+{
+	if (address == servo2040::CURRENT_SENSE_ADDR)
+	{
+		float current_A = cur_adc.raw_to_current(reading.average());
+		if (power_monitor_sample(&power, current_A, reading.timestamp_us))
+		{
+			// Cut servo power here rather than waiting for the main loop
+			gpio_put(cmdPin_to_hardwarePin(RELAY), false);
+			overcurrentPending = true;
+		}
+	}
+	else if (address == servo2040::VOLTAGE_SENSE_ADDR)
+	{
+		power_monitor_voltage(&power, vol_adc.raw_to_voltage(reading.average()));
+	}
+}
+
+/*******************************************************************************
+ * Utilization Support Functions
+ ******************************************************************************/
+void core_utilization_reset(coreUtilization *util)
+{
+	util->busy_us = 0;
+	util->maxBusy_us = 0;
+	util->loops = 0;
+	util->start_us = time_us_32();
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Called once per pass of a core's main loop. Only passes that did work count
+   towards the busy time, so the remainder is headroom. */
+void core_utilization_update(coreUtilization *util, uint32_t start_us, bool busy)
+{
+	util->loops++;
+	if (busy)
+	{
+		uint32_t elapsed_us = time_us_32() - start_us;
+		util->busy_us += elapsed_us;
+		util->maxBusy_us = MAX(util->maxBusy_us, elapsed_us);
 	}
 }
 
@@ -259,22 +1554,36 @@ void pendingVCP_ledSequence(void)
 /*******************************************************************************
  * Sensing Support Functions
  ******************************************************************************/
+/* These answer from the background scanner's latest readings rather than
+   converting on demand, so never wait on the mux or ADC */
 float read_current(void)
 {
-	mux.select(servo2040::CURRENT_SENSE_ADDR);
-	return (cur_adc.read_current());
+	return (cur_adc.raw_to_current(sensors.read_average(servo2040::CURRENT_SENSE_ADDR)));
 }
 /*******************************************************************************
  ******************************************************************************/
 float read_voltage(void)
 {
-	mux.select(servo2040::VOLTAGE_SENSE_ADDR);
-	return (vol_adc.read_voltage());
+	return (vol_adc.raw_to_voltage(sensors.read_average(servo2040::VOLTAGE_SENSE_ADDR)));
 }
 /*******************************************************************************
  ******************************************************************************/
 float read_analogPin(uint sensorAddress)
 {
-	mux.select(sensorAddress);
-	return (sen_adc.read_voltage());
+	return (sen_adc.raw_to_voltage(sensors.read_average(sensorAddress)));
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Bit n is set while leg n's foot is down, with the legs in the same order as TS1 to TS6 */
+uint32_t read_foot_contacts(void)
+{
+	uint32_t contacts = 0;
+	for (uint leg = 0; leg < IK_LEGS; leg++)
+	{
+		if (read_analogPin(cmdPin_to_hardwarePin((cmdPins)(TS1 + leg))) > FOOT_CONTACT_V)
+		{
+			contacts |= 1u << leg;
+		}
+	}
+	return contacts;
 }
\ No newline at end of file
@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "chica_parser.h"
+
+/*******************************************************************************
+ * Parser Functions
+ ******************************************************************************/
+void chica_parser_reset(chicaParser *parser)
+{
+	parser->state = PARSE_WAIT_CMD;
+	parser->valueIdx = 0;
+	parser->resyncCount = 0;
+	parser->badCmdCount = 0;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Feed a single byte into the parser. Returns true, and copies the packet into
+   pkt_out, when the byte completes a SET, GET, KEY or PROTO packet. */
+bool chica_parser_feed(chicaParser *parser, uint8_t input, cmdPkt *pkt_out)
+{
+	// A command byte always starts a new packet, even if one was in progress
+	if (input & 0x80)
+	{
+		if (parser->state != PARSE_WAIT_CMD)
+		{
+			parser->resyncCount++;
+		}
+
+		parser->pkt.protocol = CHICA_PROTOCOL_LEGACY;
+		parser->pkt.batchMore = false;
+
+		if (input == SET_CMD)
+		{
+			parser->pkt.cmd = set;
+			parser->state = PARSE_START_IDX;
+		}
+		else if (input == GET_CMD)
+		{
+			parser->pkt.cmd = get;
+			parser->state = PARSE_START_IDX;
+		}
+		else if (input == KEY_CMD)
+		{
+			parser->pkt.cmd = key;
+			parser->state = PARSE_START_IDX;
+		}
+		else if (input == PROTO_CMD)
+		{
+			parser->pkt.cmd = proto;
+			parser->pkt.startIdx = 0;
+			parser->pkt.count = 1;
+			parser->state = PARSE_VERSION;
+		}
+		else
+		{
+			parser->badCmdCount++;
+			parser->state = PARSE_WAIT_CMD;
+		}
+		return false;
+	}
+
+	switch (parser->state)
+	{
+	case PARSE_WAIT_CMD:
+		break; // Data with no command in front of it, so discard
+
+	case PARSE_START_IDX:
+		parser->pkt.startIdx = input;
+		parser->state = PARSE_COUNT;
+		break;
+
+	case PARSE_COUNT:
+		parser->pkt.count = input;
+		parser->valueIdx = 0;
+
+		// KEY packets carry their easing and duration ahead of the values
+		if (parser->pkt.cmd == key)
+		{
+			parser->state = PARSE_EASING;
+			break;
+		}
+
+		// GET packets and empty SET packets have no values to follow
+		if (parser->pkt.cmd == get || parser->pkt.count == 0)
+		{
+			*pkt_out = parser->pkt;
+			parser->state = PARSE_WAIT_CMD;
+			return true;
+		}
+		parser->state = PARSE_VALUE_LO;
+		break;
+
+	case PARSE_EASING:
+		parser->pkt.easing = input;
+		parser->state = PARSE_DURATION_LO;
+		break;
+
+	case PARSE_DURATION_LO:
+		parser->pkt.durationMs = input;
+		parser->state = PARSE_DURATION_HI;
+		break;
+
+	case PARSE_DURATION_HI:
+		parser->pkt.durationMs |= (unsigned int)input << 7;
+
+		// Empty KEY packets have no values to follow
+		if (parser->pkt.count == 0)
+		{
+			*pkt_out = parser->pkt;
+			parser->state = PARSE_WAIT_CMD;
+			return true;
+		}
+		parser->state = PARSE_VALUE_LO;
+		break;
+
+	case PARSE_VERSION:
+		parser->pkt.valueBuff[0] = input;
+		*pkt_out = parser->pkt;
+		parser->state = PARSE_WAIT_CMD;
+		return true;
+
+	case PARSE_VALUE_LO:
+		parser->pkt.valueBuff[parser->valueIdx] = input;
+		parser->state = PARSE_VALUE_HI;
+		break;
+
+	case PARSE_VALUE_HI:
+		parser->pkt.valueBuff[parser->valueIdx] |= (unsigned int)input << 7;
+		parser->valueIdx++;
+
+		if (parser->valueIdx >= parser->pkt.count)
+		{
+			*pkt_out = parser->pkt;
+			parser->state = PARSE_WAIT_CMD;
+			return true;
+		}
+		parser->state = PARSE_VALUE_LO;
+		break;
+	}
+
+	return false;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Commands */
+#define SET_CMD	0xD3 // 0x53 & 0x80
+#define GET_CMD	0xC7 // 0x47 & 0x80
+#define KEY_CMD	0xCB // 0x4B & 0x80, timed keyframe for the onboard interpolator
+#define PROTO_CMD	0xD0 // 0x50 & 0x80, protocol version request
+
+/* Protocol versions, as requested by PROTO_CMD */
+#define CHICA_PROTOCOL_LEGACY	1	// 7-bit command packets, as used by the Chica server
+#define CHICA_PROTOCOL_V2		2	// Length prefixed, CRC checked frames, see chica_v2.h
+
+/* Miscellaneous */
+#define MAX_COUNT_VALUE		127
+
+/*******************************************************************************
+ * Enumerations
+ ******************************************************************************/
+typedef enum {
+	set,
+	get,
+	key,
+	proto,
+	schedule,	// v2 only
+	clockSync,	// v2 only
+	maskSet,	// v2 only
+	poseSet,	// v2 only
+	feetSet,	// v2 only
+	legConfig,	// v2 only
+	walkSet,	// v2 only
+	gaitConfig	// v2 only
+} hexapodCmds;
+
+typedef enum {
+	PARSE_WAIT_CMD,		// Waiting for a byte with 0x80 set
+	PARSE_START_IDX,
+	PARSE_COUNT,
+	PARSE_EASING,		// KEY packets only
+	PARSE_DURATION_LO,	// KEY packets only
+	PARSE_DURATION_HI,	// KEY packets only
+	PARSE_VERSION,		// PROTO packets only
+	PARSE_VALUE_LO,
+	PARSE_VALUE_HI
+} parserStates;
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+typedef struct {
+	hexapodCmds cmd;
+	unsigned int startIdx;
+	unsigned int count;
+	unsigned int easing;		// KEY packets only
+	unsigned int durationMs;	// KEY packets only
+	uint32_t due_us;			// SCHED packets only, device time the SET is to be applied
+	uint32_t mask;				// MASK packets only, bit n set for each cmdPin n with a value
+	uint32_t arrival_us;		// When core 1 finished parsing the packet
+	unsigned int protocol;		// Framing the packet arrived in, and so the framing of its reply
+	bool batchMore;				// More SET or KEY packets follow from the same frame
+	unsigned int valueBuff[MAX_COUNT_VALUE];	// PROTO packets hold the version in the first value
+} cmdPkt;
+
+/* Parser state is kept between calls, so a packet may arrive split across any
+   number of reads without ever blocking the caller */
+typedef struct {
+	parserStates state;
+	unsigned int valueIdx;
+	cmdPkt pkt;
+	uint32_t resyncCount;	// Packets abandoned because a new command byte arrived mid-packet
+	uint32_t badCmdCount;	// Command bytes that were not SET, GET, KEY or PROTO
+} chicaParser;
+
+/*******************************************************************************
+ * Parser Functions
+ ******************************************************************************/
+void chica_parser_reset(
+chicaParser *parser
+);
+
+bool chica_parser_feed(
+chicaParser *parser,
+uint8_t input,
+cmdPkt *pkt_out
+);
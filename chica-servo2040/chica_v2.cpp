@@ -0,0 +1,417 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "chica_v2.h"
+
+/*******************************************************************************
+ * Lookup Tables
+ ******************************************************************************/
+/* CRC-16/CCITT (polynomial 0x1021) of each nibble, to process a byte in two
+   lookups without spending 512 bytes on a full table */
+static const uint16_t crc16_nibble_table[16] =
+{
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/*******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+static uint16_t read_u16(const uint8_t *data)
+{
+	return (uint16_t)(data[0] | (data[1] << 8));
+}
+/*******************************************************************************
+ ******************************************************************************/
+static int32_t read_s16(const uint8_t *data)
+{
+	return (int16_t)read_u16(data);
+}
+/*******************************************************************************
+ ******************************************************************************/
+static uint32_t read_u32(const uint8_t *data)
+{
+	return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Size of the sub-command at the start of data, or 0 if it is unknown, does not
+   fit in the remaining bytes or carries more values than a cmdPkt holds */
+static unsigned int sub_cmd_size(const uint8_t *data, unsigned int remaining)
+{
+	unsigned int size;
+	unsigned int countIdx;	// Where the count of the values that follow is, or 0 for none
+
+	switch (data[0])
+	{
+	case V2_SUB_SET:
+		size = 3;
+		countIdx = 2;
+		break;
+
+	case V2_SUB_GET:
+		size = 3;
+		countIdx = 0;
+		break;
+
+	case V2_SUB_KEY:
+		size = 6;
+		countIdx = 2;
+		break;
+
+	case V2_SUB_PROTO:
+		size = 2;
+		countIdx = 0;
+		break;
+
+	case V2_SUB_SCHED:
+		size = 7;
+		countIdx = 6;
+		break;
+
+	case V2_SUB_CLOCK:
+		size = 1;
+		countIdx = 0;
+		break;
+
+	case V2_SUB_MASK:
+		if (remaining < 5)
+		{
+			return 0;
+		}
+		size = 5 + (2 * __builtin_popcount(read_u32(&data[1])));
+		countIdx = 0;
+		break;
+
+	case V2_SUB_POSE:
+		size = 13;
+		countIdx = 0;
+		break;
+
+	case V2_SUB_FEET:
+		if (remaining < 2)
+		{
+			return 0;
+		}
+		size = 2 + (6 * __builtin_popcount(data[1] & ((1 << IK_LEGS) - 1)));
+		countIdx = 0;
+		break;
+
+	case V2_SUB_LEG:
+		size = 3 + (4 * V2_LEG_WORDS);
+		countIdx = 0;
+		break;
+
+	case V2_SUB_WALK:
+		size = 7;
+		countIdx = 0;
+		break;
+
+	case V2_SUB_GAIT:
+		size = 6;
+		countIdx = 0;
+		break;
+
+	default:
+		return 0;
+	}
+
+	if (size > remaining)
+	{
+		return 0;
+	}
+	if (data[0] == V2_SUB_GET && data[2] > MAX_COUNT_VALUE)
+	{
+		return 0;
+	}
+	if (countIdx > 0)
+	{
+		if (data[countIdx] > MAX_COUNT_VALUE)
+		{
+			return 0;
+		}
+
+		// Each value follows as 2 bytes
+		size += 2 * data[countIdx];
+		if (size > remaining)
+		{
+			return 0;
+		}
+	}
+	return size;
+}
+
+/*******************************************************************************
+ * V2 Functions
+ ******************************************************************************/
+void chica_v2_reset(chicaV2Parser *parser)
+{
+	parser->state = V2_WAIT_SYNC0;
+	parser->len = 0;
+	parser->idx = 0;
+	parser->frameCount = 0;
+	parser->crcErrors = 0;
+	parser->lengthErrors = 0;
+	parser->decodeErrors = 0;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Feed a single byte into the parser. Returns true when the byte completes a
+   frame that passed its CRC, which is then held in the parser until the next
+   call. A corrupt frame is dropped and the parser hunts for the next sync word,
+   so the stream recovers by itself at the following frame. */
+bool chica_v2_feed(chicaV2Parser *parser, uint8_t input)
+{
+	switch (parser->state)
+	{
+	case V2_WAIT_SYNC0:
+		if (input == V2_SYNC0)
+		{
+			parser->state = V2_WAIT_SYNC1;
+		}
+		break;
+
+	case V2_WAIT_SYNC1:
+		// A repeated first sync byte may still be the start of a frame
+		if (input == V2_SYNC1)
+		{
+			parser->state = V2_LEN_LO;
+		}
+		else if (input != V2_SYNC0)
+		{
+			parser->state = V2_WAIT_SYNC0;
+		}
+		break;
+
+	case V2_LEN_LO:
+		parser->crc = chica_v2_crc_update(V2_CRC_INIT, input);
+		parser->len = input;
+		parser->state = V2_LEN_HI;
+		break;
+
+	case V2_LEN_HI:
+		parser->crc = chica_v2_crc_update(parser->crc, input);
+		parser->len |= (uint16_t)input << 8;
+		if (parser->len == 0 || parser->len > V2_MAX_PAYLOAD)
+		{
+			parser->lengthErrors++;
+			parser->state = V2_WAIT_SYNC0;
+			break;
+		}
+		parser->idx = 0;
+		parser->state = V2_PAYLOAD;
+		break;
+
+	case V2_PAYLOAD:
+		parser->crc = chica_v2_crc_update(parser->crc, input);
+		parser->payload[parser->idx++] = input;
+		if (parser->idx >= parser->len)
+		{
+			parser->state = V2_CRC_LO;
+		}
+		break;
+
+	case V2_CRC_LO:
+		parser->rxCrc = input;
+		parser->state = V2_CRC_HI;
+		break;
+
+	case V2_CRC_HI:
+		parser->rxCrc |= (uint16_t)input << 8;
+		parser->state = V2_WAIT_SYNC0;
+		if (parser->rxCrc != parser->crc)
+		{
+			parser->crcErrors++;
+			break;
+		}
+		return true;
+	}
+
+	return false;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Check every sub-command in the frame just completed, so a malformed frame is
+   rejected as a whole rather than being applied in part. Returns the number of
+   SET, MASK, KEY, POSE and FEET sub-commands through motionCount. */
+bool chica_v2_validate(chicaV2Parser *parser, unsigned int *motionCount)
+{
+	unsigned int offset = 0;
+	unsigned int motion = 0;
+
+	while (offset < parser->len)
+	{
+		unsigned int size = sub_cmd_size(&parser->payload[offset], parser->len - offset);
+		if (size == 0)
+		{
+			parser->decodeErrors++;
+			return false;
+		}
+
+		uint8_t sub = parser->payload[offset];
+		if (sub == V2_SUB_SET || sub == V2_SUB_MASK || sub == V2_SUB_KEY || sub == V2_SUB_POSE || sub == V2_SUB_FEET)
+		{
+			motion++;
+		}
+		offset += size;
+	}
+
+	parser->frameCount++;
+	*motionCount = motion;
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Decode the sub-command at offset into pkt_out and move offset on to the next.
+   Returns false once the frame is used up. Only call on a validated frame. */
+bool chica_v2_next(const chicaV2Parser *parser, unsigned int *offset, cmdPkt *pkt_out)
+{
+	if (*offset >= parser->len)
+	{
+		return false;
+	}
+
+	const uint8_t *data = &parser->payload[*offset];
+	const uint8_t *values;
+
+	pkt_out->protocol = CHICA_PROTOCOL_V2;
+	pkt_out->batchMore = false;
+
+	switch (data[0])
+	{
+	case V2_SUB_SET:
+		pkt_out->cmd = set;
+		pkt_out->startIdx = data[1];
+		pkt_out->count = data[2];
+		values = &data[3];
+		break;
+
+	case V2_SUB_GET:
+		pkt_out->cmd = get;
+		pkt_out->startIdx = data[1];
+		pkt_out->count = data[2];
+		values = nullptr;
+		break;
+
+	case V2_SUB_KEY:
+		pkt_out->cmd = key;
+		pkt_out->startIdx = data[1];
+		pkt_out->count = data[2];
+		pkt_out->easing = data[3];
+		pkt_out->durationMs = read_u16(&data[4]);
+		values = &data[6];
+		break;
+
+	case V2_SUB_PROTO:
+		pkt_out->cmd = proto;
+		pkt_out->startIdx = 0;
+		pkt_out->count = 1;
+		pkt_out->valueBuff[0] = data[1];
+		values = nullptr;
+		break;
+
+	case V2_SUB_SCHED:
+		pkt_out->cmd = schedule;
+		pkt_out->due_us = read_u32(&data[1]);
+		pkt_out->startIdx = data[5];
+		pkt_out->count = data[6];
+		values = &data[7];
+		break;
+
+	case V2_SUB_MASK:
+		pkt_out->cmd = maskSet;
+		pkt_out->mask = read_u32(&data[1]);
+		pkt_out->startIdx = 0;
+		pkt_out->count = __builtin_popcount(pkt_out->mask);
+		values = &data[5];
+		break;
+
+	case V2_SUB_POSE:
+		// Widened to Q16.16, and held in the values as two's complement
+		pkt_out->cmd = poseSet;
+		pkt_out->startIdx = 0;
+		pkt_out->count = 6;
+		for (unsigned int idx = 0; idx < 6; idx++)
+		{
+			unsigned int shift = (idx < 3) ? V2_LENGTH_SHIFT : V2_ANGLE_SHIFT;
+			pkt_out->valueBuff[idx] = (unsigned int)(read_s16(&data[1 + (2 * idx)]) * (1 << shift));
+		}
+		values = nullptr;
+		break;
+
+	case V2_SUB_FEET:
+		// Only the legs that exist are kept, so the values always match the mask
+		pkt_out->cmd = feetSet;
+		pkt_out->mask = data[1] & ((1 << IK_LEGS) - 1);
+		pkt_out->startIdx = 0;
+		pkt_out->count = 3 * __builtin_popcount(pkt_out->mask);
+		for (unsigned int idx = 0; idx < pkt_out->count; idx++)
+		{
+			pkt_out->valueBuff[idx] = (unsigned int)(read_s16(&data[2 + (2 * idx)]) * (1 << V2_LENGTH_SHIFT));
+		}
+		values = nullptr;
+		break;
+
+	case V2_SUB_LEG:
+		pkt_out->cmd = legConfig;
+		pkt_out->startIdx = data[1];
+		pkt_out->count = V2_LEG_WORDS + 1;
+		for (unsigned int idx = 0; idx < V2_LEG_WORDS; idx++)
+		{
+			pkt_out->valueBuff[idx] = read_u32(&data[2 + (4 * idx)]);
+		}
+		pkt_out->valueBuff[V2_LEG_WORDS] = data[2 + (4 * V2_LEG_WORDS)];
+		values = nullptr;
+		break;
+
+	case V2_SUB_WALK:
+		// Widened to Q16.16, and held in the values as two's complement
+		pkt_out->cmd = walkSet;
+		pkt_out->startIdx = 0;
+		pkt_out->count = 3;
+		pkt_out->valueBuff[0] = (unsigned int)(read_s16(&data[1]) * (1 << IK_Q16_SHIFT));
+		pkt_out->valueBuff[1] = (unsigned int)(read_s16(&data[3]) * (1 << IK_Q16_SHIFT));
+		pkt_out->valueBuff[2] = (unsigned int)(read_s16(&data[5]) * (1 << V2_ANGLE_SHIFT));
+		values = nullptr;
+		break;
+
+	case V2_SUB_GAIT:
+		pkt_out->cmd = gaitConfig;
+		pkt_out->startIdx = 0;
+		pkt_out->count = 3;
+		pkt_out->valueBuff[0] = data[1];
+		pkt_out->valueBuff[1] = read_u16(&data[2]) * 1000;
+		pkt_out->valueBuff[2] = (unsigned int)(read_s16(&data[4]) * (1 << V2_LENGTH_SHIFT));
+		values = nullptr;
+		break;
+
+	default: // V2_SUB_CLOCK
+		pkt_out->cmd = clockSync;
+		pkt_out->startIdx = 0;
+		pkt_out->count = 0;
+		values = nullptr;
+		break;
+	}
+
+	if (values != nullptr)
+	{
+		for (unsigned int idx = 0; idx < pkt_out->count; idx++)
+		{
+			pkt_out->valueBuff[idx] = read_u16(&values[2 * idx]);
+		}
+	}
+
+	*offset += sub_cmd_size(data, parser->len - *offset);
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* CRC-16/CCITT-FALSE, start from V2_CRC_INIT */
+uint16_t chica_v2_crc_update(uint16_t crc, uint8_t byte)
+{
+	crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (byte >> 4)];
+	crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (byte & 0x0F)];
+	return crc;
+}
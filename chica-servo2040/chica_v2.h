@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include "chica_parser.h"
+#include "kinematics.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Frame layout:
+	SYNC0, SYNC1, LEN_LO, LEN_HI, payload[LEN], CRC_LO, CRC_HI
+   The CRC is CRC-16/CCITT-FALSE over the length and payload. The payload is
+   any number of sub-commands back to back, with all values 16-bit little endian:
+	SET:	V2_SUB_SET, startIdx, count, value[count]
+	GET:	V2_SUB_GET, startIdx, count
+	KEY:	V2_SUB_KEY, startIdx, count, easing, durationMs, value[count]
+	PROTO:	V2_SUB_PROTO, version
+	SCHED:	V2_SUB_SCHED, due_us (32-bit), startIdx, count, value[count]
+	CLOCK:	V2_SUB_CLOCK
+	MASK:	V2_SUB_MASK, mask (32-bit), value[one per set bit, lowest bit first]
+	POSE:	V2_SUB_POSE, x, y, z (Q12.4 mm), roll, pitch, yaw (Q8.8 degrees)
+	FEET:	V2_SUB_FEET, legMask, [x, y, z (Q12.4 mm)] per set bit, lowest bit first
+	LEG:	V2_SUB_LEG, leg, mount x, y, z, mountYaw, coxa, femur, tibia, zero[3]
+			(all 32-bit Q16.16 mm or degrees), inverted joint bits
+	WALK:	V2_SUB_WALK, vx, vy (mm/s), yawRate (Q8.8 degrees/s)
+	GAIT:	V2_SUB_GAIT, type, period (ms), stepHeight (Q12.4 mm)
+   GET replies are sent as a frame holding a single GET sub-command with its
+   values. PROTO is acknowledged with a frame holding the same sub-command.
+   CLOCK is answered with V2_SUB_CLOCK, rx_us (32-bit), tx_us (32-bit), the
+   device times the request was received and the reply was assembled. A GET the
+   device cannot answer is refused with V2_SUB_ERROR, V2_SUB_GET, startIdx, count. */
+#define V2_SYNC0			0xA5
+#define V2_SYNC1			0x5A
+#define V2_MAX_PAYLOAD		512
+#define V2_HEADER_SIZE		4	// Sync and length
+#define V2_CRC_SIZE			2
+#define V2_CRC_INIT			0xFFFF
+#define V2_LENGTH_SHIFT		12	// POSE and FEET lengths are Q12.4, and are widened to Q16.16
+#define V2_ANGLE_SHIFT		8	// POSE angles are Q8.8, and are widened to Q16.16
+#define V2_LEG_WORDS		10	// 32-bit fields in a LEG sub-command
+
+/*******************************************************************************
+ * Enumerations
+ ******************************************************************************/
+typedef enum {
+	V2_SUB_SET = 0x01,
+	V2_SUB_GET = 0x02,
+	V2_SUB_KEY = 0x03,
+	V2_SUB_PROTO = 0x04,
+	V2_SUB_SCHED = 0x05,
+	V2_SUB_CLOCK = 0x06,
+	V2_SUB_MASK = 0x07,
+	V2_SUB_POSE = 0x08,
+	V2_SUB_FEET = 0x09,
+	V2_SUB_LEG = 0x0A,
+	V2_SUB_WALK = 0x0B,
+	V2_SUB_GAIT = 0x0C,
+	V2_SUB_ERROR = 0x0D		// Replies only
+} v2SubCmds;
+
+typedef enum {
+	V2_WAIT_SYNC0,
+	V2_WAIT_SYNC1,
+	V2_LEN_LO,
+	V2_LEN_HI,
+	V2_PAYLOAD,
+	V2_CRC_LO,
+	V2_CRC_HI
+} v2States;
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+typedef struct {
+	v2States state;
+	uint16_t len;
+	uint16_t idx;
+	uint16_t crc;			// Running CRC of the frame in progress
+	uint16_t rxCrc;
+	uint8_t payload[V2_MAX_PAYLOAD];
+	uint32_t frameCount;	// Frames that passed their CRC and decoded cleanly
+	uint32_t crcErrors;
+	uint32_t lengthErrors;	// Frames with a zero or oversized length
+	uint32_t decodeErrors;	// Frames that passed their CRC but held a malformed sub-command
+} chicaV2Parser;
+
+/*******************************************************************************
+ * V2 Functions
+ ******************************************************************************/
+void chica_v2_reset(
+chicaV2Parser *parser
+);
+
+bool chica_v2_feed(
+chicaV2Parser *parser,
+uint8_t input
+);
+
+bool chica_v2_validate(
+chicaV2Parser *parser,
+unsigned int *motionCount
+);
+
+bool chica_v2_next(
+const chicaV2Parser *parser,
+unsigned int *offset,
+cmdPkt *pkt_out
+);
+
+uint16_t chica_v2_crc_update(
+uint16_t crc,
+uint8_t byte
+);
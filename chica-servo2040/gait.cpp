@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "gait.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define PHASE_SIXTH			(0x100000000ULL / 6)
+#define PHASE_FULL			0x100000000ULL
+#define DEG_TO_RAD_Q30		18740330	// pi / 180 in Q2.30
+#define HALF_TURN_Q16		(180 << IK_Q16_SHIFT)
+
+/*******************************************************************************
+ * Lookup Tables
+ ******************************************************************************/
+/* Fraction of each leg's phase spent standing, in sixths of a cycle */
+static const uint8_t gait_duty_sixths[GAIT_num] = {3, 4, 5};
+
+/* Each leg's phase offset in sixths of a cycle, legs 0 to 2 down the left side
+   from the front and legs 3 to 5 down the right. Legs swing in order of
+   decreasing offset. */
+static const uint8_t gait_offset_sixths[GAIT_num][IK_LEGS] =
+{
+	{0, 3, 0, 3, 0, 3},		// Tripod: L1, L3 and R2 then L2, R1 and R3
+	{0, 2, 4, 3, 5, 1},		// Ripple: each side back to front, the sides half a cycle apart
+	{0, 1, 2, 3, 4, 5}		// Wave: R3, R2, R1, L3, L2 then L1
+};
+
+/*******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+static int32_t scale_q16(int32_t value, int32_t scale)
+{
+	return (int32_t)(((int64_t)value * scale) >> IK_Q16_SHIFT);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* How far the ground under the foot at (x, y) moves in dt_us, relative to the
+   body, for the commanded velocity and turn rate */
+static void ground_motion(const gaitEngine *gait, int32_t x, int32_t y, uint64_t dt_us, int32_t *dx_out, int32_t *dy_out)
+{
+	int32_t yawRate_rad = (int32_t)(((int64_t)gait->yawRate * DEG_TO_RAD_Q30) >> IK_Q30_SHIFT);
+
+	// The body moving at v and turning at w is the ground moving at -(v + w x r)
+	int64_t fx = (int64_t)gait->vx - scale_q16(y, yawRate_rad);
+	int64_t fy = (int64_t)gait->vy + scale_q16(x, yawRate_rad);
+
+	*dx_out = (int32_t)(-(fx * (int64_t)dt_us) / 1000000);
+	*dy_out = (int32_t)(-(fy * (int64_t)dt_us) / 1000000);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Where a swing lands: half a stride ahead of neutral, so the stance that
+   follows carries the foot to half a stride behind it */
+static void swing_target(const gaitEngine *gait, unsigned int leg, uint64_t stance_us, ikVec *target_out)
+{
+	const ikVec *n = &gait->neutral[leg];
+	int32_t dx, dy;
+	ground_motion(gait, n->x, n->y, stance_us, &dx, &dy);
+
+	target_out->x = n->x - (dx / 2);
+	target_out->y = n->y - (dy / 2);
+	target_out->z = n->z;
+}
+
+/*******************************************************************************
+ * Gait Functions
+ ******************************************************************************/
+void gait_init(gaitEngine *gait, const ikVec *neutral)
+{
+	gait->type = GAIT_TRIPOD;
+	gait->period_us = GAIT_DEFAULT_PERIOD_US;
+	gait->stepHeight = GAIT_DEFAULT_STEP_HEIGHT;
+	for (unsigned int leg = 0; leg < IK_LEGS; leg++)
+	{
+		gait->neutral[leg] = neutral[leg];
+	}
+
+	gait->cycleCount = 0;
+	gait->earlyTouchdowns = 0;
+	gait_stop(gait);
+}
+/*******************************************************************************
+ ******************************************************************************/
+void gait_set_neutral(gaitEngine *gait, unsigned int leg, const ikVec *neutral)
+{
+	if (leg < IK_LEGS)
+	{
+		gait->neutral[leg] = *neutral;
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+void gait_configure(gaitEngine *gait, gaitTypes type, uint32_t period_us, int32_t stepHeight)
+{
+	gait->type = (type < GAIT_num) ? type : GAIT_TRIPOD;
+	gait->period_us = (period_us > GAIT_MIN_PERIOD_US) ? period_us : GAIT_MIN_PERIOD_US;
+	gait->stepHeight = stepHeight;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Walk at the given velocity. At zero the gait steps through one more cycle,
+   bringing every foot back to neutral, then stops once the last foot is down. */
+void gait_set_velocity(gaitEngine *gait, int32_t vx, int32_t vy, int32_t yawRate)
+{
+	gait->vx = vx;
+	gait->vy = vy;
+	gait->yawRate = yawRate;
+
+	if (vx != 0 || vy != 0 || yawRate != 0)
+	{
+		if (!gait->running)
+		{
+			// Start standing, so no leg begins part way through a swing
+			gait->phase = 0;
+			for (unsigned int leg = 0; leg < IK_LEGS; leg++)
+			{
+				gait->leg[leg].inSwing = false;
+				gait->leg[leg].airborne = false;
+			}
+		}
+		gait->running = true;
+		gait->stopRemaining = PHASE_FULL;
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Stop straight away, with the feet wherever they are */
+void gait_stop(gaitEngine *gait)
+{
+	gait->vx = 0;
+	gait->vy = 0;
+	gait->yawRate = 0;
+	gait->running = false;
+	gait->stopRemaining = 0;
+	gait->phase = 0;
+	for (unsigned int leg = 0; leg < IK_LEGS; leg++)
+	{
+		gait->leg[leg].inSwing = false;
+		gait->leg[leg].airborne = false;
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool gait_is_running(const gaitEngine *gait)
+{
+	return gait->running;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Advance the gait by dt_us and move feet (in the body frame) to match. Bit n
+   of contactMask is set while leg n's foot sensor is pressed, which ends its
+   swing early if it comes down on something. Returns true when a cycle ends. */
+bool gait_update(gaitEngine *gait, uint32_t dt_us, uint32_t contactMask, ikVec *feet)
+{
+	if (!gait->running)
+	{
+		return false;
+	}
+
+	if (dt_us > GAIT_MAX_DT_US)
+	{
+		dt_us = GAIT_MAX_DT_US;
+	}
+
+	uint64_t advance = ((uint64_t)dt_us << 32) / gait->period_us;
+	uint32_t lastPhase = gait->phase;
+	gait->phase += (uint32_t)advance;
+	bool cycleEnd = (gait->phase < lastPhase);
+
+	uint32_t duty = (uint32_t)(gait_duty_sixths[gait->type] * PHASE_SIXTH);
+	uint32_t swingLength = (uint32_t)(PHASE_FULL - duty);
+	uint64_t stance_us = ((uint64_t)gait->period_us * duty) >> 32;
+
+	// Once the cycle at zero velocity is through, let the swings in progress land but start no more
+	bool stationary = (gait->vx == 0 && gait->vy == 0 && gait->yawRate == 0);
+	if (stationary)
+	{
+		gait->stopRemaining = (gait->stopRemaining > advance) ? gait->stopRemaining - advance : 0;
+	}
+	bool settling = stationary && (gait->stopRemaining == 0);
+	bool anyAirborne = false;
+
+	for (unsigned int leg = 0; leg < IK_LEGS; leg++)
+	{
+		gaitLeg *l = &gait->leg[leg];
+		ikVec *foot = &feet[leg];
+		uint32_t legPhase = gait->phase + (uint32_t)(gait_offset_sixths[gait->type][leg] * PHASE_SIXTH);
+		bool inSwing = (legPhase >= duty);
+
+		if (inSwing && !l->inSwing && !settling)
+		{
+			l->airborne = true;
+			l->liftOff = *foot;
+		}
+		else if (!inSwing && l->inSwing && l->airborne)
+		{
+			// The swing is over, so put the foot down exactly where it was headed
+			swing_target(gait, leg, stance_us, foot);
+			l->airborne = false;
+		}
+		l->inSwing = inSwing;
+
+		if (l->airborne)
+		{
+			ikVec target;
+			swing_target(gait, leg, stance_us, &target);
+
+			// Progress through the swing, 0 to 180 degrees, eased at both ends
+			int32_t progress = (int32_t)(((uint64_t)(legPhase - duty) * HALF_TURN_Q16) / swingLength);
+			int32_t ease = (IK_Q30_ONE - ik_cos_q30(progress)) >> (IK_Q30_SHIFT - IK_Q16_SHIFT + 1);
+			int32_t lift = scale_q16(gait->stepHeight, ik_sin_q30(progress) >> (IK_Q30_SHIFT - IK_Q16_SHIFT));
+
+			foot->x = l->liftOff.x + scale_q16(target.x - l->liftOff.x, ease);
+			foot->y = l->liftOff.y + scale_q16(target.y - l->liftOff.y, ease);
+			foot->z = l->liftOff.z + scale_q16(target.z - l->liftOff.z, ease) + lift;
+
+			// Only a contact on the way down counts, so the foot leaving the ground does not end its own swing
+			if ((contactMask & (1u << leg)) && progress > (HALF_TURN_Q16 / 2))
+			{
+				l->airborne = false;
+				gait->earlyTouchdowns++;
+			}
+			anyAirborne |= l->airborne;
+		}
+		else
+		{
+			int32_t dx, dy;
+			ground_motion(gait, foot->x, foot->y, dt_us, &dx, &dy);
+			foot->x += dx;
+			foot->y += dy;
+		}
+	}
+
+	if (settling && !anyAirborne)
+	{
+		gait->running = false;
+	}
+
+	if (cycleEnd)
+	{
+		gait->cycleCount++;
+	}
+	return cycleEnd;
+}
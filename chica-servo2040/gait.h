@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include "kinematics.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define GAIT_DEFAULT_PERIOD_US		1000000		// One full cycle, every leg stepping once
+#define GAIT_DEFAULT_STEP_HEIGHT	(30 << IK_Q16_SHIFT)	// Q16.16 mm
+#define GAIT_MIN_PERIOD_US			200000
+#define GAIT_MAX_DT_US				100000		// Longer gaps between updates are treated as this long
+
+/*******************************************************************************
+ * Enumerations
+ ******************************************************************************/
+typedef enum {
+	GAIT_TRIPOD,	// Alternating sets of 3 legs, fastest
+	GAIT_RIPPLE,	// 2 legs in the air at once
+	GAIT_WAVE,		// 1 leg in the air at once, most stable
+	GAIT_num
+} gaitTypes;
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+typedef struct {
+	bool inSwing;		// The leg's phase is in its swing window
+	bool airborne;		// Still in the air, cleared early by a touchdown
+	ikVec liftOff;		// Where the swing started
+} gaitLeg;
+
+/* Phases are Q0.32 fractions of a cycle, so they wrap by themselves. Each leg's
+   phase is the cycle's phase plus the leg's offset. A leg stands for the first
+   part of its phase, given by the gait's duty factor, and swings for the rest. */
+typedef struct {
+	/* Configuration */
+	gaitTypes type;
+	uint32_t period_us;
+	int32_t stepHeight;			// Q16.16 mm
+	ikVec neutral[IK_LEGS];		// Q16.16 mm, where each foot is centred in the body frame
+
+	/* Command */
+	int32_t vx;					// Q16.16 mm/s, forwards
+	int32_t vy;					// Q16.16 mm/s, left
+	int32_t yawRate;			// Q16.16 degrees/s, anticlockwise seen from above
+
+	/* State */
+	bool running;
+	uint64_t stopRemaining;		// Phase left to step through at zero velocity before stopping
+	uint32_t phase;
+	gaitLeg leg[IK_LEGS];
+
+	/* Counters */
+	uint32_t cycleCount;
+	uint32_t earlyTouchdowns;	// Swings ended early by a foot contact
+} gaitEngine;
+
+/*******************************************************************************
+ * Gait Functions
+ ******************************************************************************/
+void gait_init(
+gaitEngine *gait,
+const ikVec *neutral
+);
+
+void gait_set_neutral(
+gaitEngine *gait,
+unsigned int leg,
+const ikVec *neutral
+);
+
+void gait_configure(
+gaitEngine *gait,
+gaitTypes type,
+uint32_t period_us,
+int32_t stepHeight
+);
+
+void gait_set_velocity(
+gaitEngine *gait,
+int32_t vx,
+int32_t vy,
+int32_t yawRate
+);
+
+void gait_stop(
+gaitEngine *gait
+);
+
+bool gait_is_running(
+const gaitEngine *gait
+);
+
+bool gait_update(
+gaitEngine *gait,
+uint32_t dt_us,
+uint32_t contactMask,
+ikVec *feet
+);
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "interpolator.h"
+
+/*******************************************************************************
+ * Interpolator Functions
+ ******************************************************************************/
+void interp_reset(interpolator *interp)
+{
+	for (unsigned int i = 0; i < INTERP_MAX_CHANNELS; i++)
+	{
+		interp->channel[i].active = false;
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+void interp_start(interpolator *interp, unsigned int channel, int32_t startPulse, int32_t targetPulse,
+				  uint64_t now_us, uint32_t duration_us, easingTypes easing)
+{
+	if (channel >= INTERP_MAX_CHANNELS)
+	{
+		return;
+	}
+
+	interpChannel *ch = &interp->channel[channel];
+	ch->startPulse = startPulse;
+	ch->targetPulse = targetPulse;
+	ch->start_us = now_us;
+	ch->duration_us = duration_us;
+	ch->easing = (easing < EASE_num) ? easing : EASE_LINEAR;
+	ch->active = true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+void interp_cancel(interpolator *interp, unsigned int channel)
+{
+	if (channel < INTERP_MAX_CHANNELS)
+	{
+		interp->channel[channel].active = false;
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Writes the channel's pulse at now_us into pulse_out and returns true, or
+   returns false if the channel has no keyframe running. The final sample of a
+   keyframe is always exactly the target, after which the channel goes idle. */
+bool interp_sample(interpolator *interp, unsigned int channel, uint64_t now_us, int32_t *pulse_out)
+{
+	if (channel >= INTERP_MAX_CHANNELS || !interp->channel[channel].active)
+	{
+		return false;
+	}
+
+	interpChannel *ch = &interp->channel[channel];
+	uint64_t elapsed_us = now_us - ch->start_us;
+
+	if (elapsed_us >= ch->duration_us)
+	{
+		*pulse_out = ch->targetPulse;
+		ch->active = false;
+		return true;
+	}
+
+	// Progress through the keyframe, 0 to 1 in Q16.16
+	int64_t t = (int64_t)((elapsed_us << INTERP_Q16_SHIFT) / ch->duration_us);
+
+	if (ch->easing == EASE_CUBIC)
+	{
+		// 3t^2 - 2t^3
+		int64_t t2 = (t * t) >> INTERP_Q16_SHIFT;
+		t = (t2 * ((3 * INTERP_Q16_ONE) - (2 * t))) >> INTERP_Q16_SHIFT;
+	}
+
+	int64_t delta = (int64_t)ch->targetPulse - ch->startPulse;
+	*pulse_out = ch->startPulse + (int32_t)((delta * t) >> INTERP_Q16_SHIFT);
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define INTERP_MAX_CHANNELS		21		// One per servo, SERVO1 to SERVO21
+#define INTERP_Q16_SHIFT		16		// Pulses and progress are Q16.16
+#define INTERP_Q16_ONE			(1 << INTERP_Q16_SHIFT)
+
+/*******************************************************************************
+ * Enumerations
+ ******************************************************************************/
+typedef enum {
+	EASE_LINEAR,
+	EASE_CUBIC,		// Smoothstep, so each keyframe starts and ends at rest
+	EASE_num
+} easingTypes;
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+typedef struct {
+	bool active;
+	easingTypes easing;
+	int32_t startPulse;		// Q16.16 microseconds
+	int32_t targetPulse;	// Q16.16 microseconds
+	uint64_t start_us;
+	uint32_t duration_us;
+} interpChannel;
+
+/* Each channel runs its own keyframe, so a KEY packet for some servos does not
+   disturb a keyframe still in progress on the others */
+typedef struct {
+	interpChannel channel[INTERP_MAX_CHANNELS];
+} interpolator;
+
+/*******************************************************************************
+ * Interpolator Functions
+ ******************************************************************************/
+void interp_reset(
+interpolator *interp
+);
+
+void interp_start(
+interpolator *interp,
+unsigned int channel,
+int32_t startPulse,
+int32_t targetPulse,
+uint64_t now_us,
+uint32_t duration_us,
+easingTypes easing
+);
+
+void interp_cancel(
+interpolator *interp,
+unsigned int channel
+);
+
+bool interp_sample(
+interpolator *interp,
+unsigned int channel,
+uint64_t now_us,
+int32_t *pulse_out
+);
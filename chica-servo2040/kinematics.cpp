@@ -0,0 +1,406 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "kinematics.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define Q16(value)			((int32_t)((value) * (1 << IK_Q16_SHIFT)))
+#define SIN_TABLE_STEPS		128			// Entries across 0 to 90 degrees, plus one for 90 itself
+#define SIN_TABLE_STEP_Q30	13176795	// The spacing of those entries, in Q2.30 radians
+#define CORDIC_ITERATIONS	28
+#define CORDIC_SHIFT		24			// The arctangent table is Q8.24 degrees
+#define CORDIC_INPUT_BITS	30			// Vectors are scaled to this size, to leave headroom for the gain
+#define COSINE_RULE_BITS	30			// Sides are scaled to this size before squaring
+
+/*******************************************************************************
+ * Lookup Tables
+ ******************************************************************************/
+/* sin(90 * i / 128 degrees) in Q2.30 */
+static const int32_t sin_table[SIN_TABLE_STEPS + 1] =
+{
+	0, 13176464, 26350943, 39521455, 52686014, 65842639,
+	78989349, 92124163, 105245103, 118350194, 131437462, 144504935,
+	157550647, 170572633, 183568930, 196537583, 209476638, 222384147,
+	235258165, 248096755, 260897982, 273659918, 286380643, 299058239,
+	311690799, 324276419, 336813204, 349299266, 361732726, 374111709,
+	386434353, 398698801, 410903207, 423045732, 435124548, 447137835,
+	459083786, 470960600, 482766489, 494499676, 506158392, 517740883,
+	529245404, 540670223, 552013618, 563273883, 574449320, 585538248,
+	596538995, 607449906, 618269338, 628995660, 639627258, 650162530,
+	660599890, 670937767, 681174602, 691308855, 701339000, 711263525,
+	721080937, 730789757, 740388522, 749875788, 759250125, 768510122,
+	777654384, 786681534, 795590213, 804379079, 813046808, 821592095,
+	830013654, 838310216, 846480531, 854523370, 862437520, 870221790,
+	877875009, 885396022, 892783698, 900036924, 907154608, 914135678,
+	920979082, 927683790, 934248793, 940673101, 946955747, 953095785,
+	959092290, 964944360, 970651112, 976211688, 981625251, 986890984,
+	992008094, 996975812, 1001793390, 1006460100, 1010975242, 1015338134,
+	1019548121, 1023604567, 1027506862, 1031254418, 1034846671, 1038283080,
+	1041563127, 1044686319, 1047652185, 1050460278, 1053110176, 1055601479,
+	1057933813, 1060106826, 1062120190, 1063973603, 1065666786, 1067199483,
+	1068571464, 1069782521, 1070832474, 1071721163, 1072448455, 1073014240,
+	1073418433, 1073660973, 1073741824
+};
+
+/* atan(2^-i) in Q8.24 degrees */
+static const int32_t cordic_table[CORDIC_ITERATIONS] =
+{
+	754974720, 445687602, 235489088, 119537938, 60000934, 30029717,
+	15018523, 7509720, 3754917, 1877466, 938734, 469367,
+	234684, 117342, 58671, 29335, 14668, 7334,
+	3667, 1833, 917, 458, 229, 115,
+	57, 29, 14, 7
+};
+
+/*******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+static int64_t abs64(int64_t value)
+{
+	return (value < 0) ? -value : value;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Number of right shifts that bring the larger of a and b within bits */
+static unsigned int scale_shift(int64_t a, int64_t b, unsigned int bits)
+{
+	uint64_t largest = (uint64_t)((abs64(a) > abs64(b)) ? abs64(a) : abs64(b));
+	unsigned int shift = 0;
+	while ((largest >> shift) >= ((uint64_t)1 << bits))
+	{
+		shift++;
+	}
+	return shift;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* The angle opposite side c of a triangle, by the cosine rule. Returned as
+   atan2(sin, cos) to avoid any division, with both scaled by 2ab. Returns
+   false if the sides cannot form a triangle. */
+static bool cosine_rule(int64_t a, int64_t b, int64_t c, int32_t *angle_out)
+{
+	// Q16.16 mm sides give Q32.32 squares, so the products here need care
+	int64_t adjacent = (a * a) + (b * b) - (c * c);
+	int64_t hypotenuse = 2 * a * b;
+
+	unsigned int shift = scale_shift(adjacent, hypotenuse, COSINE_RULE_BITS);
+	adjacent >>= shift;
+	hypotenuse >>= shift;
+
+	int64_t oppositeSq = (hypotenuse * hypotenuse) - (adjacent * adjacent);
+	if (hypotenuse <= 0 || oppositeSq < 0)
+	{
+		return false;
+	}
+
+	*angle_out = ik_atan2((int64_t)ik_isqrt((uint64_t)oppositeSq), adjacent);
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Rotates v about z by the angle with the given sine and cosine */
+static void rotate_z(ikVec *v, int32_t sinA, int32_t cosA)
+{
+	int64_t x = v->x;
+	int64_t y = v->y;
+	v->x = (int32_t)(((x * cosA) - (y * sinA)) >> IK_Q30_SHIFT);
+	v->y = (int32_t)(((x * sinA) + (y * cosA)) >> IK_Q30_SHIFT);
+}
+
+/*******************************************************************************
+ * Kinematics Functions
+ ******************************************************************************/
+/* Typical 3-DOF hexapod proportions, with legs 0 to 2 down the left side from
+   the front and legs 3 to 5 down the right. Send the robot's own geometry with
+   ik_set_leg() before relying on the result. */
+void ik_init_default(ikModel *model)
+{
+	static const int16_t mounts[IK_LEGS][3] =
+	{
+		// x mm, y mm, yaw degrees
+		{ 80,  50,   45},
+		{  0,  65,   90},
+		{-80,  50,  135},
+		{ 80, -50,  -45},
+		{  0, -65,  -90},
+		{-80, -50, -135}
+	};
+
+	for (unsigned int leg = 0; leg < IK_LEGS; leg++)
+	{
+		ikLegConfig config;
+		config.mount.x = Q16(mounts[leg][0]);
+		config.mount.y = Q16(mounts[leg][1]);
+		config.mount.z = 0;
+		config.mountYaw = Q16(mounts[leg][2]);
+		config.length[IK_COXA] = Q16(40);
+		config.length[IK_FEMUR] = Q16(80);
+		config.length[IK_TIBIA] = Q16(130);
+		for (unsigned int joint = 0; joint < IK_JOINTS; joint++)
+		{
+			config.zero[joint] = 0;
+			config.direction[joint] = 1;
+		}
+		ik_set_leg(model, leg, &config);
+	}
+
+	model->solveCount = 0;
+	model->unreachableCount = 0;
+}
+/*******************************************************************************
+ ******************************************************************************/
+void ik_set_leg(ikModel *model, unsigned int leg, const ikLegConfig *config)
+{
+	if (leg >= IK_LEGS)
+	{
+		return;
+	}
+
+	ikLegConfig *l = &model->leg[leg];
+	*l = *config;
+	for (unsigned int joint = 0; joint < IK_JOINTS; joint++)
+	{
+		l->direction[joint] = (config->direction[joint] < 0) ? -1 : 1;
+	}
+	l->mountSin = ik_sin_q30(config->mountYaw);
+	l->mountCos = ik_cos_q30(config->mountYaw);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Where the foot is with every joint at 0, in the body frame */
+void ik_neutral_foot(const ikModel *model, unsigned int leg, ikVec *foot_out)
+{
+	if (leg >= IK_LEGS)
+	{
+		return;
+	}
+
+	const ikLegConfig *l = &model->leg[leg];
+	ikVec reach = {l->length[IK_COXA] + l->length[IK_FEMUR], 0, -l->length[IK_TIBIA]};
+	rotate_z(&reach, l->mountSin, l->mountCos);
+
+	foot_out->x = l->mount.x + reach.x;
+	foot_out->y = l->mount.y + reach.y;
+	foot_out->z = l->mount.z + reach.z;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Solves one leg for a foot given in the ground frame, with the body at pose.
+   Writes the 3 servo values (Q16.16 degrees) into values_out and returns true,
+   or returns false, leaving values_out alone, if the foot is out of reach. */
+bool ik_solve_leg(ikModel *model, unsigned int leg, const ikPose *pose, const ikVec *foot, int32_t *values_out)
+{
+	if (leg >= IK_LEGS)
+	{
+		return false;
+	}
+	const ikLegConfig *l = &model->leg[leg];
+
+	/* Take the foot into the body frame, by undoing the body's translation and
+	   then its rotation. R = Rz(yaw) Ry(pitch) Rx(roll), applied transposed */
+	int64_t sr = ik_sin_q30(pose->roll), cr = ik_cos_q30(pose->roll);
+	int64_t sp = ik_sin_q30(pose->pitch), cp = ik_cos_q30(pose->pitch);
+	int64_t sy = ik_sin_q30(pose->yaw), cy = ik_cos_q30(pose->yaw);
+
+	int64_t spcr = (sp * cr) >> IK_Q30_SHIFT;
+	int64_t spsr = (sp * sr) >> IK_Q30_SHIFT;
+	int64_t r[3][3] =
+	{
+		{(cy * cp) >> IK_Q30_SHIFT, ((cy * spsr) - (sy * cr)) >> IK_Q30_SHIFT, ((cy * spcr) + (sy * sr)) >> IK_Q30_SHIFT},
+		{(sy * cp) >> IK_Q30_SHIFT, ((sy * spsr) + (cy * cr)) >> IK_Q30_SHIFT, ((sy * spcr) - (cy * sr)) >> IK_Q30_SHIFT},
+		{-sp, (cp * sr) >> IK_Q30_SHIFT, (cp * cr) >> IK_Q30_SHIFT}
+	};
+
+	int64_t d[3] =
+	{
+		(int64_t)foot->x - pose->translation.x,
+		(int64_t)foot->y - pose->translation.y,
+		(int64_t)foot->z - pose->translation.z
+	};
+
+	int64_t body[3];
+	for (unsigned int row = 0; row < 3; row++)
+	{
+		body[row] = ((r[0][row] * d[0]) + (r[1][row] * d[1]) + (r[2][row] * d[2])) >> IK_Q30_SHIFT;
+	}
+
+	/* Then into the leg frame, x along the leg at coxa 0, origin at the coxa joint */
+	ikVec p = {(int32_t)(body[0] - l->mount.x), (int32_t)(body[1] - l->mount.y), (int32_t)(body[2] - l->mount.z)};
+	rotate_z(&p, -l->mountSin, l->mountCos);
+
+	int32_t angle[IK_JOINTS];
+	angle[IK_COXA] = ik_atan2(p.y, p.x);
+
+	/* The femur and tibia work in the vertical plane through the leg */
+	int64_t horizontal = (int64_t)ik_isqrt(((int64_t)p.x * p.x) + ((int64_t)p.y * p.y));
+	int64_t outward = horizontal - l->length[IK_COXA];
+	int64_t down = p.z;
+	int64_t reach = (int64_t)ik_isqrt((outward * outward) + (down * down));
+
+	int32_t femurToFoot;
+	int32_t knee;
+	if (reach == 0 ||
+		!cosine_rule(l->length[IK_FEMUR], reach, l->length[IK_TIBIA], &femurToFoot) ||
+		!cosine_rule(l->length[IK_FEMUR], l->length[IK_TIBIA], reach, &knee))
+	{
+		model->unreachableCount++;
+		return false;
+	}
+
+	// Knee up, so the femur sits above the line from the coxa to the foot
+	angle[IK_FEMUR] = ik_atan2(down, outward) + femurToFoot;
+	angle[IK_TIBIA] = knee - Q16(90);
+
+	for (unsigned int joint = 0; joint < IK_JOINTS; joint++)
+	{
+		values_out[joint] = (l->direction[joint] * angle[joint]) + l->zero[joint];
+	}
+	model->solveCount++;
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Solves each leg in legMask, writing servo values into values_out at
+   (leg * IK_JOINTS) + joint. Returns the mask of the legs that were solved. */
+uint32_t ik_solve(ikModel *model, const ikPose *pose, const ikVec *feet, uint32_t legMask, int32_t *values_out)
+{
+	uint32_t solved = 0;
+	for (unsigned int leg = 0; leg < IK_LEGS; leg++)
+	{
+		if ((legMask & (1u << leg)) &&
+			ik_solve_leg(model, leg, pose, &feet[leg], &values_out[leg * IK_JOINTS]))
+		{
+			solved |= 1u << leg;
+		}
+	}
+	return solved;
+}
+
+/*******************************************************************************
+ * Fixed Point Math Functions
+ ******************************************************************************/
+/* Sine of a Q16.16 degree angle, from the quarter wave table. Between entries
+   it uses sin(a + d) = sin(a)cos(d) + cos(a)sin(d), with cos(a) read from the
+   table backwards and the small d taken to second order. Accurate to about 3e-7,
+   where linear interpolation only managed 2e-5, which put feet 0.013mm out. */
+int32_t ik_sin_q30(int32_t angle)
+{
+	const int32_t fullTurn = Q16(360);
+	const int32_t quarterTurn = Q16(90);
+
+	int32_t a = angle % fullTurn;
+	if (a < 0)
+	{
+		a += fullTurn;
+	}
+
+	unsigned int quadrant = a / quarterTurn;
+	int32_t within = a % quarterTurn;
+	if (quadrant & 1)
+	{
+		within = quarterTurn - within;
+	}
+
+	int64_t position = ((int64_t)within * SIN_TABLE_STEPS * (1 << IK_Q16_SHIFT)) / quarterTurn;
+	unsigned int idx = (unsigned int)(position >> IK_Q16_SHIFT);
+	int64_t frac = position & ((1 << IK_Q16_SHIFT) - 1);
+
+	int64_t sinA = sin_table[idx];
+	int64_t cosA = sin_table[SIN_TABLE_STEPS - idx];
+	int64_t d = (frac * SIN_TABLE_STEP_Q30) >> IK_Q16_SHIFT;
+	int64_t halfDSq = (d * d) >> (IK_Q30_SHIFT + 1);
+
+	int32_t value = (int32_t)(sinA - ((sinA * halfDSq) >> IK_Q30_SHIFT) + ((cosA * d) >> IK_Q30_SHIFT));
+	return (quadrant >= 2) ? -value : value;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* The quarter turn is added in 64 bits, as angles within 90 degrees of the end
+   of the Q16.16 range would otherwise overflow */
+int32_t ik_cos_q30(int32_t angle)
+{
+	return ik_sin_q30((int32_t)(((int64_t)angle + Q16(90)) % Q16(360)));
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Angle of (x, y) in Q16.16 degrees, -180 to 180, by CORDIC vectoring. x and y
+   may be in any units, as only their ratio matters. */
+int32_t ik_atan2(int64_t y, int64_t x)
+{
+	if (x == 0 && y == 0)
+	{
+		return 0;
+	}
+
+	// Bring the vector into the right half plane, where CORDIC converges
+	int64_t angle = 0;
+	if (x < 0)
+	{
+		angle = (y >= 0) ? ((int64_t)180 << CORDIC_SHIFT) : -((int64_t)180 << CORDIC_SHIFT);
+		x = -x;
+		y = -y;
+	}
+
+	// Scale to a fixed size, so small vectors keep their precision and large ones have room for the gain
+	unsigned int shift = scale_shift(x, y, CORDIC_INPUT_BITS);
+	x >>= shift;
+	y >>= shift;
+	while (shift == 0 && abs64(x) < ((int64_t)1 << (CORDIC_INPUT_BITS - 1)) && abs64(y) < ((int64_t)1 << (CORDIC_INPUT_BITS - 1)))
+	{
+		x <<= 1;
+		y <<= 1;
+	}
+
+	for (unsigned int i = 0; i < CORDIC_ITERATIONS; i++)
+	{
+		int64_t xNext;
+		if (y > 0)
+		{
+			xNext = x + (y >> i);
+			y -= x >> i;
+			angle += cordic_table[i];
+		}
+		else
+		{
+			xNext = x - (y >> i);
+			y += x >> i;
+			angle -= cordic_table[i];
+		}
+		x = xNext;
+	}
+
+	// Round from Q8.24 to Q16.16
+	return (int32_t)((angle + (1 << (CORDIC_SHIFT - IK_Q16_SHIFT - 1))) >> (CORDIC_SHIFT - IK_Q16_SHIFT));
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Integer square root, rounded down */
+uint64_t ik_isqrt(uint64_t value)
+{
+	uint64_t root = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
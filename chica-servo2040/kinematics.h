@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define IK_LEGS				6
+#define IK_JOINTS			3		// Coxa, femur and tibia, driven by servos (leg * IK_JOINTS) + joint
+#define IK_Q16_SHIFT		16		// Lengths are Q16.16 millimetres and angles Q16.16 degrees
+#define IK_Q30_SHIFT		30		// Sines, cosines and rotation matrices are Q2.30
+#define IK_Q30_ONE			(1 << IK_Q30_SHIFT)
+
+/*******************************************************************************
+ * Enumerations
+ ******************************************************************************/
+typedef enum {
+	IK_COXA,
+	IK_FEMUR,
+	IK_TIBIA
+} ikJoints;
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+/* Body frame: x forward, y left, z up, with the origin at the body centre.
+   Joint angles are 0 with the coxa along mountYaw, the femur level and the
+   tibia square to the femur. Positive coxa turns anticlockwise seen from above,
+   positive femur lifts and positive tibia swings the foot outwards. */
+typedef struct {
+	int32_t x;
+	int32_t y;
+	int32_t z;
+} ikVec;
+
+typedef struct {
+	ikVec translation;		// Q16.16 mm
+	int32_t roll;			// Q16.16 degrees about x
+	int32_t pitch;			// Q16.16 degrees about y
+	int32_t yaw;			// Q16.16 degrees about z
+} ikPose;
+
+typedef struct {
+	ikVec mount;				// Q16.16 mm, coxa joint position on the body
+	int32_t mountYaw;			// Q16.16 degrees, the direction the leg points at coxa 0
+	int32_t length[IK_JOINTS];	// Q16.16 mm, coxa, femur and tibia
+	int32_t zero[IK_JOINTS];	// Q16.16 degrees, servo value at joint angle 0
+	int8_t direction[IK_JOINTS];// 1, or -1 where the servo turns against the joint
+
+	/* Derived by ik_set_leg() */
+	int32_t mountSin;			// Q2.30
+	int32_t mountCos;			// Q2.30
+} ikLegConfig;
+
+typedef struct {
+	ikLegConfig leg[IK_LEGS];
+	uint32_t solveCount;
+	uint32_t unreachableCount;	// Feet out of reach, which leave their leg where it was
+} ikModel;
+
+/*******************************************************************************
+ * Kinematics Functions
+ ******************************************************************************/
+void ik_init_default(
+ikModel *model
+);
+
+void ik_set_leg(
+ikModel *model,
+unsigned int leg,
+const ikLegConfig *config
+);
+
+void ik_neutral_foot(
+const ikModel *model,
+unsigned int leg,
+ikVec *foot_out
+);
+
+bool ik_solve_leg(
+ikModel *model,
+unsigned int leg,
+const ikPose *pose,
+const ikVec *foot,
+int32_t *values_out
+);
+
+uint32_t ik_solve(
+ikModel *model,
+const ikPose *pose,
+const ikVec *feet,
+uint32_t legMask,
+int32_t *values_out
+);
+
+/*******************************************************************************
+ * Fixed Point Math Functions
+ ******************************************************************************/
+int32_t ik_sin_q30(
+int32_t angle
+);
+
+int32_t ik_cos_q30(
+int32_t angle
+);
+
+int32_t ik_atan2(
+int64_t y,
+int64_t x
+);
+
+uint64_t ik_isqrt(
+uint64_t value
+);
@@ -3,17 +3,78 @@
 #include <stdio.h>
 #include <cstring>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/util/queue.h"
 #include "servo2040.hpp"
 #include "analogmux.hpp"
+#include "analogmux_scanner.hpp"
 #include "analog.hpp"
 #include "button.hpp"
+#include "chica_parser.h"
+#include "chica_v2.h"
+#include "vcp.h"
+#include "interpolator.h"
+#include "scheduler.h"
+#include "kinematics.h"
+#include "gait.h"
+#include "power_monitor.h"
+#include "target_buffer.h"
+#include "chain.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+
+// Uncomment the below line to print a PWM timing report over the VCP each time the user switch is pressed.
+// This is for bench tuning only, as the text will confuse the Chica server
+//#define PWM_TIMING_REPORT
+
+// Uncomment the below line to print how busy each core is, and what the PWM DMA interrupt costs, each time
+// the user switch is pressed. Also for bench use only
+//#define CORE_UTILIZATION_REPORT
+
+// Uncomment the below line to print the current, energy and overcurrent trip counters each time the user switch is pressed.
+// Also for bench use only
+//#define POWER_REPORT
+
+// Uncomment the below line to print how far ahead of their deadlines scheduled SETs arrive each time the user switch is pressed.
+// Also for bench use only
+//#define SCHEDULE_REPORT
+
+// Uncomment the below line to time the fixed point calibration path from value to PWM level against the float one
+// each time the user switch is pressed. Also for bench use only
+//#define CALIBRATION_BENCH_REPORT
+
+// Comment out the below line to have the PWM DMA interrupt restart the servo PWM every period, rather than
+// a second DMA channel looping it and only interrupting when new pulses are loaded
+#define PWM_CHAINED_DMA
+
+// Uncomment one of the below lines to chain boards together behind one USB port. The master is the board
+// the host talks to, and owns indexes 0 to 31. Each slave takes the next 32 along the chain, and commits
+// with the master on its frame sync line. The chain uses the Qw/ST pins, so there are no auxiliary servos
+//#define CHAIN_MASTER
+//#define CHAIN_SLAVE
+
+#if defined(CHAIN_MASTER) && defined(CHAIN_SLAVE)
+#error "A board is either the chain's master or one of its slaves"
+#endif
+#if defined(CHAIN_MASTER) || defined(CHAIN_SLAVE)
+#define CHAIN_ENABLED
+#endif
 
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
-/* Commands */
-#define SET_CMD	0xD3 // 0x53 & 0x80
-#define GET_CMD	0xC7 // 0x47 & 0x80
+/* Servo channels, numbered from 0 for SERVO1. The legs' servos are on pio0, and the
+   auxiliary ones on the Qw/ST connector's pins are on pio1 alongside the LED bar */
+#define LEG_SERVOS			18	// SERVO1 to SERVO18
+#define LEG_SHARDS			3	// pio0 state machines 0 to 2, six servos (two legs) on each
+#ifdef CHAIN_ENABLED
+#define AUX_SERVOS			0	// Their pins carry the chain
+#else
+#define AUX_SERVOS			3	// SERVO19 to SERVO21, for a neck, tail or gripper
+#endif
+#define SERVO_CHANNELS		(LEG_SERVOS + AUX_SERVOS)
 
 /* A0/A1/A2 Mapping */
 #define A0_GPIO_PIN			26
@@ -27,15 +88,37 @@
 #define GPIO_HIGH_MASK		0xFFFFFFFF
 #define GPIO_LOW_MASK		0x00
 
-/* Miscellaneous */
-#define MAX_COUNT_VALUE		127
+/* Background sensor scanning */
+#define SENSOR_OVERSAMPLE		8		// Samples averaged into each reading
+#define SENSOR_SCAN_PERIOD_US	500		// All 8 mux addresses are read every half millisecond
+
+/* Overcurrent protection */
+#define CURRENT_LIMIT_A			9.0f	// Filtered current that drops the relay, below the 10A terminal rating
+#define CURRENT_FILTER_ALPHA	0.25f	// Per sample low pass coefficient, roughly a 2ms time constant
+
+/* Foot contact switches, on the touch sensor inputs */
+#define FOOT_CONTACT_V			1.65f	// Sensor voltage above which a foot counts as down
+
+/* Core 1 to core 0 packet queues */
+#define MOTION_QUEUE_DEPTH	8	// SET and KEY packets
+#define GET_QUEUE_DEPTH		4
+
+/* Board chaining, over UART1 on the Qw/ST pins. TX goes to the next board's RX, and every
+   board shares the sync line, which the master pulses at the start of each of its frames */
+#define CHAIN_UART			uart1
+#define CHAIN_UART_IRQ		UART1_IRQ
+#define CHAIN_BAUD			1000000
+#define CHAIN_TX_PIN		servo::servo2040::I2C_SDA
+#define CHAIN_RX_PIN		servo::servo2040::I2C_SCL
+#define CHAIN_SYNC_PIN		servo::servo2040::I2C_INT
+#define CHAIN_SYNC_PULSE_US	5		// Long enough for every slave to see the edge
+#define CHAIN_QUEUE_DEPTH	8		// Slave packets held for the next frame sync
+#define CHAIN_TX_RING_SIZE	1024	// Frames waiting for the UART, must be a power of 2
+#define CHAIN_TX_RESERVE	((CHAIN_MAX_NODES - 1) * CHAIN_MAX_FRAME)	// Room for a frame to every slave
 
 /*******************************************************************************
  * Constants
  ******************************************************************************/
-/* Timing */
-constexpr uint GETC_TIMEOUT_US	= 100; // 10bits/115200bps = 86.8us acquire time
-
 /* LED */
 constexpr float BRIGHTNESS		= 0.3f;		// Normalized
 
@@ -52,23 +135,21 @@ typedef enum {
 	SERVO7, SERVO8, SERVO9, SERVO10, SERVO11, SERVO12, 
 	SERVO13, SERVO14, SERVO15, SERVO16, SERVO17, SERVO18,
 	TS1, TS2, TS3, TS4, TS5, TS6, 
-	CURR, VOLT, RELAY, A1, A2, cmdPin_num
+	CURR, VOLT, RELAY, A1, A2,
+	SERVO19, SERVO20, SERVO21, cmdPin_num	// Added after the Chica pins, so their indexes stay put
 } cmdPins;
 
-typedef enum {
-	set,
-	get
-} hexapodCmds;
-
 /*******************************************************************************
  * Structures
  ******************************************************************************/
+/* Each core counts the time spent in passes of its main loop that did work.
+   Written only by its own core, so the other core may read it slightly stale */
 typedef struct {
-	hexapodCmds cmd;
-	uint startIdx;
-	uint count;
-	uint valueBuff[MAX_COUNT_VALUE];
-} cmdPkt;
+	volatile uint64_t busy_us;
+	volatile uint32_t maxBusy_us;	// Longest single busy pass
+	volatile uint32_t loops;
+	volatile uint32_t start_us;		// When the counters were last reset
+} coreUtilization;
 
 /*******************************************************************************
  * Lookup Tables
@@ -91,20 +172,122 @@ constexpr uint RP_hardwarePins_table[] =
 	servo::servo2040::VOLTAGE_SENSE_ADDR,	// VOLT
 	A0_GPIO_PIN,							// RELAY
 	A1_GPIO_PIN,							// A1
-	A2_GPIO_PIN								// A2
+	A2_GPIO_PIN,							// A2
+	servo::servo2040::I2C_INT,				// SERVO19
+	servo::servo2040::I2C_SDA,				// SERVO20
+	servo::servo2040::I2C_SCL				// SERVO21
 };
 
 /*******************************************************************************
  * Function Forward Declarations
  ******************************************************************************/
 
+/*******************************************************************************
+ * Core 1 Functions
+ ******************************************************************************/
+void core1_entry(
+void
+);
+
+bool vcp_task(
+void
+);
+
+void queue_v2_frame(
+void
+);
+
+void queue_packet(
+cmdPkt &pkt
+);
+
+#ifdef CHAIN_SLAVE
+bool chain_rx_task(
+void
+);
+#endif
+
 /*******************************************************************************
  * Core Functions
  ******************************************************************************/
-void parse_and_command_task(
+bool command_task(
+void
+);
+
+bool motion_task(
+void
+);
+
+bool schedule_task(
+void
+);
+
+bool gait_task(
+void
+);
+
+bool interpolate_task(
+void
+);
+
+bool power_task(
+void
+);
+
+#ifdef CHAIN_ENABLED
+bool chain_task(
+void
+);
+#endif
+
+void run_command(
+cmdPkt &curr_cmdPkt
+);
+
+bool stage_cmdPin_value(
+cmdPins cmdPin,
+uint value
+);
+
+bool stage_ik_values(
+void
+);
+
+void publish_targets(
 void
 );
 
+/*******************************************************************************
+ * Servo Support Functions
+ ******************************************************************************/
+int cmdPin_to_servo(
+cmdPins cmdPin
+);
+
+servo::ServoCluster &servo_cluster(
+uint servo
+);
+
+uint servo_clusterIndex(
+uint servo
+);
+
+void commit_servos(
+void
+);
+
+void commit_step(
+bool loadNeeded
+);
+
+uint32_t servo_load_count(
+void
+);
+
+void enable_servos(
+bool enable
+);
+
 /*******************************************************************************
  * VCP/Parsing Support Functions
  ******************************************************************************/
@@ -112,11 +295,126 @@ uint cmdPin_to_hardwarePin(
 cmdPins cmdPin
 );
 
+bool is_batched_cmd(
+hexapodCmds cmd
+);
+
+bool get_cmdPin_value(
+cmdPins cmdPin,
+uint *value_out
+);
+
 void vcp_transmit(
 uint *txbuff,
 uint size
 );
 
+void vcp_transmit_v2(
+const uint8_t *payload,
+uint size
+);
+
+#ifdef PWM_TIMING_REPORT
+void print_timing_report(
+void
+);
+#endif
+
+#ifdef CORE_UTILIZATION_REPORT
+void print_core_utilization(
+void
+);
+#endif
+
+#ifdef POWER_REPORT
+void print_power_report(
+void
+);
+#endif
+
+#ifdef SCHEDULE_REPORT
+void print_schedule_report(
+void
+);
+#endif
+
+#ifdef CALIBRATION_BENCH_REPORT
+void print_calibration_bench(
+void
+);
+#endif
+
+/*******************************************************************************
+ * Chain Support Functions
+ ******************************************************************************/
+#ifdef CHAIN_ENABLED
+bool chain_uart_write(
+void *context,
+const uint8_t *data,
+unsigned int size
+);
+
+bool chain_uart_read(
+void *context,
+uint8_t *byte
+);
+
+void chain_uart_tx_init(
+void
+);
+
+uint32_t chain_uart_tx_free(
+void
+);
+
+bool chain_uart_tx_idle(
+void
+);
+
+void chain_uart_tx_fill(
+void
+);
+
+void chain_uart_irq_handler(
+void
+);
+#endif
+
+#ifdef CHAIN_MASTER
+bool chain_tx_ready(
+void
+);
+#endif
+
+#ifdef CHAIN_SLAVE
+void chain_sync_callback(
+uint gpio,
+uint32_t events
+);
+#endif
+
+/*******************************************************************************
+ * Sensor Support Functions
+ ******************************************************************************/
+void sensor_reading_callback(
+uint8_t address,
+const AnalogMuxScanner::Reading &reading,
+void *context
+);
+
+/*******************************************************************************
+ * Utilization Support Functions
+ ******************************************************************************/
+void core_utilization_reset(
+coreUtilization *util
+);
+
+void core_utilization_update(
+coreUtilization *util,
+uint32_t start_us,
+bool busy
+);
+
 /*******************************************************************************
  * LED Support Functions
  ******************************************************************************/
@@ -137,4 +435,8 @@ void
 
 float read_analogPin(
 uint sensorAddress
+);
+
+uint32_t read_foot_contacts(
+void
 );
\ No newline at end of file
@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "power_monitor.h"
+#include <math.h>
+
+/*******************************************************************************
+ * Power Monitor Functions
+ ******************************************************************************/
+void power_monitor_init(powerMonitor *monitor, float limit_A, float alpha)
+{
+	monitor->limit_A = limit_A;
+	monitor->alpha = alpha;
+
+	monitor->filtered_A = 0.0f;
+	monitor->voltage_V = 0.0f;
+	monitor->lastSample_us = 0;
+	monitor->hasSample = false;
+
+	monitor->framePeak_A = 0.0f;
+	monitor->frameSumSq = 0.0f;
+	monitor->frameEnergy_J = 0.0f;
+	monitor->frameSamples = 0;
+
+	monitor->lastFrame = {0.0f, 0.0f, 0.0f, 0};
+	monitor->cycleEnergy_J = 0.0f;
+	monitor->lastCycleEnergy_J = 0.0f;
+	monitor->totalEnergy_J = 0.0f;
+	monitor->cycleCount = 0;
+
+	monitor->tripped = false;
+	monitor->tripCurrent_A = 0.0f;
+	monitor->tripCount = 0;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Add a current sample. Returns true only for the sample that trips the
+   protection, so the caller acts on it once. */
+bool power_monitor_sample(powerMonitor *monitor, float current_A, uint32_t timestamp_us)
+{
+	if (!monitor->hasSample)
+	{
+		monitor->filtered_A = current_A;
+	}
+	else
+	{
+		monitor->filtered_A += monitor->alpha * (current_A - monitor->filtered_A);
+
+		// Integrate the power over the time since the last sample
+		uint32_t dt_us = timestamp_us - monitor->lastSample_us;
+		if (dt_us <= POWER_MAX_SAMPLE_GAP_US)
+		{
+			float energy_J = monitor->voltage_V * current_A * ((float)dt_us / 1000000.0f);
+			monitor->frameEnergy_J += energy_J;
+		}
+	}
+	monitor->lastSample_us = timestamp_us;
+	monitor->hasSample = true;
+
+	if (monitor->filtered_A > monitor->framePeak_A)
+	{
+		monitor->framePeak_A = monitor->filtered_A;
+	}
+	monitor->frameSumSq += current_A * current_A;
+	monitor->frameSamples++;
+
+	if (!monitor->tripped && monitor->filtered_A > monitor->limit_A)
+	{
+		monitor->tripped = true;
+		monitor->tripCurrent_A = monitor->filtered_A;
+		monitor->tripCount++;
+		return true;
+	}
+	return false;
+}
+/*******************************************************************************
+ ******************************************************************************/
+void power_monitor_voltage(powerMonitor *monitor, float voltage_V)
+{
+	monitor->voltage_V = voltage_V;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Close the frame in progress into lastFrame, and add its energy to the counters */
+void power_monitor_end_frame(powerMonitor *monitor)
+{
+	powerFrame *frame = &monitor->lastFrame;
+	frame->peak_A = monitor->framePeak_A;
+	frame->rms_A = (monitor->frameSamples > 0) ? sqrtf(monitor->frameSumSq / (float)monitor->frameSamples) : 0.0f;
+	frame->energy_J = monitor->frameEnergy_J;
+	frame->samples = monitor->frameSamples;
+
+	monitor->cycleEnergy_J += monitor->frameEnergy_J;
+	monitor->totalEnergy_J += monitor->frameEnergy_J;
+
+	monitor->framePeak_A = 0.0f;
+	monitor->frameSumSq = 0.0f;
+	monitor->frameEnergy_J = 0.0f;
+	monitor->frameSamples = 0;
+}
+/*******************************************************************************
+ ******************************************************************************/
+void power_monitor_end_cycle(powerMonitor *monitor)
+{
+	monitor->lastCycleEnergy_J = monitor->cycleEnergy_J;
+	monitor->cycleEnergy_J = 0.0f;
+	monitor->cycleCount++;
+}
+/*******************************************************************************
+ ******************************************************************************/
+void power_monitor_clear_trip(powerMonitor *monitor)
+{
+	monitor->tripped = false;
+}
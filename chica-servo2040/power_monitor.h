@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define POWER_MAX_SAMPLE_GAP_US		10000	// Longer gaps are not integrated into the energy, e.g. after a pause in scanning
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+typedef struct {
+	float peak_A;			// Highest filtered current in the frame
+	float rms_A;			// RMS of the unfiltered current samples in the frame
+	float energy_J;
+	uint32_t samples;
+} powerFrame;
+
+/* Samples are added from the sensor scanner's interrupt, while frames and cycles
+   are closed from the main loop, so callers must stop the two overlapping */
+typedef struct {
+	/* Configuration */
+	float limit_A;			// Filtered current that trips the protection
+	float alpha;			// Low pass filter coefficient, 0 to 1. Higher follows the current faster
+
+	/* Signals */
+	float filtered_A;
+	float voltage_V;		// Latest supply voltage, for the energy counters
+	uint32_t lastSample_us;
+	bool hasSample;
+
+	/* Accumulators for the frame in progress */
+	float framePeak_A;
+	float frameSumSq;
+	float frameEnergy_J;
+	uint32_t frameSamples;
+
+	/* Counters */
+	powerFrame lastFrame;
+	float cycleEnergy_J;		// Energy in the gait cycle in progress
+	float lastCycleEnergy_J;	// Energy of the last complete gait cycle
+	float totalEnergy_J;
+	uint32_t cycleCount;
+
+	/* Protection */
+	bool tripped;			// Latched until power_monitor_clear_trip()
+	float tripCurrent_A;	// Filtered current when the protection last tripped
+	uint32_t tripCount;
+} powerMonitor;
+
+/*******************************************************************************
+ * Power Monitor Functions
+ ******************************************************************************/
+void power_monitor_init(
+powerMonitor *monitor,
+float limit_A,
+float alpha
+);
+
+bool power_monitor_sample(
+powerMonitor *monitor,
+float current_A,
+uint32_t timestamp_us
+);
+
+void power_monitor_voltage(
+powerMonitor *monitor,
+float voltage_V
+);
+
+void power_monitor_end_frame(
+powerMonitor *monitor
+);
+
+void power_monitor_end_cycle(
+powerMonitor *monitor
+);
+
+void power_monitor_clear_trip(
+powerMonitor *monitor
+);
@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "scheduler.h"
+
+/*******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+static bool entry_before(const schedEntry *a, const schedEntry *b)
+{
+	int32_t diff = (int32_t)(a->due_us - b->due_us);
+	if (diff != 0)
+	{
+		return diff < 0;
+	}
+	return (int32_t)(a->order - b->order) < 0;
+}
+/*******************************************************************************
+ ******************************************************************************/
+static void swap_entries(schedEntry *a, schedEntry *b)
+{
+	schedEntry temp = *a;
+	*a = *b;
+	*b = temp;
+}
+
+/*******************************************************************************
+ * Scheduler Functions
+ ******************************************************************************/
+void sched_reset(scheduler *sched)
+{
+	sched->size = 0;
+	sched->nextOrder = 0;
+	sched_reset_stats(sched);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Drop every waiting entry, keeping the stats */
+void sched_clear(scheduler *sched)
+{
+	sched->size = 0;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Add a SET to be applied at due_us. Returns false, and counts the entry as
+   rejected, if it cannot be held or its deadline is implausibly far from when
+   it arrived. */
+bool sched_push(scheduler *sched, uint32_t due_us, uint32_t arrival_us, unsigned int startIdx,
+				unsigned int count, const unsigned int *valueBuff)
+{
+	int32_t lead_us = (int32_t)(due_us - arrival_us);
+
+	if (sched->size >= SCHED_MAX_ENTRIES || count > SCHED_MAX_VALUES ||
+		lead_us > SCHED_MAX_LEAD_US || lead_us < -SCHED_MAX_LEAD_US)
+	{
+		sched->stats.rejected++;
+		return false;
+	}
+
+	schedStats *stats = &sched->stats;
+	stats->accepted++;
+	stats->lastLead_us = lead_us;
+	stats->totalLead_us += lead_us;
+	if (stats->accepted == 1 || lead_us < stats->minLead_us)
+	{
+		stats->minLead_us = lead_us;
+	}
+	if (stats->accepted == 1 || lead_us > stats->maxLead_us)
+	{
+		stats->maxLead_us = lead_us;
+	}
+	if (lead_us < 0)
+	{
+		stats->late++;
+	}
+
+	unsigned int idx = sched->size++;
+	schedEntry *entry = &sched->heap[idx];
+	entry->due_us = due_us;
+	entry->order = sched->nextOrder++;
+	entry->startIdx = startIdx;
+	entry->count = count;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		entry->valueBuff[i] = valueBuff[i];
+	}
+
+	// Sift up
+	while (idx > 0)
+	{
+		unsigned int parent = (idx - 1) / 2;
+		if (!entry_before(&sched->heap[idx], &sched->heap[parent]))
+		{
+			break;
+		}
+		swap_entries(&sched->heap[idx], &sched->heap[parent]);
+		idx = parent;
+	}
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Whether the earliest entry is due before before_us */
+bool sched_is_due(const scheduler *sched, uint32_t before_us)
+{
+	return (sched->size > 0) && ((int32_t)(sched->heap[0].due_us - before_us) < 0);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Remove the earliest entry into entry_out if it is due before before_us.
+   Returns false if nothing is due yet. */
+bool sched_pop_due(scheduler *sched, uint32_t before_us, schedEntry *entry_out)
+{
+	if (!sched_is_due(sched, before_us))
+	{
+		return false;
+	}
+
+	*entry_out = sched->heap[0];
+	sched->size--;
+	sched->stats.applied++;
+	if (sched->size == 0)
+	{
+		return true;
+	}
+
+	// Sift the last entry down from the top
+	sched->heap[0] = sched->heap[sched->size];
+	unsigned int idx = 0;
+	while (true)
+	{
+		unsigned int left = (2 * idx) + 1;
+		unsigned int right = left + 1;
+		unsigned int first = idx;
+
+		if (left < sched->size && entry_before(&sched->heap[left], &sched->heap[first]))
+		{
+			first = left;
+		}
+		if (right < sched->size && entry_before(&sched->heap[right], &sched->heap[first]))
+		{
+			first = right;
+		}
+		if (first == idx)
+		{
+			break;
+		}
+		swap_entries(&sched->heap[idx], &sched->heap[first]);
+		idx = first;
+	}
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+void sched_reset_stats(scheduler *sched)
+{
+	schedStats *stats = &sched->stats;
+	stats->accepted = 0;
+	stats->late = 0;
+	stats->rejected = 0;
+	stats->applied = 0;
+	stats->lastLead_us = 0;
+	stats->minLead_us = 0;
+	stats->maxLead_us = 0;
+	stats->totalLead_us = 0;
+}
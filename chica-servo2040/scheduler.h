@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define SCHED_MAX_ENTRIES		16			// Scheduled SETs waiting for their frame
+#define SCHED_MAX_VALUES		32			// Enough to cover every command pin in one entry
+#define SCHED_MAX_LEAD_US		2000000		// Entries further than this from their arrival are rejected
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+typedef struct {
+	uint32_t due_us;		// Device time, as the low 32 bits of the microsecond timer
+	uint32_t order;			// Arrival order, so entries due together are applied as sent
+	uint8_t startIdx;
+	uint8_t count;
+	uint16_t valueBuff[SCHED_MAX_VALUES];
+} schedEntry;
+
+/* Lead is how long before its deadline each entry arrived, so negative leads
+   are entries that arrived too late to make their frame */
+typedef struct {
+	uint32_t accepted;
+	uint32_t late;			// Arrived after their deadline, applied at the next frame
+	uint32_t rejected;		// Queue full, too many values or too far from now
+	uint32_t applied;
+	int32_t lastLead_us;
+	int32_t minLead_us;
+	int32_t maxLead_us;
+	int64_t totalLead_us;	// Divide by accepted for the average
+} schedStats;
+
+/* Min-heap of entries ordered by deadline. Deadlines are compared as signed
+   differences, so the timer wrapping every 71 minutes is harmless */
+typedef struct {
+	schedEntry heap[SCHED_MAX_ENTRIES];
+	unsigned int size;
+	uint32_t nextOrder;
+	schedStats stats;
+} scheduler;
+
+/*******************************************************************************
+ * Scheduler Functions
+ ******************************************************************************/
+void sched_reset(
+scheduler *sched
+);
+
+void sched_clear(
+scheduler *sched
+);
+
+bool sched_push(
+scheduler *sched,
+uint32_t due_us,
+uint32_t arrival_us,
+unsigned int startIdx,
+unsigned int count,
+const unsigned int *valueBuff
+);
+
+bool sched_is_due(
+const scheduler *sched,
+uint32_t before_us
+);
+
+bool sched_pop_due(
+scheduler *sched,
+uint32_t before_us,
+schedEntry *entry_out
+);
+
+void sched_reset_stats(
+scheduler *sched
+);
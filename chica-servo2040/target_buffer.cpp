@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "target_buffer.h"
+
+/*******************************************************************************
+ * Local Functions
+ ******************************************************************************/
+/* Orders the buffer writes against the sequence, and the sequence against the
+   reads. A dmb on the RP2040, which also covers the other core */
+static inline void targets_barrier(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* The back buffer, opened with the front's targets the first time it is written */
+static targetSnapshot *targets_back(targetBuffer *targets)
+{
+	uint32_t sequence = targets->sequence;
+	targetSnapshot *back = &targets->buffer[(sequence + 1) & 1];
+
+	if (!targets->writing)
+	{
+		const targetSnapshot *front = &targets->buffer[sequence & 1];
+		for (unsigned int channel = 0; channel < TARGET_CHANNELS; channel++)
+		{
+			back->pulse[channel] = front->pulse[channel];
+		}
+		back->changed = 0;
+		targets->writing = true;
+	}
+	return back;
+}
+
+/*******************************************************************************
+ * Target Buffer Functions
+ ******************************************************************************/
+void targets_init(targetBuffer *targets)
+{
+	for (unsigned int idx = 0; idx < 2; idx++)
+	{
+		for (unsigned int channel = 0; channel < TARGET_CHANNELS; channel++)
+		{
+			targets->buffer[idx].pulse[channel] = 0;
+		}
+		targets->buffer[idx].changed = 0;
+	}
+	targets->sequence = 0;
+	targets->writing = false;
+	targets->stats = {};
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Writer only. The target is staged in the back buffer until the next publish */
+void targets_set(targetBuffer *targets, unsigned int channel, int32_t pulse)
+{
+	if (channel < TARGET_CHANNELS)
+	{
+		targetSnapshot *back = targets_back(targets);
+		back->pulse[channel] = pulse;
+		back->changed |= 1u << channel;
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Writer only. The latest target, including any staged but not yet published */
+int32_t targets_get(targetBuffer *targets, unsigned int channel)
+{
+	if (channel >= TARGET_CHANNELS)
+	{
+		return 0;
+	}
+
+	uint32_t sequence = targets->sequence;
+	const targetSnapshot *latest = &targets->buffer[(targets->writing ? sequence + 1 : sequence) & 1];
+	return latest->pulse[channel];
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Writer only. Makes the back buffer the front in one store. Returns false if
+   nothing was staged */
+bool targets_publish(targetBuffer *targets)
+{
+	if (!targets->writing)
+	{
+		return false;
+	}
+
+	targets_barrier();
+	targets->sequence = targets->sequence + 1;
+	targets->writing = false;
+	targets->stats.published++;
+	return true;
+}
+/*******************************************************************************
+ ******************************************************************************/
+void targets_reader_init(targetReader *reader)
+{
+	reader->lastSequence = 0;
+	reader->snapshot = {};
+	reader->stats = {};
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Copies the front snapshot into the reader if one was published since its
+   last read. If any were missed in between, the channels that differ from the
+   reader's previous snapshot are marked changed instead. The reader keeps its
+   own counters, so the buffer is never stored to from the reader's side */
+bool targets_read(const targetBuffer *targets, targetReader *reader)
+{
+	uint32_t sequence = targets->sequence;
+	if (sequence == reader->lastSequence)
+	{
+		return false;
+	}
+
+	// The writer only touches this buffer again after publishing over it, so an
+	// unchanged sequence afterwards means the copy is whole
+	targetSnapshot copy;
+	for (;;)
+	{
+		targets_barrier();
+		copy = targets->buffer[sequence & 1];
+		targets_barrier();
+
+		uint32_t check = targets->sequence;
+		if (check == sequence)
+		{
+			break;
+		}
+		reader->stats.retries++;
+		sequence = check;
+	}
+
+	if ((sequence - reader->lastSequence) > 1)
+	{
+		copy.changed = 0;
+		for (unsigned int channel = 0; channel < TARGET_CHANNELS; channel++)
+		{
+			if (copy.pulse[channel] != reader->snapshot.pulse[channel])
+			{
+				copy.changed |= 1u << channel;
+			}
+		}
+		reader->stats.skipped += (sequence - reader->lastSequence) - 1;
+	}
+
+	reader->snapshot = copy;
+	reader->lastSequence = sequence;
+	reader->stats.consumed++;
+	return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define TARGET_CHANNELS			21			// SERVO1 to SERVO21
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+typedef struct {
+	int32_t pulse[TARGET_CHANNELS];	// Q16.16 us, 0 for a servo that is off
+	uint32_t changed;				// Channels written since the snapshot before
+} targetSnapshot;
+
+typedef struct {
+	uint32_t published;
+} targetStats;
+
+typedef struct {
+	uint32_t consumed;
+	uint32_t skipped;		// Snapshots published over before the reader got to them
+	uint32_t retries;		// Reads that overlapped a publish and had to be taken again
+} targetReadStats;
+
+/* One writer fills the back buffer, starting from a copy of the front, then
+   publishes it by bumping the sequence. buffer[sequence & 1] is always the
+   front. A reader copies the front out and checks the sequence did not move
+   while it did, so it only ever sees whole snapshots, from any core or IRQ.
+   Only the writer stores to this structure */
+typedef struct {
+	targetSnapshot buffer[2];
+	volatile uint32_t sequence;
+	bool writing;
+	targetStats stats;
+} targetBuffer;
+
+/* Everything a reader keeps, the last snapshot it took and its counters
+   included, so reading never stores to the shared targetBuffer */
+typedef struct {
+	uint32_t lastSequence;
+	targetSnapshot snapshot;
+	targetReadStats stats;
+} targetReader;
+
+/*******************************************************************************
+ * Target Buffer Functions
+ ******************************************************************************/
+void targets_init(
+targetBuffer *targets
+);
+
+void targets_set(
+targetBuffer *targets,
+unsigned int channel,
+int32_t pulse
+);
+
+int32_t targets_get(
+targetBuffer *targets,
+unsigned int channel
+);
+
+bool targets_publish(
+targetBuffer *targets
+);
+
+void targets_reader_init(
+targetReader *reader
+);
+
+bool targets_read(
+const targetBuffer *targets,
+targetReader *reader
+);
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2023 Eddie Carrera
+ * MIT License
+ */
+
+#include "vcp.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdio/driver.h"
+
+/////////////* Global Variables */////////////
+static vcpRxRing rxRing;
+static vcpTxBuff txBuff;
+static vcpTxStats txStats = {0, 0, UINT32_MAX, 0, 0, 0, 0};
+static queue_t txQueue;
+
+/*******************************************************************************
+ * VCP Functions
+ ******************************************************************************/
+void vcp_init(void)
+{
+	queue_init(&txQueue, sizeof(vcpTxBuff), VCP_TX_QUEUE_DEPTH);
+}
+
+/*******************************************************************************
+ * VCP Receive Functions
+ ******************************************************************************/
+/* Move everything currently held in the CDC FIFO into the receive ring, in as
+   few bulk reads as possible. Never waits for data. Returns the bytes moved. */
+uint vcp_rx_drain(void)
+{
+	uint total = 0;
+
+	while (true)
+	{
+		uint used = rxRing.head - rxRing.tail;
+		uint space = VCP_RX_RING_SIZE - used;
+		if (space == 0)
+		{
+			rxRing.overflowCount++; // Leave the rest in the CDC FIFO for next time
+			break;
+		}
+
+		// Only read up to the end of the ring in one go, the next pass handles the wrap
+		uint headIdx = rxRing.head & VCP_RX_RING_MASK;
+		uint contiguous = MIN(space, VCP_RX_RING_SIZE - headIdx);
+
+		// Go through the stdio driver so reads are serialised with the background tud_task()
+		int read = stdio_usb.in_chars((char *)&rxRing.data[headIdx], contiguous);
+		if (read <= 0)
+		{
+			break; // PICO_ERROR_NO_DATA
+		}
+
+		rxRing.head += read;
+		total += read;
+
+		if ((uint)read < contiguous)
+		{
+			break; // FIFO is now empty
+		}
+	}
+
+	return total;
+}
+/*******************************************************************************
+ ******************************************************************************/
+uint vcp_rx_available(void)
+{
+	return rxRing.head - rxRing.tail;
+}
+/*******************************************************************************
+ ******************************************************************************/
+bool vcp_rx_get(uint8_t *byte)
+{
+	if (rxRing.head == rxRing.tail)
+	{
+		return false;
+	}
+
+	*byte = rxRing.data[rxRing.tail & VCP_RX_RING_MASK];
+	rxRing.tail++;
+	return true;
+}
+
+/*******************************************************************************
+ * VCP Transmit Functions
+ ******************************************************************************/
+/* Start assembling a new reply, discarding anything not yet flushed */
+void vcp_tx_begin(void)
+{
+	txBuff.size = 0;
+	txBuff.start_us = time_us_32();
+}
+/*******************************************************************************
+ ******************************************************************************/
+void vcp_tx_put(uint8_t byte)
+{
+	if (txBuff.size < VCP_TX_BUFF_SIZE)
+	{
+		txBuff.data[txBuff.size++] = byte;
+	}
+	else
+	{
+		txStats.droppedBytes++;
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Hand the finished reply to the USB core. Never waits, so a host that has
+   stopped reading cannot stall the servo core. */
+void vcp_tx_flush(void)
+{
+	if (txBuff.size > 0)
+	{
+		if (!queue_try_add(&txQueue, &txBuff))
+		{
+			txStats.droppedReplies++;
+		}
+		txBuff.size = 0;
+	}
+}
+/*******************************************************************************
+ ******************************************************************************/
+/* Send each queued reply in one CDC write. The stdio driver performs the
+   tud_cdc_write() + tud_cdc_write_flush() under its own lock. Returns the
+   number of replies sent. */
+uint vcp_tx_service(void)
+{
+	static vcpTxBuff reply;
+	uint sent = 0;
+
+	while (queue_try_remove(&txQueue, &reply))
+	{
+		stdio_usb.out_chars((const char *)reply.data, reply.size);
+		sent++;
+
+		uint32_t elapsed_us = time_us_32() - reply.start_us;
+		txStats.replyCount++;
+		txStats.last_us = elapsed_us;
+		txStats.min_us = MIN(txStats.min_us, elapsed_us);
+		txStats.max_us = MAX(txStats.max_us, elapsed_us);
+		txStats.total_us += elapsed_us;
+	}
+
+	return sent;
+}
+/*******************************************************************************
+ ******************************************************************************/
+const vcpTxStats *vcp_tx_get_stats(void)
+{
+	return &txStats;
+}
+/*******************************************************************************
+ ******************************************************************************/
+void vcp_tx_reset_stats(void)
+{
+	txStats.replyCount = 0;
+	txStats.last_us = 0;
+	txStats.min_us = UINT32_MAX;
+	txStats.max_us = 0;
+	txStats.total_us = 0;
+	txStats.droppedBytes = 0;
+	txStats.droppedReplies = 0;
+}
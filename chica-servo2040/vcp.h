@@ -0,0 +1,89 @@
+#pragma once
+
+#include "pico/stdlib.h"
+#include "pico/util/queue.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define VCP_RX_RING_SIZE	512 // Must be a power of 2
+#define VCP_RX_RING_MASK	(VCP_RX_RING_SIZE - 1)
+#define VCP_TX_BUFF_SIZE	512 // Largest GET reply is 9 + (2 * MAX_COUNT_VALUE) bytes, in a v2 frame
+#define VCP_TX_QUEUE_DEPTH	4	// Replies waiting to be written by the USB core
+
+/*******************************************************************************
+ * Structures
+ ******************************************************************************/
+typedef struct {
+	uint8_t data[VCP_RX_RING_SIZE];
+	uint head;				// Next index to write, free running
+	uint tail;				// Next index to read, free running
+	uint32_t overflowCount;	// Times the ring was full when the CDC still had data
+} vcpRxRing;
+
+typedef struct {
+	uint8_t data[VCP_TX_BUFF_SIZE];
+	uint size;
+	uint32_t start_us;		// When the reply started being assembled
+} vcpTxBuff;
+
+typedef struct {
+	uint32_t replyCount;
+	uint32_t last_us;		// Assembly + queueing + write time of the most recent reply
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t total_us;		// Divide by replyCount for the average
+	uint32_t droppedBytes;	// Bytes that did not fit in the assembly buffer
+	uint32_t droppedReplies;// Replies that found the queue full, as the host was not reading
+} vcpTxStats;
+
+/*******************************************************************************
+ * VCP Functions
+ ******************************************************************************/
+void vcp_init(
+void
+);
+
+/*******************************************************************************
+ * VCP Receive Functions (USB core only)
+ ******************************************************************************/
+uint vcp_rx_drain(
+void
+);
+
+uint vcp_rx_available(
+void
+);
+
+bool vcp_rx_get(
+uint8_t *byte
+);
+
+/*******************************************************************************
+ * VCP Transmit Functions
+ ******************************************************************************/
+/* Replies are assembled and flushed on the servo core, then written to the CDC
+   by vcp_tx_service() on the USB core */
+void vcp_tx_begin(
+void
+);
+
+void vcp_tx_put(
+uint8_t byte
+);
+
+void vcp_tx_flush(
+void
+);
+
+uint vcp_tx_service(
+void
+);
+
+const vcpTxStats *vcp_tx_get_stats(
+void
+);
+
+void vcp_tx_reset_stats(
+void
+);
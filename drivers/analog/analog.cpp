@@ -8,8 +8,7 @@ namespace pimoroni {
 
     float Analog::read_voltage() {
       adc_select_input(pin - 26);
-      float voltage = ((((float)adc_read() * 3.3f) / (1 << 12)) + offset) / amplifier_gain;
-      return MAX(voltage, 0.0f);
+      return raw_to_voltage((float)adc_read());
     }
 
     float Analog::read_current() {
@@ -18,4 +17,17 @@ namespace pimoroni {
       else
         return read_voltage();
     }
+
+    // Converts a raw reading taken elsewhere (such as an averaged one) using this input's gain and offset
+    float Analog::raw_to_voltage(float raw) const {
+      float voltage = (((raw * 3.3f) / (1 << 12)) + offset) / amplifier_gain;
+      return MAX(voltage, 0.0f);
+    }
+
+    float Analog::raw_to_current(float raw) const {
+      if(resistor > 0.0f)
+        return raw_to_voltage(raw) / resistor;
+      else
+        return raw_to_voltage(raw);
+    }
 };
\ No newline at end of file
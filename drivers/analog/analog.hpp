@@ -22,6 +22,8 @@ namespace pimoroni {
     uint16_t read_raw();
     float read_voltage();
     float read_current();
+    float raw_to_voltage(float raw) const;
+    float raw_to_current(float raw) const;
   private:
     uint pin;
     float amplifier_gain;
@@ -34,6 +34,14 @@ namespace pimoroni {
   }
 
   void AnalogMux::select(uint8_t address) {
+    if(address <= max_address) {
+      set_address(address);
+      sleep_us(10); // Add a delay to let the pins settle before taking a reading
+    }
+  }
+
+  // Switches the mux without waiting for it to settle, for callers that time the settling themselves
+  void AnalogMux::set_address(uint8_t address) {
     if(address <= max_address) {
       bool to_pull_up = (pull_ups & (1u << address));
       bool to_pull_down = (pull_downs & (1u << address));
@@ -58,10 +66,13 @@ namespace pimoroni {
       if((muxed_pin != PIN_UNUSED) && (to_pull_up || to_pull_down)) {
         gpio_set_pulls(muxed_pin, to_pull_up, to_pull_down);
       }
-      sleep_us(10); // Add a delay to let the pins settle before taking a reading
     }
   }
 
+  uint AnalogMux::get_max_address() const {
+    return max_address;
+  }
+
   void AnalogMux::disable() {
     if(en_pin != PIN_UNUSED) {
       gpio_put(en_pin, false);
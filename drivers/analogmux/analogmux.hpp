@@ -12,6 +12,8 @@ namespace pimoroni {
               uint en_pin = PIN_UNUSED, uint muxed_pin = PIN_UNUSED);
 
     void select(uint8_t address);
+    void set_address(uint8_t address);
+    uint get_max_address() const;
     void disable();
     void configure_pulls(uint8_t address, bool pullup, bool pulldown);
     bool read();
@@ -0,0 +1,15 @@
+set(DRIVER_NAME analogmux_scanner)
+add_library(${DRIVER_NAME} INTERFACE)
+
+target_sources(${DRIVER_NAME} INTERFACE
+  ${CMAKE_CURRENT_LIST_DIR}/analogmux_scanner.cpp
+)
+
+target_include_directories(${DRIVER_NAME} INTERFACE ${CMAKE_CURRENT_LIST_DIR})
+
+target_link_libraries(${DRIVER_NAME} INTERFACE
+    pico_stdlib
+    hardware_adc
+    hardware_dma
+    analogmux
+    )
@@ -0,0 +1,232 @@
+#include "analogmux_scanner.hpp"
+#include "hardware/sync.h"
+
+namespace pimoroni {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// STATICS
+////////////////////////////////////////////////////////////////////////////////////////////////////
+AnalogMuxScanner* AnalogMuxScanner::scanner = nullptr;
+
+
+AnalogMuxScanner::AnalogMuxScanner(AnalogMux &mux, uint adc_pin, uint8_t address_count,
+                                   uint8_t oversample, uint32_t settle_us, uint32_t scan_period_us)
+: mux(mux)
+, adc_pin(adc_pin)
+, address_count(MIN(MIN(address_count, MAX_ADDRESSES), (uint8_t)(mux.get_max_address() + 1)))
+, oversample(MIN(MAX(oversample, (uint8_t)1), MAX_OVERSAMPLE))
+, settle_us(settle_us)
+, scan_period_us(scan_period_us)
+, dma_channel(-1)
+, alarm(0)
+, initialised(false)
+, running(false)
+, current_address(0)
+, scan_count(0)
+, scan_start_us(0)
+, reading_callback(nullptr)
+, reading_callback_context(nullptr) {
+
+  for(uint8_t address = 0; address < MAX_ADDRESSES; address++) {
+    sequence[address] = 0;
+  }
+}
+
+AnalogMuxScanner::~AnalogMuxScanner() {
+  if(initialised) {
+    stop();
+
+    dma_channel_set_irq1_enabled(dma_channel, false);
+    irq_remove_handler(DMA_IRQ_1, dma_interrupt_handler);
+    dma_channel_unclaim(dma_channel);
+    adc_fifo_setup(false, false, 0, false, false);
+
+    scanner = nullptr;
+  }
+}
+
+bool AnalogMuxScanner::init() {
+  if(!initialised && scanner == nullptr) {
+    dma_channel = dma_claim_unused_channel(false);
+    if(dma_channel >= 0) {
+      adc_init();
+
+      //Make sure GPIO is high-impedance, no pullups etc
+      adc_gpio_init(adc_pin);
+      adc_select_input(adc_pin - 26);
+
+      // Have each conversion request a DMA transfer, and run the ADC as fast as it can (2us per sample)
+      adc_fifo_setup(true, true, 1, false, false);
+      adc_set_clkdiv(0);
+
+      dma_channel_config config = dma_channel_get_default_config(dma_channel);
+      channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+      channel_config_set_read_increment(&config, false);
+      channel_config_set_write_increment(&config, true);
+      channel_config_set_dreq(&config, DREQ_ADC);
+
+      dma_channel_configure(
+        dma_channel,
+        &config,
+        samples,
+        &adc_hw->fifo,
+        oversample,
+        false);
+
+      // DMA IRQ 0 is left for PWMCluster
+      dma_channel_set_irq1_enabled(dma_channel, true);
+      irq_add_shared_handler(DMA_IRQ_1, dma_interrupt_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+      irq_set_enabled(DMA_IRQ_1, true);
+
+      scanner = this;
+      initialised = true;
+    }
+  }
+  return initialised;
+}
+
+void AnalogMuxScanner::start() {
+  if(initialised && !running) {
+    running = true;
+    current_address = 0;
+    scan_start_us = time_us_32();
+
+    // Let the first address settle before sampling it
+    mux.set_address(current_address);
+    alarm = add_alarm_in_us(settle_us, alarm_callback, this, true);
+    if(alarm < 0) {
+      running = false;
+    }
+  }
+}
+
+void AnalogMuxScanner::stop() {
+  if(running) {
+    // Stop the chain of alarms and transfers without racing the interrupts that continue it
+    uint32_t save = save_and_disable_interrupts();
+    running = false;
+    if(alarm > 0) {
+      cancel_alarm(alarm);
+    }
+    dma_channel_abort(dma_channel);
+    adc_run(false);
+    restore_interrupts(save);
+
+    adc_fifo_drain();
+  }
+}
+
+bool AnalogMuxScanner::is_running() const {
+  return running;
+}
+
+// Returns the latest reading of the address. This can be called from either core, as a reading
+// that gets updated part way through being copied is detected by its sequence number and copied again
+AnalogMuxScanner::Reading AnalogMuxScanner::read(uint8_t address) const {
+  Reading reading;
+  if(address < address_count) {
+    uint32_t seq;
+    do {
+      seq = sequence[address];
+      __dmb();
+      reading = readings[address];
+      __dmb();
+    } while((seq & 1) || (seq != sequence[address]));
+  }
+  return reading;
+}
+
+float AnalogMuxScanner::read_average(uint8_t address) const {
+  return read(address).average();
+}
+
+uint32_t AnalogMuxScanner::get_scan_count() const {
+  return scan_count;
+}
+
+// The callback runs in the DMA interrupt, so should be kept short. It is the place to react to a
+// reading sooner than polling would allow, such as cutting power on an overcurrent
+void AnalogMuxScanner::set_reading_callback(ReadingCallback callback, void *context) {
+  // Change both together, so the interrupt never sees the new callback with the old context
+  uint32_t save = save_and_disable_interrupts();
+  reading_callback = callback;
+  reading_callback_context = context;
+  restore_interrupts(save);
+}
+
+void AnalogMuxScanner::dma_interrupt_handler() {
+  if(scanner != nullptr && dma_channel_get_irq1_status(scanner->dma_channel)) {
+    scanner->conversion_complete();
+  }
+}
+
+int64_t AnalogMuxScanner::alarm_callback(alarm_id_t id, void *user_data) {
+  static_cast<AnalogMuxScanner*>(user_data)->start_conversion();
+  return 0; // Do not repeat, the next alarm is set once the conversions complete
+}
+
+void AnalogMuxScanner::start_conversion() {
+  alarm = 0;
+  if(running) {
+    // Capture the set number of samples, with the DMA interrupt marking the end
+    adc_select_input(adc_pin - 26);
+    adc_fifo_drain();
+    dma_channel_set_write_addr(dma_channel, samples, false);
+    dma_channel_set_trans_count(dma_channel, oversample, true);
+    adc_run(true);
+  }
+}
+
+void AnalogMuxScanner::conversion_complete() {
+  dma_channel_acknowledge_irq1(dma_channel);
+
+  // Stop the ADC and discard the conversion it was part way through
+  adc_run(false);
+  adc_fifo_drain();
+
+  if(!running)
+    return;
+
+  uint32_t sum = 0;
+  for(uint8_t i = 0; i < oversample; i++) {
+    sum += samples[i];
+  }
+
+  // Publish the new reading
+  uint32_t now_us = time_us_32();
+  sequence[current_address]++;
+  __dmb();
+  Reading &reading = readings[current_address];
+  reading.sum = sum;
+  reading.samples = oversample;
+  reading.timestamp_us = now_us;
+  reading.scan = scan_count;
+  __dmb();
+  sequence[current_address]++;
+
+  if(reading_callback != nullptr) {
+    reading_callback(current_address, reading, reading_callback_context);
+  }
+
+  // Move on to the next address, waiting out the rest of the scan period after the last one
+  uint32_t delay_us = settle_us;
+  current_address++;
+  if(current_address >= address_count) {
+    current_address = 0;
+    scan_count++;
+
+    int32_t remaining_us = (int32_t)(scan_start_us + scan_period_us - now_us);
+    if(remaining_us > (int32_t)settle_us) {
+      delay_us = remaining_us;
+    }
+    scan_start_us = now_us + delay_us;
+  }
+
+  mux.set_address(current_address);
+  alarm = add_alarm_in_us(delay_us, alarm_callback, this, true);
+  if(alarm < 0) {
+    running = false;
+  }
+}
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "common/pimoroni_common.hpp"
+#include "analogmux.hpp"
+
+namespace pimoroni {
+
+  // Cycles through the addresses of an AnalogMux in the background, sampling the muxed ADC input with
+  // DMA, and keeps the latest reading of each address. Only one scanner can use the ADC at a time, and
+  // while it is running the ADC should not be read by anything else (such as Analog::read_voltage())
+  class AnalogMuxScanner {
+    //--------------------------------------------------
+    // Constants
+    //--------------------------------------------------
+  public:
+    static const uint8_t MAX_ADDRESSES = 8;
+    static const uint8_t MAX_OVERSAMPLE = 16;
+    static const uint8_t DEFAULT_OVERSAMPLE = 4;
+    static const uint32_t DEFAULT_SETTLE_US = 10;         // Matches the delay AnalogMux::select() uses
+    static const uint32_t DEFAULT_SCAN_PERIOD_US = 1000;  // How often every address is read. If shorter than
+                                                          // a full scan takes, scans run back to back
+
+
+    //--------------------------------------------------
+    // Substructures
+    //--------------------------------------------------
+  public:
+    struct Reading {
+      //--------------------------------------------------
+      // Variables
+      //--------------------------------------------------
+      uint32_t sum;           // The total of all the raw samples taken
+      uint8_t samples;
+      uint32_t timestamp_us;  // When the samples finished
+      uint32_t scan;          // The scan the samples were taken in
+
+
+      //--------------------------------------------------
+      // Constructors/Destructor
+      //--------------------------------------------------
+      Reading() : sum(0), samples(0), timestamp_us(0), scan(0) {};
+
+
+      //--------------------------------------------------
+      // Methods
+      //--------------------------------------------------
+      float average() const { return (samples > 0) ? (float)sum / (float)samples : 0.0f; };
+    };
+
+    // Called from the DMA interrupt each time a new reading is published
+    typedef void (*ReadingCallback)(uint8_t address, const Reading &reading, void *context);
+
+
+    //--------------------------------------------------
+    // Variables
+    //--------------------------------------------------
+  private:
+    AnalogMux &mux;
+    uint adc_pin;
+    uint8_t address_count;
+    uint8_t oversample;
+    uint32_t settle_us;
+    uint32_t scan_period_us;
+
+    int dma_channel;
+    alarm_id_t alarm;
+    bool initialised;
+    volatile bool running;
+
+    uint8_t current_address;
+    volatile uint32_t scan_count;
+    uint32_t scan_start_us;
+    uint16_t samples[MAX_OVERSAMPLE];
+
+    // Each reading is guarded by a sequence number, which is odd while the reading is being written
+    volatile uint32_t sequence[MAX_ADDRESSES];
+    Reading readings[MAX_ADDRESSES];
+
+    ReadingCallback reading_callback;
+    void *reading_callback_context;
+
+
+    //--------------------------------------------------
+    // Statics
+    //--------------------------------------------------
+    static AnalogMuxScanner* scanner;
+    static void dma_interrupt_handler();
+    static int64_t alarm_callback(alarm_id_t id, void *user_data);
+
+
+    //--------------------------------------------------
+    // Constructors/Destructor
+    //--------------------------------------------------
+  public:
+    AnalogMuxScanner(AnalogMux &mux, uint adc_pin, uint8_t address_count = MAX_ADDRESSES,
+                     uint8_t oversample = DEFAULT_OVERSAMPLE, uint32_t settle_us = DEFAULT_SETTLE_US,
+                     uint32_t scan_period_us = DEFAULT_SCAN_PERIOD_US);
+    ~AnalogMuxScanner();
+
+
+    //--------------------------------------------------
+    // Methods
+    //--------------------------------------------------
+  public:
+    bool init();
+    void start();
+    void stop();
+    bool is_running() const;
+
+    Reading read(uint8_t address) const;
+    float read_average(uint8_t address) const;
+    uint32_t get_scan_count() const;
+    void set_reading_callback(ReadingCallback callback, void *context = nullptr);
+
+    //--------------------------------------------------
+  private:
+    void start_conversion();
+    void conversion_complete();
+  };
+
+}
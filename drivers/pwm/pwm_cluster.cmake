@@ -11,6 +11,7 @@ target_link_libraries(${DRIVER_NAME} INTERFACE
     pico_stdlib
     hardware_pio
     hardware_dma
+    pwm_cluster_model
     )
 
 pico_generate_pio_header(${DRIVER_NAME} ${CMAKE_CURRENT_LIST_DIR}/pwm_cluster.pio)
\ No newline at end of file
@@ -1,13 +1,20 @@
 #include "pwm_cluster.hpp"
 #include "hardware/gpio.h"
 #include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
 #include "pwm_cluster.pio.h"
+#include "pwm_cluster_model.hpp"
 
 // Uncomment the below line to enable debugging
 //#define DEBUG_MULTI_PWM
 
 namespace pimoroni {
 
+#if defined(DEBUG_MULTI_PWM) && defined(PWM_CLUSTER_COMPACT)
+  #error "The debug program only streams the two word transitions"
+#endif
+
 #ifdef DEBUG_MULTI_PWM
   static const uint IRQ_GPIO = 15;
   static const uint WRITE_GPIO = 16;
@@ -18,8 +25,37 @@ namespace pimoroni {
 // STATICS
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 PWMCluster* PWMCluster::clusters[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+uint32_t PWMCluster::cluster_dma_mask = 0;
 uint8_t PWMCluster::claimed_sms[] = { 0x0, 0x0 };
-uint PWMCluster::pio_program_offset = 0;
+uint PWMCluster::pio_program_offset[] = { 0, 0 };
+uint PWMCluster::dma_irq_index = 0;
+bool PWMCluster::dma_irq_exclusive = false;
+bool PWMCluster::irq_timing = false;
+volatile uint32_t PWMCluster::irq_restart_cycles = 0;
+PWMCluster::IrqStats PWMCluster::irq_stats;
+PWMCluster::IrqHook PWMCluster::irq_hook = nullptr;
+
+// SysTick counts down from its 24 bit reload value, at the system clock once started by set_irq_timing()
+static const uint32_t SYSTICK_MASK = 0x00FFFFFF;
+
+static inline uint32_t systick_elapsed(uint32_t from, uint32_t to) {
+  return (from - to) & SYSTICK_MASK;
+}
+
+static inline void dma_set_channel_irq_enabled(uint irq_index, uint channel, bool enabled) {
+  if(irq_index == 0)
+    dma_channel_set_irq0_enabled(channel, enabled);
+  else
+    dma_channel_set_irq1_enabled(channel, enabled);
+}
+
+static inline io_rw_32 &dma_inte_reg(uint irq_index) {
+  return (irq_index == 0) ? dma_hw->inte0 : dma_hw->inte1;
+}
+
+static inline io_rw_32 &dma_ints_reg(uint irq_index) {
+  return (irq_index == 0) ? dma_hw->ints0 : dma_hw->ints1;
+}
 
 
 PWMCluster::PWMCluster(PIO pio, uint sm, uint pin_mask, bool loading_zone)
@@ -163,11 +199,18 @@ void PWMCluster::constructor_common() {
     channels = new ChannelState[channel_count];
   }
 
+  if(pin_mask != 0) {
+    out_base = __builtin_ctz(pin_mask);
+    out_count = (32 - __builtin_clz(pin_mask)) - out_base;
+  }
+
   // Set up the transition buffers
   for(uint i = 0; i < NUM_BUFFERS; i++) {
     // Need to set a delay otherwise a lockup occurs when first changing frequency
-    sequences[i].data[0].delay = 10;
-    loop_sequences[i].data[0].delay = 10;
+    sequences[i].size = 0;
+    loop_sequences[i].size = 0;
+    append_transition(sequences[i], 0u, 10);
+    append_transition(loop_sequences[i], 0u, 10);
   }
 }
 
@@ -175,10 +218,19 @@ PWMCluster::~PWMCluster() {
   if(initialised) {
     pio_sm_set_enabled(pio, sm, false);
 
+    // Stop the control channel first, so it cannot restart the data channel while that is torn down
+    if(ctrl_channel >= 0) {
+      set_data_chain(false);
+      dma_channel_abort(ctrl_channel);
+      dma_channel_unclaim(ctrl_channel);
+      ctrl_channel = -1;
+    }
+
     // Tear down the DMA channel.
     // This is copied from: https://github.com/raspberrypi/pico-sdk/pull/744/commits/5e0e8004dd790f0155426e6689a66e08a83cd9fc
-    uint32_t irq0_save = dma_hw->inte0 & (1u << dma_channel);
-    hw_clear_bits(&dma_hw->inte0, irq0_save);
+    io_rw_32 &inte = dma_inte_reg(dma_irq_index);
+    uint32_t irq_save = inte & (1u << dma_channel);
+    hw_clear_bits(&inte, irq_save);
 
     dma_hw->abort = 1u << dma_channel;
 
@@ -187,11 +239,12 @@ PWMCluster::~PWMCluster() {
     while (dma_hw->ch[dma_channel].ctrl_trig & DMA_CH0_CTRL_TRIG_BUSY_BITS) tight_loop_contents();
 
     // Clear the interrupt (if any) and restore the interrupt masks.
-    dma_hw->ints0 = 1u << dma_channel;
-    hw_set_bits(&dma_hw->inte0, irq0_save);
+    dma_ints_reg(dma_irq_index) = 1u << dma_channel;
+    hw_set_bits(&inte, irq_save);
 
     dma_channel_unclaim(dma_channel); // This works now the teardown behaves correctly
     clusters[dma_channel] = nullptr;
+    cluster_dma_mask &= ~(1u << dma_channel);
 
     pio_sm_unclaim(pio, sm);
 
@@ -200,15 +253,20 @@ PWMCluster::~PWMCluster() {
 
     //If there are no more SMs using the encoder program, then we can remove it from the PIO
     if(claimed_sms[pio_idx] == 0) {
-    #ifdef DEBUG_MULTI_PWM
-      pio_remove_program(pio, &debug_pwm_cluster_program, pio_program_offset);
+    #if defined(DEBUG_MULTI_PWM)
+      pio_remove_program(pio, &debug_pwm_cluster_program, pio_program_offset[pio_idx]);
+    #elif defined(PWM_CLUSTER_COMPACT)
+      pio_remove_program(pio, &pwm_cluster_compact_program, pio_program_offset[pio_idx]);
     #else
-      pio_remove_program(pio, &pwm_cluster_program, pio_program_offset);
+      pio_remove_program(pio, &pwm_cluster_program, pio_program_offset[pio_idx]);
     #endif
     }
 
     if(claimed_sms[0] == 0 && claimed_sms[1] == 0) {
-      irq_remove_handler(DMA_IRQ_0, dma_interrupt_handler);
+      uint irq_num = DMA_IRQ_0 + dma_irq_index;
+      if(dma_irq_exclusive)
+        irq_set_enabled(irq_num, false);
+      irq_remove_handler(irq_num, dma_interrupt_handler);
     }
 
     // Reset all the pins this PWM will control back to an unused state
@@ -221,11 +279,36 @@ PWMCluster::~PWMCluster() {
 }
 
 void PWMCluster::dma_interrupt_handler() {
-  // Go through each dma channel to see which triggered this interrupt,
-  // and if there's an associated cluster, have it advance to the next sequence
-  for(uint8_t channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
-    if(dma_channel_get_irq0_status(channel) && clusters[channel] != nullptr) {
-      clusters[channel]->next_dma_sequence();
+  const bool timing = irq_timing;
+  const uint32_t entry = timing ? systick_hw->cvr : 0;
+  irq_restart_cycles = 0;
+  if(irq_hook != nullptr)
+    irq_hook(true);
+
+  // Read which channels triggered this interrupt just once, and only visit those with
+  // an associated cluster, having each advance to its next sequence. Channels of other
+  // drivers sharing the interrupt are left for their own handlers to acknowledge
+  uint32_t pending = dma_ints_reg(dma_irq_index) & cluster_dma_mask;
+  uint32_t sequences = 0;
+  while(pending != 0) {
+    uint channel = __builtin_ctz(pending);
+    pending &= pending - 1;
+    clusters[channel]->next_dma_sequence();
+    sequences++;
+  }
+
+  if(irq_hook != nullptr)
+    irq_hook(false);
+
+  if(timing) {
+    uint32_t cycles = systick_elapsed(entry, systick_hw->cvr);
+    irq_stats.count++;
+    irq_stats.sequences += sequences;
+    irq_stats.last_cycles = cycles;
+    irq_stats.max_cycles = MAX(irq_stats.max_cycles, cycles);
+    irq_stats.total_cycles += cycles;
+    if(sequences > 0) {
+      irq_stats.max_restart_cycles = MAX(irq_stats.max_restart_cycles, systick_elapsed(entry, irq_restart_cycles));
     }
   }
 }
@@ -236,29 +319,73 @@ void PWMCluster::next_dma_sequence() {
   #endif
 
   // Clear any interrupt request caused by our channel
-  dma_channel_acknowledge_irq0(dma_channel);
+  dma_ints_reg(dma_irq_index) = 1u << dma_channel;
 
   // If new data been written since the last time, switch to reading
   // that sequence, otherwise continue with the looping sequence
   Sequence* seq;
+  bool new_sequence = false;
   if(last_written_index != read_index) {
     read_index = last_written_index;
     seq = &sequences[read_index];
+    new_sequence = true;
   }
   else {
     seq = &loop_sequences[read_index];
   }
 
+  // Once back to looping, hand the restarts over to the control channel and stop interrupting.
+  // The transfer count written here is what the data channel reloads on every restart
+  if(ctrl_channel >= 0 && !new_sequence) {
+    loop_read_addr = (uint32_t)(uintptr_t)seq->data;
+    set_data_chain(true);
+    dma_set_channel_irq_enabled(dma_irq_index, dma_channel, false);
+  }
+
   // Let the dma channel know the sequence size and data location
-  dma_channel_set_trans_count(dma_channel, seq->size << 1, false);
+  dma_channel_set_trans_count(dma_channel, seq->size * WORDS_PER_TRANSITION, false);
   dma_channel_set_read_addr(dma_channel, seq->data, true);
 
+  // Only the first cluster's restart in an interrupt is the one measured. The bit above
+  // the counter marks the stamp as taken, even if the counter happened to read zero
+  if(irq_timing && irq_restart_cycles == 0)
+    irq_restart_cycles = systick_hw->cvr | (SYSTICK_MASK + 1);
+
+  // Each sequence covers exactly one period, so this marks a frame boundary.
+  // Only signal after the DMA is restarted, to keep the callback off the critical path.
+  // When chained, the periods looped without an interrupt are counted in as well
+  if(ctrl_channel >= 0) {
+    uint32_t now_us = time_us_32();
+    uint32_t period_q8 = frame_period_us_q8();
+    uint32_t frames = 1;
+    if(period_q8 > 0)
+      frames = MAX(1u, (uint32_t)((((uint64_t)(now_us - frame_anchor_us) << 8) + (period_q8 >> 1)) / period_q8));
+    frame_count += frames;
+    frame_anchor_us = now_us;
+  }
+  else {
+    frame_count++;
+  }
+  if(new_sequence) {
+    live_load = sequence_loads[read_index];
+    if(live_callback != nullptr) {
+      live_callback(live_load, live_callback_context);
+    }
+  }
+
   #ifdef DEBUG_MULTI_PWM
     gpio_put(IRQ_GPIO, false);
   #endif
 }
 
-bool PWMCluster::init() {
+// Leaving the state machine disabled lets several clusters be started together with enable_in_sync()
+bool PWMCluster::init(bool enable) {
+#ifdef PWM_CLUSTER_COMPACT
+  // The compact program can only reach so far above the lowest pin
+  if((pin_mask >> out_base) >> COMPACT_PIN_BITS != 0)
+    return false;
+#endif
+
   if(!initialised && !pio_sm_is_claimed(pio, sm)) {
     dma_channel = dma_claim_unused_channel(false);
     if(dma_channel >= 0) {
@@ -267,10 +394,12 @@ bool PWMCluster::init() {
 
       // If this is the first time using a cluster on this PIO, add the program to the PIO memory
       if(claimed_sms[pio_idx] == 0) {
-        #ifdef DEBUG_MULTI_PWM
-          pio_program_offset = pio_add_program(pio, &debug_pwm_cluster_program);
+        #if defined(DEBUG_MULTI_PWM)
+          pio_program_offset[pio_idx] = pio_add_program(pio, &debug_pwm_cluster_program);
+        #elif defined(PWM_CLUSTER_COMPACT)
+          pio_program_offset[pio_idx] = pio_add_program(pio, &pwm_cluster_compact_program);
         #else
-          pio_program_offset = pio_add_program(pio, &pwm_cluster_program);
+          pio_program_offset[pio_idx] = pio_add_program(pio, &pwm_cluster_program);
         #endif
       }
 
@@ -294,18 +423,21 @@ bool PWMCluster::init() {
       pio_gpio_init(pio, DEBUG_SIDESET);
       pio_sm_set_consecutive_pindirs(pio, sm, DEBUG_SIDESET, 1, true);
 
-      pio_sm_config c = debug_pwm_cluster_program_get_default_config(pio_program_offset);
-      sm_config_set_out_pins(&c, 0, IRQ_GPIO);
+      pio_sm_config c = debug_pwm_cluster_program_get_default_config(pio_program_offset[pio_idx]);
       sm_config_set_sideset_pins(&c, DEBUG_SIDESET);
+    #elif defined(PWM_CLUSTER_COMPACT)
+      pio_sm_config c = pwm_cluster_compact_program_get_default_config(pio_program_offset[pio_idx]);
     #else
-      pio_sm_config c = pwm_cluster_program_get_default_config(pio_program_offset);
-      sm_config_set_out_pins(&c, 0, 32);
+      pio_sm_config c = pwm_cluster_program_get_default_config(pio_program_offset[pio_idx]);
     #endif
+      // Only this cluster's span of pins, so its transitions leave those of other state machines alone
+      sm_config_set_out_pins(&c, out_base, out_count);
       sm_config_set_out_shift(&c, false, true, 32);
       sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_NONE); // We actively do not want a joined FIFO even though we are not needing the RX
 
       float div = clock_get_hz(clk_sys) / 500000;
       sm_config_set_clkdiv(&c, div);
+      clkdiv256 = (uint32_t)(div * 256.0f);
 
       dma_channel_config data_config = dma_channel_get_default_config(dma_channel);
       channel_config_set_bswap(&data_config, false);
@@ -321,19 +453,47 @@ bool PWMCluster::init() {
         0,
         false);
 
-      dma_channel_set_irq0_enabled(dma_channel, true);
+      dma_set_channel_irq_enabled(dma_irq_index, dma_channel, true);
+
+      // The control channel copies the looping sequence's address into the data channel's read
+      // address trigger each time the data channel finishes, and chains to it. Without a spare
+      // channel the cluster falls back to restarting every period from the interrupt
+      if(chained_dma) {
+        ctrl_channel = dma_claim_unused_channel(false);
+        if(ctrl_channel >= 0) {
+          dma_channel_config ctrl_config = dma_channel_get_default_config(ctrl_channel);
+          channel_config_set_transfer_data_size(&ctrl_config, DMA_SIZE_32);
+          channel_config_set_read_increment(&ctrl_config, false);
+          channel_config_set_write_increment(&ctrl_config, false);
+
+          dma_channel_configure(
+            ctrl_channel,
+            &ctrl_config,
+            &dma_hw->ch[dma_channel].al3_read_addr_trig,
+            &loop_read_addr,
+            1,
+            false);
+        }
+      }
 
-      pio_sm_init(pio, sm, pio_program_offset, &c);
-      pio_sm_set_enabled(pio, sm, true);
+      pio_sm_init(pio, sm, pio_program_offset[pio_idx], &c);
+      if(enable)
+        pio_sm_set_enabled(pio, sm, true);
 
       if(claimed_sms[0] == 0 && claimed_sms[1] == 0) {
-        // Configure the processor to run dma_handler() when DMA IRQ 0 is asserted
-        irq_add_shared_handler(DMA_IRQ_0, dma_interrupt_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
-        irq_set_enabled(DMA_IRQ_0, true);
+        // Configure the processor to run dma_handler() when the DMA IRQ is asserted. A dedicated line
+        // skips the shared handler chain, but then no other driver can have a handler on it
+        uint irq_num = DMA_IRQ_0 + dma_irq_index;
+        if(dma_irq_exclusive)
+          irq_set_exclusive_handler(irq_num, dma_interrupt_handler);
+        else
+          irq_add_shared_handler(irq_num, dma_interrupt_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(irq_num, true);
       }
 
       //Keep a record of this cluster for the interrupt callback
       clusters[dma_channel] = this;
+      cluster_dma_mask |= 1u << dma_channel;
       claimed_sms[pio_idx] |= 1u << sm;
 
       // Manually set the next dma sequence to trigger the first transfer
@@ -346,6 +506,53 @@ bool PWMCluster::init() {
   return initialised;
 }
 
+// Chained clusters only interrupt the CPU when a newly loaded sequence has to be switched in,
+// and loop their sequence with a second DMA channel otherwise. Between interrupts the frame
+// count is extrapolated from the timer. Only possible before init(), and loads then need to
+// come from the core the interrupt runs on
+bool PWMCluster::set_chained_dma(bool chained) {
+  if(initialised)
+    return false;
+
+  chained_dma = chained;
+  return true;
+}
+
+// Changes CTRL through its non-triggering alias, so any transfer in progress carries on
+void PWMCluster::set_data_chain(bool chain) {
+  uint32_t ctrl = dma_hw->ch[dma_channel].al1_ctrl;
+  uint chain_to = chain ? (uint)ctrl_channel : (uint)dma_channel; // Chaining to itself is no chain
+  dma_hw->ch[dma_channel].al1_ctrl = (ctrl & ~DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) | (chain_to << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+}
+
+// Takes the data channel back from the control channel, so the end of the current period
+// interrupts and the new sequence can be switched in
+void PWMCluster::arm_sequence_irq() {
+  uint32_t save = save_and_disable_interrupts();
+  if((dma_inte_reg(dma_irq_index) & (1u << dma_channel)) == 0) {
+    set_data_chain(false);
+
+    // A restart the chain already began has to land before the data channel can be checked
+    while(dma_channel_is_busy(ctrl_channel))
+      tight_loop_contents();
+
+    // Drop the completions that were left to the chain, then interrupt on the next one
+    dma_ints_reg(dma_irq_index) = 1u << dma_channel;
+    dma_set_channel_irq_enabled(dma_irq_index, dma_channel, true);
+
+    // If the period ended while the chain was being broken, nothing will restart it, so do so now
+    if(!dma_channel_is_busy(dma_channel))
+      next_dma_sequence();
+  }
+  restore_interrupts(save);
+}
+
+// The length of one PWM period in microseconds, in 24.8 fixed point
+uint32_t PWMCluster::frame_period_us_q8() const {
+  uint64_t cycles256 = (uint64_t)wrap_level * PWM_CLUSTER_CYCLES * clkdiv256;
+  return (uint32_t)((cycles256 * 1000000) / clock_get_hz(clk_sys));
+}
+
 uint8_t PWMCluster::get_chan_count() const {
   return channel_count;
 }
@@ -377,6 +584,7 @@ uint32_t PWMCluster::get_chan_level(uint8_t channel) const {
 void PWMCluster::set_chan_level(uint8_t channel, uint32_t level, bool load) {
   assert(channel < channel_count);
   channels[channel].level = level;
+  dirty_channels |= (1u << channel);
   if(load)
     load_pwm();
 }
@@ -389,6 +597,7 @@ uint32_t PWMCluster::get_chan_offset(uint8_t channel) const {
 void PWMCluster::set_chan_offset(uint8_t channel, uint32_t offset, bool load) {
   assert(channel < channel_count);
   channels[channel].offset = offset;
+  dirty_channels |= (1u << channel);
   if(load)
     load_pwm();
 }
@@ -401,6 +610,7 @@ bool PWMCluster::get_chan_polarity(uint8_t channel) const {
 void PWMCluster::set_chan_polarity(uint8_t channel, bool polarity, bool load) {
   assert(channel < channel_count);
   channels[channel].polarity = polarity;
+  dirty_channels |= (1u << channel);
   if(load)
     load_pwm();
 }
@@ -411,6 +621,7 @@ uint32_t PWMCluster::get_wrap() const {
 
 void PWMCluster::set_wrap(uint32_t wrap, bool load) {
   wrap_level = MAX(wrap, 1);  // Cannot have a wrap of zero!
+  rebuild_all = true;
   if(load)
     load_pwm();
 }
@@ -418,22 +629,123 @@ void PWMCluster::set_wrap(uint32_t wrap, bool load) {
 // These apply immediately, so do not obey the PWM update trigger
 void PWMCluster::set_clkdiv(float divider) {
   pio_sm_set_clkdiv(pio, sm, divider);
+  clkdiv256 = (uint32_t)(divider * 256.0f);
 }
 
 // These apply immediately, so do not obey the PWM update trigger
 void PWMCluster::set_clkdiv_int_frac(uint16_t integer, uint8_t fract) {
   pio_sm_set_clkdiv_int_frac(pio, sm, integer, fract);
+  clkdiv256 = ((uint32_t)integer << 8) | fract;
 }
 
 void PWMCluster::load_pwm() {
+  publish_sequence(write_sequence());
+}
+
+// Whether anything has changed that the next load would need to output
+bool PWMCluster::is_dirty() const {
+  return rebuild_all || dirty_channels != 0;
+}
+
+// Loads several clusters so their new sequences go live in the same period. All the sequences are
+// written first and then handed over together with interrupts off, so that no cluster's interrupt
+// can switch to its own before the rest are ready. The clusters' periods only line up if they were
+// started with enable_in_sync() and share a wrap and divider
+void PWMCluster::load_pwm_in_sync(PWMCluster *const *clusters, uint count) {
+  assert(count <= NUM_DMA_CHANNELS);
+  uint write_indices[NUM_DMA_CHANNELS];
+  for(uint i = 0; i < count; i++) {
+    write_indices[i] = clusters[i]->write_sequence();
+  }
+
+  uint32_t save = save_and_disable_interrupts();
+  for(uint i = 0; i < count; i++) {
+    clusters[i]->publish_sequence(write_indices[i]);
+  }
+  restore_interrupts(save);
+}
+
+// Starts the state machines of clusters initialised without being enabled, all on the same clock
+// cycle, so their periods begin together. The clusters must share a PIO. Returns false if they do not
+bool PWMCluster::enable_in_sync(PWMCluster *const *clusters, uint count) {
+  uint32_t sm_mask = 0;
+  for(uint i = 0; i < count; i++) {
+    if(!clusters[i]->initialised || clusters[i]->pio != clusters[0]->pio)
+      return false;
+    sm_mask |= 1u << clusters[i]->sm;
+  }
+
+  if(count > 0) {
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t now_us = time_us_32();
+    for(uint i = 0; i < count; i++) {
+      clusters[i]->frame_anchor_us = now_us;
+    }
+    pio_enable_sm_mask_in_sync(clusters[0]->pio, sm_mask);
+    restore_interrupts(save);
+  }
+  return true;
+}
+
+// Applies a new divider to clusters sharing a PIO and then restarts their dividers together, so
+// clusters started in sync stay in step. Returns false if they do not share a PIO
+bool PWMCluster::set_clkdiv_in_sync(PWMCluster *const *clusters, uint count, uint16_t integer, uint8_t fract) {
+  uint32_t sm_mask = 0;
+  for(uint i = 0; i < count; i++) {
+    if(clusters[i]->pio != clusters[0]->pio)
+      return false;
+    sm_mask |= 1u << clusters[i]->sm;
+  }
+
+  if(count > 0) {
+    uint32_t save = save_and_disable_interrupts();
+    for(uint i = 0; i < count; i++) {
+      clusters[i]->set_clkdiv_int_frac(integer, fract);
+    }
+    pio_clkdiv_restart_sm_mask(clusters[0]->pio, sm_mask);
+    restore_interrupts(save);
+  }
+  return true;
+}
+
+// Builds the next sequences into a buffer the DMA is not using, without handing them over. Returns that buffer's index
+uint PWMCluster::write_sequence() {
   #ifdef DEBUG_MULTI_PWM
     gpio_put(WRITE_GPIO, true);
   #endif
 
-  uint data_size = 0;
-  uint looping_data_size = 0;
+  // Bring the looping transitions up to date. These only depend on each channel's level, offset and polarity,
+  // so when only a few channels have changed just their transitions are moved. Each one moved is a pass over
+  // the sorted transitions, so past a quarter of the channels a rebuild from scratch is the cheaper
+  const uint incremental_limit = MAX(channel_count / INCREMENTAL_DIVISOR, 1u);
+  if(rebuild_all || (uint)__builtin_popcount(dirty_channels) > incremental_limit) {
+    looping_data_size = 0;
+    for(uint channel = 0; channel < channel_count; channel++) {
+      insert_looping_transitions(channel);
+    }
+
+    if(loading_zone) {
+      // Introduce "Loading Zone" transitions to the end of the sequence to
+      // prevent the DMA interrupt firing many milliseconds before the sequence ends.
+      uint32_t zone_inserts = MIN(LOADING_ZONE_SIZE, wrap_level - LOADING_ZONE_POSITION);
+      for(uint32_t i = zone_inserts + LOADING_ZONE_POSITION; i > LOADING_ZONE_POSITION; i--) {
+        PWMCluster::sorted_insert(looping_transitions, looping_data_size, TransitionData(wrap_level - i));
+      }
+    }
+    rebuild_all = false;
+  }
+  else if(dirty_channels != 0) {
+    PWMCluster::sorted_remove(looping_transitions, looping_data_size, dirty_channels);
+    for(uint channel = 0; channel < channel_count; channel++) {
+      if(bit_in_mask(channel, dirty_channels)) {
+        insert_looping_transitions(channel);
+      }
+    }
+  }
+  dirty_channels = 0;
 
   uint pin_states = 0; // Start with all pins low
+  uint32_t overrun_channels = 0;
 
   // Check if the data we last wrote has been picked up by the DMA yet?
   const bool read_since_last_write = (read_index == last_written_index);
@@ -463,40 +775,63 @@ void PWMCluster::load_pwm() {
     if(state.overrun > 0) {
       // Flip the initial state so the pin starts "high" (or "low" if polarity inverted)
       pin_states ^= (1u << channel_to_pin_map[channel]);
+    }
 
-      // Is our end level before our start level?
-      if(channel_wrapped_end < channel_start) {
-        // Yes, so add a transition to "low" (or "high" if polarity inverted) at the end level, rather than the overrun (so our pulse takes effect earlier)
-        PWMCluster::sorted_insert(transitions, data_size, TransitionData(channel, channel_wrapped_end, state.polarity));
-      }
-      else if(state.overrun < channel_start) {
-        // No, so add a transition to "low" (or "high" if polarity inverted) at the overrun instead
-        PWMCluster::sorted_insert(transitions, data_size, TransitionData(channel, state.overrun, state.polarity));
-      }
+    // If the channel overruns the wrap level, record by how much
+    if(state.level > 0 && channel_start < wrap_level && channel_wrapped_end < channel_start) {
+      state.next_overrun = channel_wrapped_end;
+    }
+
+    // This channel's transitions differ from its looping ones if the previous
+    // sequence overran the wrap level, or if its end level is beyond the wrap
+    if(state.overrun > 0 || channel_end >= wrap_level) {
+      overrun_channels |= (1u << channel);
     }
+  }
 
-    // Is the state level greater than zero, and the start level within the wrap?
-    if(state.level > 0 && channel_start < wrap_level) {
-      // Add a transition to "high" (or "low" if polarity inverted) at the start level
-      PWMCluster::sorted_insert(transitions, data_size, TransitionData(channel, channel_start, !state.polarity));
-      PWMCluster::sorted_insert(looping_transitions, looping_data_size, TransitionData(channel, channel_start, !state.polarity));
+  // The transitions for the next sequence only differ from the looping ones for those
+  // channels, so start with a copy of the looping transitions and then patch just them
+  uint data_size = looping_data_size;
+  for(uint i = 0; i < data_size; i++) {
+    transitions[i] = looping_transitions[i];
+  }
+
+  if(overrun_channels != 0) {
+    PWMCluster::sorted_remove(transitions, data_size, overrun_channels);
+
+    for(uint channel = 0; channel < channel_count; channel++) {
+      if(!bit_in_mask(channel, overrun_channels))
+        continue;
+
+      const ChannelState &state = channels[channel];
+      const uint channel_start = state.offset;
+      const uint channel_end = (state.offset + state.level);
+      const uint channel_wrapped_end = channel_end % wrap_level;
+
+      // Did the previous sequence overrun the wrap level?
+      if(state.overrun > 0) {
+        // Is our end level before our start level?
+        if(channel_wrapped_end < channel_start) {
+          // Yes, so add a transition to "low" (or "high" if polarity inverted) at the end level, rather than the overrun (so our pulse takes effect earlier)
+          PWMCluster::sorted_insert(transitions, data_size, TransitionData(channel, channel_wrapped_end, state.polarity));
+        }
+        else if(state.overrun < channel_start) {
+          // No, so add a transition to "low" (or "high" if polarity inverted) at the overrun instead
+          PWMCluster::sorted_insert(transitions, data_size, TransitionData(channel, state.overrun, state.polarity));
+        }
+      }
 
-      // If the channel has overrun the wrap level, record by how much
-      if(channel_wrapped_end < channel_start) {
-          state.next_overrun = channel_wrapped_end;
+      // Is the state level greater than zero, and the start level within the wrap?
+      if(state.level > 0 && channel_start < wrap_level) {
+        // Add a transition to "high" (or "low" if polarity inverted) at the start level
+        PWMCluster::sorted_insert(transitions, data_size, TransitionData(channel, channel_start, !state.polarity));
       }
-    }
 
-    // Is the state level within the wrap?
-    if(state.level < wrap_level) {
-      // Is the end level within the wrap too?
-      if(channel_end < wrap_level) {
+      // Are the state level and end level within the wrap?
+      if(state.level < wrap_level && channel_end < wrap_level) {
         // Add a transition to "low" (or "high" if polarity inverted) at the end level
         PWMCluster::sorted_insert(transitions, data_size, TransitionData(channel, channel_end, state.polarity));
       }
-
-      // Add a transition to "low" (or "high" if polarity inverted) at the wrapped end level
-      PWMCluster::sorted_insert(looping_transitions, looping_data_size, TransitionData(channel, channel_wrapped_end, state.polarity));
     }
   }
 
@@ -504,16 +839,6 @@ void PWMCluster::load_pwm() {
     gpio_put(WRITE_GPIO, false);
   #endif
 
-  if(loading_zone) {
-    // Introduce "Loading Zone" transitions to the end of the sequence to
-    // prevent the DMA interrupt firing many milliseconds before the sequence ends.
-    uint32_t zone_inserts = MIN(LOADING_ZONE_SIZE, wrap_level - LOADING_ZONE_POSITION);
-    for(uint32_t i = zone_inserts + LOADING_ZONE_POSITION; i > LOADING_ZONE_POSITION; i--) {
-      PWMCluster::sorted_insert(transitions, data_size, TransitionData(wrap_level - i));
-      PWMCluster::sorted_insert(looping_transitions, looping_data_size, TransitionData(wrap_level - i));
-    }
-  }
-
   #ifdef DEBUG_MULTI_PWM
     gpio_put(WRITE_GPIO, true);
   #endif
@@ -538,12 +863,183 @@ void PWMCluster::load_pwm() {
   populate_sequence(transitions, data_size, sequences[write_index], pin_states);
   populate_sequence(looping_transitions, looping_data_size, loop_sequences[write_index], pin_states);
 
-  // Update the last written index so that the next DMA interrupt picks up the new sequence
-  last_written_index = write_index;
-
   #ifdef DEBUG_MULTI_PWM
     gpio_put(WRITE_GPIO, false);
   #endif
+
+  return write_index;
+}
+
+// The buffer stays free of the DMA until this, as the interrupt only ever moves to the last written index
+void PWMCluster::publish_sequence(uint write_index) {
+  // Update the last written index so that the next DMA interrupt picks up the new sequence
+  load_count++;
+  sequence_loads[write_index] = load_count;
+  last_written_index = write_index;
+
+  // A chained cluster is not interrupting while it loops, so ask for the next period end
+  if(ctrl_channel >= 0)
+    arm_sequence_irq();
+}
+
+uint32_t PWMCluster::get_load_count() const {
+  return load_count;
+}
+
+uint32_t PWMCluster::get_live_load() const {
+  return live_load;
+}
+
+// Whether the given load, or one after it, has started being output. Loads that are overwritten
+// before the next period starts never go live themselves, but are covered by the later load
+bool PWMCluster::is_load_live(uint32_t load) const {
+  return (int32_t)(live_load - load) >= 0;
+}
+
+// Blocks until the given load goes live, or the timeout passes. Returns false on timeout
+bool PWMCluster::wait_for_load(uint32_t load, uint32_t timeout_us) {
+  absolute_time_t timeout = make_timeout_time_us(timeout_us);
+  while(!is_load_live(load)) {
+    if(time_reached(timeout))
+      return false;
+    tight_loop_contents();
+  }
+  return true;
+}
+
+// When chained, the periods looped since the last interrupt are added from the timer
+uint32_t PWMCluster::get_frame_count() const {
+  if(ctrl_channel < 0)
+    return frame_count;
+
+  uint32_t save = save_and_disable_interrupts();
+  uint32_t count = frame_count;
+  uint32_t anchor_us = frame_anchor_us;
+  restore_interrupts(save);
+
+  uint32_t period_q8 = frame_period_us_q8();
+  if(period_q8 == 0)
+    return count;
+  return count + (uint32_t)(((uint64_t)(time_us_32() - anchor_us) << 8) / period_q8);
+}
+
+// Picks the DMA IRQ line the clusters use, and whether they have it to themselves. Only possible
+// before the first cluster is initialised. Returns false if too late, or if the line is invalid
+bool PWMCluster::set_dma_irq(uint irq_index, bool exclusive) {
+  if(irq_index > 1 || claimed_sms[0] != 0 || claimed_sms[1] != 0)
+    return false;
+
+  dma_irq_index = irq_index;
+  dma_irq_exclusive = exclusive;
+  return true;
+}
+
+// Starts timing the DMA interrupt with SysTick, which is left free running at the system clock.
+// SysTick belongs to each core, so call this from the core the clusters were initialised on
+void PWMCluster::set_irq_timing(bool enable) {
+  if(enable && !irq_timing) {
+    systick_hw->csr = 0;
+    systick_hw->rvr = SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+  }
+  irq_timing = enable;
+}
+
+// Taken with interrupts disabled, so the fields all come from between the same two interrupts
+PWMCluster::IrqStats PWMCluster::get_irq_stats() {
+  uint32_t save = save_and_disable_interrupts();
+  IrqStats stats = irq_stats;
+  restore_interrupts(save);
+  return stats;
+}
+
+void PWMCluster::reset_irq_stats() {
+  uint32_t save = save_and_disable_interrupts();
+  irq_stats = IrqStats();
+  restore_interrupts(save);
+}
+
+// The hook runs inside the DMA interrupt, twice per interrupt, so should be as short as a pin toggle
+void PWMCluster::set_irq_hook(IrqHook hook) {
+  irq_hook = hook;
+}
+
+// The callback runs in the DMA interrupt, so should do no more than note the frame or signal a semaphore
+void PWMCluster::set_live_callback(LiveCallback callback, void *context) {
+  // Change both together, so the interrupt never sees the new callback with the old context
+  uint32_t save = save_and_disable_interrupts();
+  live_callback = callback;
+  live_callback_context = context;
+  restore_interrupts(save);
+}
+
+// Runs the most recently loaded looping sequence through a model of the PIO program, and reports
+// the exact cycles each channel's edges occur on. This lets the generated data be checked against
+// the requested levels without needing to capture the pins. Not intended for time critical code
+bool PWMCluster::measure_loop_sequence(ChannelTiming *timings_out, uint8_t length, uint64_t &period_cycles_out) const {
+  assert(timings_out != nullptr);
+  const Sequence &loop = loop_sequences[last_written_index];
+  if(loop.size == 0)
+    return false;
+
+  // The pins enter the loop in the state the loop itself finishes in, so start the model from there.
+  // Three loops are run, so that edges of channels that wrap around the period can be paired up
+  const uint32_t *words = reinterpret_cast<const uint32_t *>(loop.data); // This is exactly what the DMA streams
+#ifdef PWM_CLUSTER_COMPACT
+  PWMClusterModel model(pin_mask, PWMClusterModel::compact_pin_states(words[loop.size - 1], out_base));
+  model.run_compact(words, loop.size, out_base);
+  const uint64_t period = model.get_cycles();
+  model.run_compact(words, loop.size, out_base);
+  model.run_compact(words, loop.size, out_base);
+#else
+  PWMClusterModel model(pin_mask, loop.data[loop.size - 1].mask << out_base);
+  model.run(words, loop.size << 1, out_base);
+  const uint64_t period = model.get_cycles();
+  model.run(words, loop.size << 1, out_base);
+  model.run(words, loop.size << 1, out_base);
+#endif
+
+  if(model.get_edges_dropped() > 0)
+    return false;
+
+  uint8_t count = MIN(length, channel_count);
+  for(uint8_t channel = 0; channel < count; channel++) {
+    ChannelTiming &timing = timings_out[channel];
+    timing = ChannelTiming();
+
+    const uint8_t pin = channel_to_pin_map[channel];
+    const bool active_state = !channels[channel].polarity;
+
+    // Find the first time in the middle loop the channel becomes active, and the next time after it goes inactive
+    bool rise_found = false;
+    for(uint32_t e = 0; e < model.get_edge_count(); e++) {
+      const PWMClusterModel::Edge &edge = model.get_edge(e);
+      if(edge.pin != pin)
+        continue;
+
+      if(!rise_found) {
+        if(edge.state == active_state && edge.cycle >= period && edge.cycle < (period << 1)) {
+          timing.rise_cycle = edge.cycle - period;
+          rise_found = true;
+        }
+      }
+      else if(edge.state != active_state) {
+        timing.fall_cycle = edge.cycle - period;
+        timing.active_cycles = timing.fall_cycle - timing.rise_cycle;
+        timing.pulsing = true;
+        break;
+      }
+    }
+
+    if(!timing.pulsing) {
+      timing.active = (((model.get_pin_states() >> pin) & 0b1) != 0) == active_state;
+      timing.active_cycles = timing.active ? period : 0;
+    }
+  }
+
+  period_cycles_out = period;
+  return true;
 }
 
 // Derived from the rp2 Micropython implementation: https://github.com/micropython/micropython/blob/master/ports/rp2/machine_pwm.c
@@ -607,6 +1103,36 @@ void PWMCluster::sorted_insert(TransitionData array[], uint &size, const Transit
   size++;
 }
 
+void PWMCluster::sorted_remove(TransitionData array[], uint &size, uint32_t channel_mask) {
+  // Remove all transitions of the masked channels, shuffling the rest down so they remain in order
+  uint j = 0;
+  for(uint i = 0; i < size; i++) {
+    if(array[i].dummy || !bit_in_mask(array[i].channel, channel_mask)) {
+      array[j] = array[i];
+      j++;
+    }
+  }
+  size = j;
+}
+
+void PWMCluster::insert_looping_transitions(uint8_t channel) {
+  const ChannelState &state = channels[channel];
+  const uint channel_start = state.offset;
+  const uint channel_wrapped_end = (state.offset + state.level) % wrap_level;
+
+  // Is the state level greater than zero, and the start level within the wrap?
+  if(state.level > 0 && channel_start < wrap_level) {
+    // Add a transition to "high" (or "low" if polarity inverted) at the start level
+    PWMCluster::sorted_insert(looping_transitions, looping_data_size, TransitionData(channel, channel_start, !state.polarity));
+  }
+
+  // Is the state level within the wrap?
+  if(state.level < wrap_level) {
+    // Add a transition to "low" (or "high" if polarity inverted) at the wrapped end level
+    PWMCluster::sorted_insert(looping_transitions, looping_data_size, TransitionData(channel, channel_wrapped_end, state.polarity));
+  }
+}
+
 void PWMCluster::populate_sequence(const TransitionData transitions[], const uint &data_size, Sequence &seq_out, uint &pin_states_in_out) const {
   seq_out.size = 0; // Reset the sequence, otherwise we end up appending and weird things happen
 
@@ -641,9 +1167,7 @@ void PWMCluster::populate_sequence(const TransitionData transitions[], const uin
       } while(data_index < data_size);
 
       // Add the transition to the sequence
-      seq_out.data[seq_out.size].mask = pin_states_in_out;
-      seq_out.data[seq_out.size].delay = (next_level - current_level) - 1;
-      seq_out.size++;
+      append_transition(seq_out, pin_states_in_out, (next_level - current_level) - 1);
 
       current_level = next_level;
     }
@@ -651,9 +1175,31 @@ void PWMCluster::populate_sequence(const TransitionData transitions[], const uin
   else {
     // There were no transitions (either because there was a zero wrap, or no channels because there was a zero wrap?),
     // so initialise the sequence with something, so the PIO functions correctly
-    seq_out.data[seq_out.size].mask = 0u;
-    seq_out.data[seq_out.size].delay = wrap_level - 1;
+    append_transition(seq_out, 0u, wrap_level - 1);
+  }
+}
+
+// Adds a transition that sets the pins, then holds them for delay + 1 loops of the program. The states are
+// packed from the out base, and cut to the OUT window. A compact word only has room for so long a delay,
+// so longer ones carry on over more words that leave the pins as they are
+void PWMCluster::append_transition(Sequence &seq_out, uint32_t pin_states, uint32_t delay) const {
+  const uint32_t window_states = (pin_states >> out_base) & ((out_count < 32) ? ((1u << out_count) - 1) : UINT32_MAX);
+#ifdef PWM_CLUSTER_COMPACT
+  const uint32_t packed_states = (window_states & ((1u << COMPACT_PIN_BITS) - 1)) << COMPACT_DELAY_BITS;
+  while(delay > COMPACT_MAX_DELAY) {
+    assert(seq_out.size < SEQUENCE_SIZE);
+    seq_out.data[seq_out.size] = packed_states | COMPACT_MAX_DELAY;
     seq_out.size++;
+    delay -= COMPACT_MAX_DELAY + 1;
   }
+  assert(seq_out.size < SEQUENCE_SIZE);
+  seq_out.data[seq_out.size] = packed_states | delay;
+  seq_out.size++;
+#else
+  assert(seq_out.size < SEQUENCE_SIZE);
+  seq_out.data[seq_out.size].mask = window_states;
+  seq_out.data[seq_out.size].delay = delay;
+  seq_out.size++;
+#endif
+}
 }
-}
\ No newline at end of file
@@ -21,15 +21,56 @@ namespace pimoroni {
                                                               // Smaller values will make the DMA interrupt trigger closer to the time the data is needed,
                                                               // but risks stalling the PIO if the interrupt takes longer due to other processes
     static const bool DEFAULT_USE_LOADING_ZONE = true;        // Whether or not the default behaviour of PWMCluster is to use the loading zone
+    static const uint INCREMENTAL_DIVISOR = 4;                // Loads with more than this fraction of the channels dirty rebuild the looping transitions
+                                                              // in full, as patching them one channel at a time costs as much by then (see pwm_cluster_bench)
   public:
     static const uint BUFFER_SIZE = 64;     // Set to 64, the maximum number of single rises and falls for 32 channels within a looping time period
     static const uint NUM_BUFFERS = 3;
 
+    // Defining PWM_CLUSTER_COMPACT packs each transition into a single word for the pwm_cluster_compact program,
+    // with the pin states above the delay. This halves the sequence memory and the DMA traffic, but limits a
+    // cluster to pins within COMPACT_PIN_BITS of its lowest one
+    static const uint COMPACT_PIN_BITS = 18;                                    // Must match PWM_CLUSTER_COMPACT_PIN_BITS in pwm_cluster.pio
+    static const uint COMPACT_DELAY_BITS = 32 - COMPACT_PIN_BITS;
+    static const uint32_t COMPACT_MAX_DELAY = (1u << COMPACT_DELAY_BITS) - 1;
+  #ifdef PWM_CLUSTER_COMPACT
+    static const uint SEQUENCE_SIZE = BUFFER_SIZE + (MAX_PWM_CLUSTER_WRAP >> COMPACT_DELAY_BITS);  // Room for delays split over several words
+    static const uint WORDS_PER_TRANSITION = 1;
+  #else
+    static const uint SEQUENCE_SIZE = BUFFER_SIZE;
+    static const uint WORDS_PER_TRANSITION = 2;
+  #endif
+
 
     //--------------------------------------------------
     // Substructures
     //--------------------------------------------------
   public:
+    // Called from the DMA interrupt when a newly loaded sequence starts being output, with the load count it came from
+    typedef void (*LiveCallback)(uint32_t load, void *context);
+
+    // Called at the very start and very end of the DMA interrupt, for example to toggle a pin and compare
+    // the interrupt on a scope against others sharing the core
+    typedef void (*IrqHook)(bool entering);
+
+    struct IrqStats {
+      //--------------------------------------------------
+      // Variables
+      //--------------------------------------------------
+      uint32_t count;               // Interrupts handled
+      uint32_t sequences;           // Sequences advanced, more than count when clusters finish together
+      uint32_t last_cycles;         // Entry to exit, in system clock cycles
+      uint32_t max_cycles;
+      uint64_t total_cycles;
+      uint32_t max_restart_cycles;  // Entry to the first DMA restart, which has to beat the loading zone
+
+
+      //--------------------------------------------------
+      // Constructors/Destructor
+      //--------------------------------------------------
+      IrqStats() : count(0), sequences(0), last_cycles(0), max_cycles(0), total_cycles(0), max_restart_cycles(0) {};
+    };
+
     struct Transition {
       //--------------------------------------------------
       // Variables
@@ -44,12 +85,27 @@ namespace pimoroni {
       Transition() : mask(0), delay(0) {};
     };
 
+  #ifdef PWM_CLUSTER_COMPACT
     struct Sequence {
       //--------------------------------------------------
       // Variables
       //--------------------------------------------------
       uint32_t size;
-      Transition data[BUFFER_SIZE];
+      uint32_t data[SEQUENCE_SIZE];   // The pin states from the out base in the top COMPACT_PIN_BITS, then the delay
+
+
+      //--------------------------------------------------
+      // Constructors/Destructor
+      //--------------------------------------------------
+      Sequence() : size(1), data{0} {};
+    };
+  #else
+    struct Sequence {
+      //--------------------------------------------------
+      // Variables
+      //--------------------------------------------------
+      uint32_t size;
+      Transition data[SEQUENCE_SIZE];
 
 
       //--------------------------------------------------
@@ -57,6 +113,7 @@ namespace pimoroni {
       //--------------------------------------------------
       Sequence() : size(1), data{Transition()} {};
     };
+  #endif
 
     struct TransitionData {
       //--------------------------------------------------
@@ -76,6 +133,23 @@ namespace pimoroni {
       TransitionData(uint32_t level) : channel(0), level(level), state(false), dummy(true) {};
     };
 
+    struct ChannelTiming {
+      //--------------------------------------------------
+      // Variables
+      //--------------------------------------------------
+      uint64_t rise_cycle;      // PIO cycle within the period that the channel becomes active
+      uint64_t fall_cycle;      // PIO cycle within the period that the channel becomes inactive (may exceed the period if wrapped)
+      uint64_t active_cycles;
+      bool pulsing;             // False if the channel never changed state, so is either always active or always inactive
+      bool active;              // If not pulsing, whether the channel is held active
+
+
+      //--------------------------------------------------
+      // Constructors/Destructor
+      //--------------------------------------------------
+      ChannelTiming() : rise_cycle(0), fall_cycle(0), active_cycles(0), pulsing(false), active(false) {};
+    };
+
   private:
     struct ChannelState {
       //--------------------------------------------------
@@ -102,10 +176,17 @@ namespace pimoroni {
     PIO pio;
     uint sm;
     int dma_channel;
+    int ctrl_channel = -1;                  // Re-triggers the looping sequence when chained, otherwise -1
+    bool chained_dma = false;
+    volatile uint32_t loop_read_addr = 0;   // The looping sequence's data, as read by the control channel
     uint pin_mask;
     uint8_t channel_count;
     ChannelState* channels;
     uint8_t channel_to_pin_map[NUM_BANK0_GPIOS];
+    uint8_t out_base = 0;                   // The lowest pin, which the programs output from
+    uint8_t out_count = 0;                  // The pins from the out base up to the highest, and no further. A PIO's
+                                            // state machines share its output levels, so a wider OUT window would
+                                            // drive the pins of other clusters on the same PIO
     uint wrap_level;
 
     Sequence sequences[NUM_BUFFERS];
@@ -113,6 +194,10 @@ namespace pimoroni {
 
     TransitionData transitions[BUFFER_SIZE];
     TransitionData looping_transitions[BUFFER_SIZE];
+    uint looping_data_size = 0;             // The looping transitions are kept sorted between loads, and only patched for dirty channels
+
+    uint32_t dirty_channels = 0;            // Channels whose level, offset or polarity have changed since the last load
+    bool rebuild_all = true;                // Set when the wrap changes, as that moves every transition
 
     volatile uint read_index = 0;
     volatile uint last_written_index = 0;
@@ -120,13 +205,30 @@ namespace pimoroni {
     bool initialised = false;
     bool loading_zone = true;
 
+    uint32_t load_count = 0;
+    uint32_t sequence_loads[NUM_BUFFERS] = { 0, 0, 0 };  // The load count each buffer was written by
+    volatile uint32_t live_load = 0;                    // The load count of the sequence currently being output
+    volatile uint32_t frame_count = 0;                  // Incremented at the start of every PWM period
+    volatile uint32_t frame_anchor_us = 0;              // When the interrupt last counted frames, to extrapolate from when chained
+    uint32_t clkdiv256 = 256;                           // The state machine's clock divider, in 1/256ths
+
+    LiveCallback live_callback = nullptr;
+    void *live_callback_context = nullptr;
+
 
     //--------------------------------------------------
     // Statics
     //--------------------------------------------------
     static PWMCluster* clusters[NUM_DMA_CHANNELS];
+    static uint32_t cluster_dma_mask;       // The DMA channels in clusters[], so the interrupt only looks at those
     static uint8_t claimed_sms[NUM_PIOS];
-    static uint pio_program_offset;
+    static uint pio_program_offset[NUM_PIOS];   // Each PIO may have other programs loaded, so its own offset
+    static uint dma_irq_index;              // 0 for DMA_IRQ_0, 1 for DMA_IRQ_1
+    static bool dma_irq_exclusive;
+    static bool irq_timing;
+    static volatile uint32_t irq_restart_cycles;
+    static IrqStats irq_stats;
+    static IrqHook irq_hook;
     static void dma_interrupt_handler();
 
 
@@ -151,7 +253,8 @@ namespace pimoroni {
     // Methods
     //--------------------------------------------------
   public:
-    bool init();
+    bool set_chained_dma(bool chained);
+    bool init(bool enable = true);
 
     uint8_t get_chan_count() const;
     uint8_t get_chan_pair_count() const;
@@ -175,6 +278,25 @@ namespace pimoroni {
     void set_clkdiv_int_frac(uint16_t integer, uint8_t fract);
 
     void load_pwm();
+    bool is_dirty() const;
+    uint32_t get_load_count() const;
+    uint32_t get_live_load() const;
+    bool is_load_live(uint32_t load) const;
+    bool wait_for_load(uint32_t load, uint32_t timeout_us);
+    uint32_t get_frame_count() const;
+    void set_live_callback(LiveCallback callback, void *context = nullptr);
+
+    bool measure_loop_sequence(ChannelTiming *timings_out, uint8_t length, uint64_t &period_cycles_out) const;
+
+    static void load_pwm_in_sync(PWMCluster *const *clusters, uint count);
+    static bool enable_in_sync(PWMCluster *const *clusters, uint count);
+    static bool set_clkdiv_in_sync(PWMCluster *const *clusters, uint count, uint16_t integer, uint8_t fract);
+
+    static bool set_dma_irq(uint irq_index, bool exclusive = false);
+    static void set_irq_timing(bool enable);
+    static IrqStats get_irq_stats();
+    static void reset_irq_stats();
+    static void set_irq_hook(IrqHook hook);
 
     //--------------------------------------------------
   public:
@@ -182,8 +304,16 @@ namespace pimoroni {
   private:
     static bool bit_in_mask(uint bit, uint mask);
     static void sorted_insert(TransitionData array[], uint &size, const TransitionData &data);
+    static void sorted_remove(TransitionData array[], uint &size, uint32_t channel_mask);
+    void insert_looping_transitions(uint8_t channel);
     void populate_sequence(const TransitionData transitions[], const uint &data_size, Sequence &seq_out, uint &pin_states_in_out) const;
+    void append_transition(Sequence &seq_out, uint32_t pin_states, uint32_t delay) const;
 
+    uint write_sequence();
+    void publish_sequence(uint write_index);
     void next_dma_sequence();
+    void set_data_chain(bool chain);
+    void arm_sequence_irq();
+    uint32_t frame_period_us_q8() const;
   };
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "pwm_cluster_model.hpp"
+#include <assert.h>
+
+namespace pimoroni {
+
+PWMClusterModel::PWMClusterModel(uint32_t pin_mask, uint32_t initial_states)
+: pin_mask(pin_mask) {
+  reset(initial_states);
+}
+
+void PWMClusterModel::reset(uint32_t initial_states) {
+  pin_states = initial_states & pin_mask;
+  cycles = 0;
+  transitions = 0;
+  clear_edges();
+}
+
+void PWMClusterModel::clear_edges() {
+  edge_count = 0;
+  edges_dropped = 0;
+}
+
+void PWMClusterModel::run(const uint32_t *words, uint32_t word_count, uint8_t out_base) {
+  // Each transition is two words. The program pulls the mask and outputs it one cycle in,
+  // then pulls the delay and counts it down, taking CYCLES_PER_LOOP for each count plus the initial load
+  for(uint32_t i = 0; i + 1 < word_count; i += 2) {
+    transition(words[i] << out_base, words[i + 1]);
+  }
+}
+
+void PWMClusterModel::run_compact(const uint32_t *words, uint32_t word_count, uint8_t out_base) {
+  // Each transition is one word, with the pins from the out base in its top bits. The program outputs
+  // them one cycle in, as the two word one does, and its extra cycle loading the delay keeps the timing the same
+  for(uint32_t i = 0; i < word_count; i++) {
+    transition(compact_pin_states(words[i], out_base), words[i] & ((1u << COMPACT_DELAY_BITS) - 1));
+  }
+}
+
+uint32_t PWMClusterModel::compact_pin_states(uint32_t word, uint8_t out_base) {
+  return (word >> COMPACT_DELAY_BITS) << out_base;
+}
+
+void PWMClusterModel::transition(uint32_t new_states, uint32_t delay) {
+  new_states &= pin_mask;
+
+  uint32_t changed = new_states ^ pin_states;
+  for(uint8_t pin = 0; changed != 0; pin++, changed >>= 1) {
+    if(changed & 0b1) {
+      if(edge_count < MAX_EDGES) {
+        edges[edge_count] = Edge(cycles + OUT_CYCLE, pin, (new_states & (1u << pin)) != 0);
+        edge_count++;
+      }
+      else {
+        edges_dropped++;
+      }
+    }
+  }
+
+  pin_states = new_states;
+  cycles += transition_cycles(delay);
+  transitions++;
+}
+
+uint32_t PWMClusterModel::get_pin_states() const {
+  return pin_states;
+}
+
+uint64_t PWMClusterModel::get_cycles() const {
+  return cycles;
+}
+
+uint32_t PWMClusterModel::get_transition_count() const {
+  return transitions;
+}
+
+uint32_t PWMClusterModel::get_edge_count() const {
+  return edge_count;
+}
+
+const PWMClusterModel::Edge &PWMClusterModel::get_edge(uint32_t index) const {
+  assert(index < edge_count);
+  return edges[index];
+}
+
+uint32_t PWMClusterModel::get_edges_dropped() const {
+  return edges_dropped;
+}
+
+uint64_t PWMClusterModel::transition_cycles(uint32_t delay) {
+  return (uint64_t)CYCLES_PER_LOOP * ((uint64_t)delay + 1);
+}
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace pimoroni {
+
+  // A software model of the pwm_cluster.pio program. It consumes the same word stream that PWMCluster's
+  // DMA feeds to the state machine and reconstructs the resulting pin waveforms, so sequences can be
+  // checked without PIO hardware. It intentionally has no dependencies on the Pico SDK.
+  class PWMClusterModel {
+    //--------------------------------------------------
+    // Constants
+    //--------------------------------------------------
+  public:
+    static const uint32_t CYCLES_PER_LOOP = 5;    // Must match PWM_CLUSTER_CYCLES in pwm_cluster.pio
+    static const uint32_t OUT_CYCLE = 1;          // The cycle within a transition that "out pins" changes the pins
+    static const uint32_t COMPACT_PIN_BITS = 18;  // Must match PWM_CLUSTER_COMPACT_PIN_BITS in pwm_cluster.pio
+    static const uint32_t COMPACT_DELAY_BITS = 32 - COMPACT_PIN_BITS;
+    static const uint32_t MAX_EDGES = 256;
+
+
+    //--------------------------------------------------
+    // Substructures
+    //--------------------------------------------------
+  public:
+    struct Edge {
+      //--------------------------------------------------
+      // Variables
+      //--------------------------------------------------
+      uint64_t cycle;   // The PIO cycle the pin changed on, counted from the last reset
+      uint8_t pin;
+      bool state;
+
+
+      //--------------------------------------------------
+      // Constructors/Destructor
+      //--------------------------------------------------
+      Edge() : cycle(0), pin(0), state(false) {};
+      Edge(uint64_t cycle, uint8_t pin, bool state) : cycle(cycle), pin(pin), state(state) {};
+    };
+
+
+    //--------------------------------------------------
+    // Variables
+    //--------------------------------------------------
+  private:
+    uint32_t pin_mask;
+    uint32_t pin_states;
+    uint64_t cycles;
+    uint32_t transitions;
+
+    Edge edges[MAX_EDGES];
+    uint32_t edge_count;
+    uint32_t edges_dropped;
+
+
+    //--------------------------------------------------
+    // Constructors/Destructor
+    //--------------------------------------------------
+  public:
+    PWMClusterModel(uint32_t pin_mask, uint32_t initial_states = 0);
+
+
+    //--------------------------------------------------
+    // Methods
+    //--------------------------------------------------
+  public:
+    void reset(uint32_t initial_states = 0);
+    void clear_edges();
+
+    // Consume words as the DMA would stream them, alternating a pin state mask from the out base then a delay
+    void run(const uint32_t *words, uint32_t word_count, uint8_t out_base);
+
+    // Consume words as the DMA would stream them to the pwm_cluster_compact program, one per transition
+    void run_compact(const uint32_t *words, uint32_t word_count, uint8_t out_base);
+    static uint32_t compact_pin_states(uint32_t word, uint8_t out_base);
+
+    uint32_t get_pin_states() const;
+    uint64_t get_cycles() const;
+    uint32_t get_transition_count() const;
+
+    uint32_t get_edge_count() const;
+    const Edge &get_edge(uint32_t index) const;
+    uint32_t get_edges_dropped() const;
+
+    //--------------------------------------------------
+    static uint64_t transition_cycles(uint32_t delay);
+    void transition(uint32_t new_states, uint32_t delay);
+  };
+
+}
@@ -1,4 +1,5 @@
 #include "calibration.hpp"
+#include <math.h>
 
 namespace servo {
   Calibration::Pair::Pair()
@@ -10,7 +11,8 @@ namespace servo {
   }
 
   Calibration::Calibration()
-    : calibration(nullptr), calibration_size(0), limit_lower(true), limit_upper(true) {
+    : calibration(nullptr), calibration_size(0), limit_lower(true), limit_upper(true)
+    , fixed(nullptr), tables_dirty(true), fixed_valid(false) {
   }
 
   Calibration::Calibration(CalibrationType default_type)
@@ -19,7 +21,8 @@ namespace servo {
   }
 
   Calibration::Calibration(const Calibration &other)
-    : calibration(nullptr), calibration_size(0), limit_lower(other.limit_lower), limit_upper(other.limit_upper) {
+    : calibration(nullptr), calibration_size(0), limit_lower(other.limit_lower), limit_upper(other.limit_upper)
+    , fixed(nullptr), tables_dirty(true), fixed_valid(false) {
     uint size = other.size();
     apply_blank_pairs(size);
     for(uint i = 0; i < size; i++) {
@@ -32,6 +35,10 @@ namespace servo {
       delete[] calibration;
       calibration = nullptr;
     }
+    if(fixed != nullptr) {
+      delete[] fixed;
+      fixed = nullptr;
+    }
   }
 
   Calibration &Calibration::operator=(const Calibration &other) {
@@ -48,6 +55,7 @@ namespace servo {
 
   Calibration::Pair &Calibration::operator[](uint8_t index) {
     assert(index < calibration_size);
+    tables_dirty = true;
     return calibration[index];
   }
 
@@ -60,15 +68,21 @@ namespace servo {
     if(calibration != nullptr) {
       delete[] calibration;
     }
+    if(fixed != nullptr) {
+      delete[] fixed;
+    }
 
     if(size > 0) {
       calibration = new Pair[size];
+      fixed = new FixedPair[size];
       calibration_size = size;
     }
     else {
       calibration = nullptr;
+      fixed = nullptr;
       calibration_size = 0;
     }
+    tables_dirty = true;
   }
 
   void Calibration::apply_two_pairs(float min_pulse, float max_pulse, float min_value, float max_value) {
@@ -120,6 +134,7 @@ namespace servo {
 
   Calibration::Pair &Calibration::pair(uint8_t index) {
     assert(index < calibration_size);
+    tables_dirty = true;
     return calibration[index];
   }
 
@@ -146,6 +161,7 @@ namespace servo {
 
   Calibration::Pair &Calibration::first() {
     assert(calibration_size > 0);
+    tables_dirty = true;
     return calibration[0];
   }
 
@@ -172,6 +188,7 @@ namespace servo {
 
   Calibration::Pair &Calibration::last() {
     assert(calibration_size > 0);
+    tables_dirty = true;
     return calibration[calibration_size - 1];
   }
 
@@ -241,14 +258,10 @@ namespace servo {
         }
       }
       else {
-        // The value must between two calibration pairs, so iterate through them to find which ones
-        for(uint8_t i = 0; i < last; i++) {
-          if(value <= calibration[i + 1].value) {
-            pulse_out = map_float(value, calibration[i].value, calibration[i + 1].value,
-                                         calibration[i].pulse, calibration[i + 1].pulse);
-            break; // No need to continue checking so break out of the loop
-          }
-        }
+        // The value must between two calibration pairs, so look up which ones
+        uint8_t i = value_segment(value);
+        pulse_out = map_float(value, calibration[i].value, calibration[i + 1].value,
+                                     calibration[i].pulse, calibration[i + 1].pulse);
       }
 
       // Clamp the pulse between the hard limits
@@ -266,14 +279,10 @@ namespace servo {
                                            calibration[last - 1].value, calibration[last].value);
         }
         else {
-          // The pulse must between two calibration pairs, so iterate through them to find which ones
-          for(uint8_t i = 0; i < last; i++) {
-            if(pulse_out <= calibration[i + 1].pulse) {
-              value_out = map_float(pulse_out, calibration[i].pulse, calibration[i + 1].pulse,
-                                               calibration[i].value, calibration[i + 1].value);
-              break; // No need to continue checking so break out of the loop
-            }
-          }
+          // The pulse must between two calibration pairs, so look up which ones
+          uint8_t i = pulse_segment(pulse_out);
+          value_out = map_float(pulse_out, calibration[i].pulse, calibration[i + 1].pulse,
+                                           calibration[i].value, calibration[i + 1].value);
         }
       }
 
@@ -316,14 +325,10 @@ namespace servo {
         }
       }
       else {
-        // The pulse must between two calibration pairs, so iterate through them to find which ones
-        for(uint8_t i = 0; i < last; i++) {
-          if(pulse <= calibration[i + 1].pulse) {
-            value_out = map_float(pulse, calibration[i].pulse, calibration[i + 1].pulse,
-                                         calibration[i].value, calibration[i + 1].value);
-            break; // No need to continue checking so break out of the loop
-          }
-        }
+        // The pulse must between two calibration pairs, so look up which ones
+        uint8_t i = pulse_segment(pulse);
+        value_out = map_float(pulse, calibration[i].pulse, calibration[i + 1].pulse,
+                                     calibration[i].value, calibration[i + 1].value);
       }
 
       success = true;
@@ -332,7 +337,268 @@ namespace servo {
     return success;
   }
 
+  // The fixed point equivalent of value_to_pulse(). Returns false if there are fewer than two pairs, or if the
+  // pairs cannot be represented in Q16.16 (e.g. descending pulses), in which case the float version should be used
+  bool Calibration::value_to_pulse_q16(int32_t value, int32_t &pulse_out, int32_t &value_out) const {
+    if(!has_fixed_table())
+      return false;
+
+    uint8_t last = calibration_size - 1;
+    value_out = value;
+
+    // Is the value below the bottom most calibration pair?
+    if(value < fixed[0].value) {
+      // Should the value be limited to the calibration or projected below it?
+      if(limit_lower) {
+        pulse_out = fixed[0].pulse;
+        value_out = fixed[0].value;
+      }
+      else {
+        pulse_out = map_fixed(value, fixed[0].value, fixed[0].pulse, fixed[0].pulse_slope, fixed[0].pulse_shift);
+      }
+    }
+    // Is the value above the top most calibration pair?
+    else if(value > fixed[last].value) {
+      // Should the value be limited to the calibration or projected above it?
+      if(limit_upper) {
+        pulse_out = fixed[last].pulse;
+        value_out = fixed[last].value;
+      }
+      else {
+        const FixedPair &seg = fixed[last - 1];
+        pulse_out = map_fixed(value, seg.value, seg.pulse, seg.pulse_slope, seg.pulse_shift);
+      }
+    }
+    else {
+      // The value must between two calibration pairs, so look up which ones
+      uint8_t i = value_segment_q16(value);
+      pulse_out = map_fixed(value, fixed[i].value, fixed[i].pulse, fixed[i].pulse_slope, fixed[i].pulse_shift);
+    }
+
+    // Clamp the pulse between the hard limits
+    if(pulse_out < LOWER_HARD_LIMIT_Q16 || pulse_out > UPPER_HARD_LIMIT_Q16) {
+      pulse_out = MIN(MAX(pulse_out, LOWER_HARD_LIMIT_Q16), UPPER_HARD_LIMIT_Q16);
+
+      // Is the pulse below the bottom most calibration pair?
+      if(pulse_out < fixed[0].pulse) {
+        value_out = map_fixed(pulse_out, fixed[0].pulse, fixed[0].value, fixed[0].value_slope, fixed[0].value_shift);
+      }
+      // Is the pulse above the top most calibration pair?
+      else if(pulse_out > fixed[last].pulse) {
+        const FixedPair &seg = fixed[last - 1];
+        value_out = map_fixed(pulse_out, seg.pulse, seg.value, seg.value_slope, seg.value_shift);
+      }
+      else {
+        // The pulse must between two calibration pairs, so look up which ones
+        uint8_t i = pulse_segment_q16(pulse_out);
+        value_out = map_fixed(pulse_out, fixed[i].pulse, fixed[i].value, fixed[i].value_slope, fixed[i].value_shift);
+      }
+    }
+
+    return true;
+  }
+
+  // The fixed point equivalent of pulse_to_value(). Returns false under the same conditions as value_to_pulse_q16()
+  bool Calibration::pulse_to_value_q16(int32_t pulse, int32_t &value_out, int32_t &pulse_out) const {
+    if(!has_fixed_table())
+      return false;
+
+    uint8_t last = calibration_size - 1;
+
+    // Clamp the pulse between the hard limits
+    pulse_out = MIN(MAX(pulse, LOWER_HARD_LIMIT_Q16), UPPER_HARD_LIMIT_Q16);
+
+    // Is the pulse below the bottom most calibration pair?
+    if(pulse_out < fixed[0].pulse) {
+      // Should the pulse be limited to the calibration or projected below it?
+      if(limit_lower) {
+        value_out = fixed[0].value;
+        pulse_out = fixed[0].pulse;
+      }
+      else {
+        value_out = map_fixed(pulse, fixed[0].pulse, fixed[0].value, fixed[0].value_slope, fixed[0].value_shift);
+      }
+    }
+    // Is the pulse above the top most calibration pair?
+    else if(pulse > fixed[last].pulse) {
+      // Should the pulse be limited to the calibration or projected above it?
+      if(limit_upper) {
+        value_out = fixed[last].value;
+        pulse_out = fixed[last].pulse;
+      }
+      else {
+        const FixedPair &seg = fixed[last - 1];
+        value_out = map_fixed(pulse, seg.pulse, seg.value, seg.value_slope, seg.value_shift);
+      }
+    }
+    else {
+      // The pulse must between two calibration pairs, so look up which ones
+      uint8_t i = pulse_segment_q16(pulse);
+      value_out = map_fixed(pulse, fixed[i].pulse, fixed[i].value, fixed[i].value_slope, fixed[i].value_shift);
+    }
+
+    return true;
+  }
+
+  bool Calibration::has_fixed_table() const {
+    update_tables();
+    return fixed_valid;
+  }
+
+  void Calibration::update_tables() const {
+    if(tables_dirty) {
+      build_tables();
+    }
+  }
+
+  void Calibration::build_tables() const {
+    tables_dirty = false;
+    fixed_valid = false;
+    value_index = SegmentIndex();
+    pulse_index = SegmentIndex();
+
+    if(calibration_size < 2)
+      return;
+
+    build_index(&Pair::value, value_index);
+    build_index(&Pair::pulse, pulse_index);
+
+    for(uint i = 0; i < calibration_size; i++) {
+      const Pair &p = calibration[i];
+      if(fabsf(p.pulse) > MAX_FIXED_MAGNITUDE || fabsf(p.value) > MAX_FIXED_MAGNITUDE)
+        return;
+
+      fixed[i].pulse = (int32_t)roundf(p.pulse * (float)Q16_ONE);
+      fixed[i].value = (int32_t)roundf(p.value * (float)Q16_ONE);
+      fixed[i].pulse_slope = 0;
+      fixed[i].value_slope = 0;
+      fixed[i].pulse_shift = 0;
+      fixed[i].value_shift = 0;
+
+      // Both the values and pulses must be strictly ascending for the segment searches to work
+      if(i > 0 && (fixed[i].pulse <= fixed[i - 1].pulse || fixed[i].value <= fixed[i - 1].value))
+        return;
+    }
+
+    for(uint i = 0; i < calibration_size - 1; i++) {
+      const int32_t pulse_delta = fixed[i + 1].pulse - fixed[i].pulse;
+      const int32_t value_delta = fixed[i + 1].value - fixed[i].value;
+      fixed_slope(value_delta, pulse_delta, fixed[i].pulse_slope, fixed[i].pulse_shift);
+      fixed_slope(pulse_delta, value_delta, fixed[i].value_slope, fixed[i].value_shift);
+    }
+
+    const uint8_t last = calibration_size - 1;
+    value_index.step_q16 = (fixed[last].value - fixed[0].value) / last;
+    pulse_index.step_q16 = (fixed[last].pulse - fixed[0].pulse) / last;
+    fixed_valid = true;
+  }
+
+  void Calibration::build_index(float Pair::*field, SegmentIndex &index_out) const {
+    const uint8_t last = calibration_size - 1;
+    const float step = (calibration[last].*field - calibration[0].*field) / (float)last;
+
+    index_out.ascending = true;
+    index_out.uniform = true;
+    for(uint8_t i = 0; i < last; i++) {
+      const float delta = calibration[i + 1].*field - calibration[i].*field;
+      if(delta <= 0.0f) {
+        index_out.ascending = false;
+        index_out.uniform = false;
+        return;
+      }
+
+      // Evenly spaced pairs (such as from apply_uniform_pairs) can be indexed directly. The lookup corrects
+      // for any small error in the guess, so this only needs to be close enough to land on a neighbour
+      if(fabsf(delta - step) > step * UNIFORM_TOLERANCE)
+        index_out.uniform = false;
+    }
+    index_out.inv_step = 1.0f / step;
+  }
+
+  // Finds the segment i for which pairs[i] < in <= pairs[i + 1], for an input already known to be within the pairs.
+  // Ascending pairs are either indexed directly from a guess, or binary searched, so the cost does not grow with
+  // the number of pairs. Anything else falls back to checking each pair in turn
+  template<typename P, typename T>
+  static uint8_t find_segment(const P *pairs, T P::*field, uint8_t last, T in, bool ascending, int32_t guess) {
+    if(!ascending) {
+      for(uint8_t i = 0; i < last - 1; i++) {
+        if(in <= pairs[i + 1].*field) {
+          return i;
+        }
+      }
+      return last - 1;
+    }
+
+    if(guess >= 0) {
+      uint8_t i = (uint8_t)MIN(guess, (int32_t)last - 1);
+      while(i < last - 1 && in > pairs[i + 1].*field)
+        i++;
+      while(i > 0 && in <= pairs[i].*field)
+        i--;
+      return i;
+    }
+
+    uint8_t lo = 0;
+    uint8_t hi = last - 1;
+    while(lo < hi) {
+      uint8_t mid = (lo + hi) / 2;
+      if(in <= pairs[mid + 1].*field)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    return lo;
+  }
+
+  uint8_t Calibration::value_segment(float value) const {
+    update_tables();
+    int32_t guess = value_index.uniform ? (int32_t)((value - calibration[0].value) * value_index.inv_step) : -1;
+    return find_segment(calibration, &Pair::value, calibration_size - 1, value, value_index.ascending, guess);
+  }
+
+  uint8_t Calibration::pulse_segment(float pulse) const {
+    update_tables();
+    int32_t guess = pulse_index.uniform ? (int32_t)((pulse - calibration[0].pulse) * pulse_index.inv_step) : -1;
+    return find_segment(calibration, &Pair::pulse, calibration_size - 1, pulse, pulse_index.ascending, guess);
+  }
+
+  // Only called once has_fixed_table() has confirmed the fixed table is up to date and valid
+  uint8_t Calibration::value_segment_q16(int32_t value) const {
+    int32_t guess = value_index.uniform ? (value - fixed[0].value) / value_index.step_q16 : -1;
+    return find_segment(fixed, &FixedPair::value, calibration_size - 1, value, true, guess);
+  }
+
+  uint8_t Calibration::pulse_segment_q16(int32_t pulse) const {
+    int32_t guess = pulse_index.uniform ? (pulse - fixed[0].pulse) / pulse_index.step_q16 : -1;
+    return find_segment(fixed, &FixedPair::pulse, calibration_size - 1, pulse, true, guess);
+  }
+
+  void Calibration::fixed_slope(int32_t in_delta, int32_t out_delta, int32_t &slope_out, uint8_t &shift_out) {
+    // Pick the largest scaling that keeps the slope within 31 bits, so shallow slopes (such as
+    // value per microsecond) keep their precision rather than being rounded to a few Q16.16 steps
+    uint8_t shift = 30;
+    int64_t slope = ((int64_t)out_delta << shift) / in_delta;
+    while(shift > 0 && (slope > INT32_MAX || slope < -INT32_MAX)) {
+      shift--;
+      slope = ((int64_t)out_delta << shift) / in_delta;
+    }
+    slope_out = (int32_t)slope;
+    shift_out = shift;
+  }
+
+  int32_t Calibration::map_fixed(int32_t in, int32_t in_start, int32_t out_start, int32_t slope, uint8_t shift) {
+    // Projecting far beyond the calibration can exceed Q16.16, so saturate rather than wrap
+    int64_t out = (int64_t)out_start + (((int64_t)in - in_start) * slope >> shift);
+    return (int32_t)MIN(MAX(out, (int64_t)INT32_MIN), (int64_t)INT32_MAX);
+  }
+
   float Calibration::map_float(float in, float in_min, float in_max, float out_min, float out_max) {
     return (((in - in_min) * (out_max - out_min)) / (in_max - in_min)) + out_min;
   }
+
+  // Whole microseconds to a Q16.16 pulse. Anything past the upper hard limit is clamped to it first, as
+  // pulses of 32768us or more would otherwise shift into negative, disabling, Q16.16 values
+  int32_t Calibration::pulse_us_to_q16(uint pulse_us) {
+    return (int32_t)(MIN(pulse_us, (uint)(UPPER_HARD_LIMIT_Q16 >> Q16_SHIFT)) << Q16_SHIFT);
+  }
 };
\ No newline at end of file
@@ -19,9 +19,16 @@ namespace servo {
     static constexpr float DEFAULT_MID_PULSE = 1500.0f;  // in microseconds
     static constexpr float DEFAULT_MAX_PULSE = 2500.0f;  // in microseconds
 
+    static const uint Q16_SHIFT = 16;                   // Fixed point values are Q16.16
+    static const int32_t Q16_ONE = 1 << Q16_SHIFT;
+
   private:
     static constexpr float LOWER_HARD_LIMIT = 400.0f;   // The minimum microsecond pulse to send
     static constexpr float UPPER_HARD_LIMIT = 2600.0f;  // The maximum microsecond pulse to send
+    static const int32_t LOWER_HARD_LIMIT_Q16 = 400 << Q16_SHIFT;
+    static const int32_t UPPER_HARD_LIMIT_Q16 = 2600 << Q16_SHIFT;
+    static const int32_t MAX_FIXED_MAGNITUDE = 32767;   // The largest pulse or value the Q16.16 table can hold
+    static constexpr float UNIFORM_TOLERANCE = 0.01f;   // How far spacings can vary and still be treated as uniform
 
 
     //--------------------------------------------------
@@ -43,6 +50,35 @@ namespace servo {
         float value;
     };
 
+  private:
+    struct FixedPair {
+        //--------------------------------------------------
+        // Variables
+        //--------------------------------------------------
+        int32_t pulse;          // Q16.16
+        int32_t value;          // Q16.16
+        int32_t pulse_slope;    // Change in pulse per value, towards the next pair, scaled by 2^pulse_shift
+        int32_t value_slope;    // Change in value per pulse, towards the next pair, scaled by 2^value_shift
+        uint8_t pulse_shift;
+        uint8_t value_shift;
+    };
+
+    struct SegmentIndex {
+        //--------------------------------------------------
+        // Variables
+        //--------------------------------------------------
+        bool ascending;     // Each pair is greater than the last, so the segments can be searched
+        bool uniform;       // The pairs are evenly spaced, so the segment can be calculated directly
+        float inv_step;     // One over the spacing between pairs
+        int32_t step_q16;   // The spacing between pairs, in Q16.16
+
+
+        //--------------------------------------------------
+        // Constructors/Destructor
+        //--------------------------------------------------
+        SegmentIndex() : ascending(false), uniform(false), inv_step(0.0f), step_q16(0) {};
+    };
+
 
     //--------------------------------------------------
     // Constructors/Destructor
@@ -103,7 +139,22 @@ namespace servo {
     bool value_to_pulse(float value, float &pulse_out, float &value_out) const;
     bool pulse_to_value(float pulse, float &value_out, float &pulse_out) const;
 
+    bool value_to_pulse_q16(int32_t value, int32_t &pulse_out, int32_t &value_out) const;
+    bool pulse_to_value_q16(int32_t pulse, int32_t &value_out, int32_t &pulse_out) const;
+    bool has_fixed_table() const;
+
     static float map_float(float in, float in_min, float in_max, float out_min, float out_max);
+    static int32_t pulse_us_to_q16(uint pulse_us);
+  private:
+    void update_tables() const;
+    void build_tables() const;
+    void build_index(float Pair::*field, SegmentIndex &index_out) const;
+    uint8_t value_segment(float value) const;
+    uint8_t pulse_segment(float pulse) const;
+    uint8_t value_segment_q16(int32_t value) const;
+    uint8_t pulse_segment_q16(int32_t pulse) const;
+    static void fixed_slope(int32_t in_delta, int32_t out_delta, int32_t &slope_out, uint8_t &shift_out);
+    static int32_t map_fixed(int32_t in, int32_t in_start, int32_t out_start, int32_t slope, uint8_t shift);
 
 
     //--------------------------------------------------
@@ -114,6 +165,13 @@ namespace servo {
     uint calibration_size;
     bool limit_lower;
     bool limit_upper;
+
+    // A fixed point copy of the pairs and segment indexes, rebuilt on first use after any pair could have been modified
+    FixedPair* fixed;
+    mutable bool tables_dirty;
+    mutable bool fixed_valid;
+    mutable SegmentIndex value_index;
+    mutable SegmentIndex pulse_index;
   };
 
 }
\ No newline at end of file
@@ -1,49 +1,83 @@
 #include "servo_cluster.hpp"
 #include "pwm.hpp"
+#include "hardware/clocks.h"
 #include <cstdio>
 
 namespace servo {
-  ServoCluster::ServoCluster(PIO pio, uint sm, uint pin_mask, CalibrationType default_type, float freq, bool auto_phase)
-    : pwms(pio, sm, pin_mask), pwm_frequency(freq) {
+  static uint32_t pins_from_mask(uint pin_mask, uint8_t *pins_out) {
+    uint32_t length = 0;
+    for(uint pin = 0; pin < NUM_BANK0_GPIOS; pin++) {
+      if(pin_mask & (1u << pin))
+        pins_out[length++] = pin;
+    }
+    return length;
+  }
+
+  static uint32_t pins_from_range(uint pin_base, uint pin_count, uint8_t *pins_out) {
+    uint32_t length = 0;
+    uint pin_end = MIN(pin_count + pin_base, NUM_BANK0_GPIOS);
+    for(uint pin = pin_base; pin < pin_end; pin++) {
+      pins_out[length++] = pin;
+    }
+    return length;
+  }
+
+  ServoCluster::ServoCluster(PIO pio, uint sm, uint pin_mask, CalibrationType default_type, float freq, bool auto_phase, uint8_t max_shards)
+    : pwm_period(1), pwm_div256(256), pwm_frequency(freq), pwm_level_scale(0) {
+    uint8_t pins[NUM_BANK0_GPIOS];
+    create_shards(pio, sm, pins, pins_from_mask(pin_mask, pins), max_shards);
     create_servo_states(default_type, auto_phase);
   }
 
-  ServoCluster::ServoCluster(PIO pio, uint sm, uint pin_base, uint pin_count, CalibrationType default_type, float freq, bool auto_phase)
-    : pwms(pio, sm, pin_base, pin_count), pwm_frequency(freq) {
+  ServoCluster::ServoCluster(PIO pio, uint sm, uint pin_base, uint pin_count, CalibrationType default_type, float freq, bool auto_phase, uint8_t max_shards)
+    : pwm_period(1), pwm_div256(256), pwm_frequency(freq), pwm_level_scale(0) {
+    uint8_t pins[NUM_BANK0_GPIOS];
+    create_shards(pio, sm, pins, pins_from_range(pin_base, pin_count, pins), max_shards);
     create_servo_states(default_type, auto_phase);
   }
 
-  ServoCluster::ServoCluster(PIO pio, uint sm, const uint8_t *pins, uint32_t length, CalibrationType default_type, float freq, bool auto_phase)
-    : pwms(pio, sm, pins, length), pwm_frequency(freq) {
+  ServoCluster::ServoCluster(PIO pio, uint sm, const uint8_t *pins, uint32_t length, CalibrationType default_type, float freq, bool auto_phase, uint8_t max_shards)
+    : pwm_period(1), pwm_div256(256), pwm_frequency(freq), pwm_level_scale(0) {
+    create_shards(pio, sm, pins, length, max_shards);
     create_servo_states(default_type, auto_phase);
   }
 
-  ServoCluster::ServoCluster(PIO pio, uint sm, std::initializer_list<uint8_t> pins, CalibrationType default_type, float freq, bool auto_phase)
-    : pwms(pio, sm, pins), pwm_frequency(freq) {
+  ServoCluster::ServoCluster(PIO pio, uint sm, std::initializer_list<uint8_t> pins, CalibrationType default_type, float freq, bool auto_phase, uint8_t max_shards)
+    : pwm_period(1), pwm_div256(256), pwm_frequency(freq), pwm_level_scale(0) {
+    create_shards(pio, sm, pins.begin(), pins.size(), max_shards);
     create_servo_states(default_type, auto_phase);
   }
 
-  ServoCluster::ServoCluster(PIO pio, uint sm, uint pin_mask, const Calibration& calibration, float freq, bool auto_phase)
-    : pwms(pio, sm, pin_mask), pwm_frequency(freq) {
+  ServoCluster::ServoCluster(PIO pio, uint sm, uint pin_mask, const Calibration& calibration, float freq, bool auto_phase, uint8_t max_shards)
+    : pwm_period(1), pwm_div256(256), pwm_frequency(freq), pwm_level_scale(0) {
+    uint8_t pins[NUM_BANK0_GPIOS];
+    create_shards(pio, sm, pins, pins_from_mask(pin_mask, pins), max_shards);
     create_servo_states(calibration, auto_phase);
   }
 
-  ServoCluster::ServoCluster(PIO pio, uint sm, uint pin_base, uint pin_count, const Calibration& calibration, float freq, bool auto_phase)
-    : pwms(pio, sm, pin_base, pin_count), pwm_frequency(freq) {
+  ServoCluster::ServoCluster(PIO pio, uint sm, uint pin_base, uint pin_count, const Calibration& calibration, float freq, bool auto_phase, uint8_t max_shards)
+    : pwm_period(1), pwm_div256(256), pwm_frequency(freq), pwm_level_scale(0) {
+    uint8_t pins[NUM_BANK0_GPIOS];
+    create_shards(pio, sm, pins, pins_from_range(pin_base, pin_count, pins), max_shards);
     create_servo_states(calibration, auto_phase);
   }
 
-  ServoCluster::ServoCluster(PIO pio, uint sm, const uint8_t *pins, uint32_t length, const Calibration& calibration, float freq, bool auto_phase)
-    : pwms(pio, sm, pins, length), pwm_frequency(freq) {
+  ServoCluster::ServoCluster(PIO pio, uint sm, const uint8_t *pins, uint32_t length, const Calibration& calibration, float freq, bool auto_phase, uint8_t max_shards)
+    : pwm_period(1), pwm_div256(256), pwm_frequency(freq), pwm_level_scale(0) {
+    create_shards(pio, sm, pins, length, max_shards);
     create_servo_states(calibration, auto_phase);
   }
 
-  ServoCluster::ServoCluster(PIO pio, uint sm, std::initializer_list<uint8_t> pins, const Calibration& calibration, float freq, bool auto_phase)
-    : pwms(pio, sm, pins), pwm_frequency(freq) {
+  ServoCluster::ServoCluster(PIO pio, uint sm, std::initializer_list<uint8_t> pins, const Calibration& calibration, float freq, bool auto_phase, uint8_t max_shards)
+    : pwm_period(1), pwm_div256(256), pwm_frequency(freq), pwm_level_scale(0) {
+    create_shards(pio, sm, pins.begin(), pins.size(), max_shards);
     create_servo_states(calibration, auto_phase);
   }
 
   ServoCluster::~ServoCluster() {
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      delete shards[shard];
+    }
     delete[] states;
     delete[] servo_phases;
   }
@@ -51,29 +85,39 @@ namespace servo {
   bool ServoCluster::init() {
     bool success = false;
 
-    if(pwms.init()) {
+    // The shards are left stopped until they can be started together
+    bool shards_ready = (shard_count > 0);
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      shards_ready &= shards[shard]->init(false);
+    }
+
+    if(shards_ready) {
       // Calculate a suitable pwm wrap period for this frequency
       uint32_t period; uint32_t div256;
       if(pimoroni::PWMCluster::calculate_pwm_factors(pwm_frequency, period, div256)) {
         pwm_period = period;
+        pwm_div256 = div256;
+        pwm_level_scale = ServoState::level_scale_q24(pwm_period, pwm_frequency);
 
         // Update the pwm before setting the new wrap
-        uint8_t servo_count = pwms.get_chan_count();
         for(uint8_t servo = 0; servo < servo_count; servo++) {
-          pwms.set_chan_level(servo, 0, false);
-          pwms.set_chan_offset(servo, (uint32_t)(servo_phases[servo] * (float)pwm_period), false);
+          shards[servo_shard[servo]]->set_chan_level(servo_channel[servo], 0, false);
+          shards[servo_shard[servo]]->set_chan_offset(servo_channel[servo], (uint32_t)(servo_phases[servo] * (float)pwm_period), false);
         }
 
         // Set the new wrap (should be 1 less than the period to get full 0 to 100%)
-        pwms.set_wrap(pwm_period, true); // NOTE Minus 1 not needed here. Maybe should change Wrap behaviour so it is needed, for consistency with hardware pwm?
+        for(uint8_t shard = 0; shard < shard_count; shard++) {
+          shards[shard]->set_wrap(pwm_period, false); // NOTE Minus 1 not needed here. Maybe should change Wrap behaviour so it is needed, for consistency with hardware pwm?
+        }
+        load();
 
         // Apply the new divider
         // This is done after loading new PWM values to avoid a lockup condition
         uint8_t div = div256 >> 8;
         uint8_t mod = div256 % 256;
-        pwms.set_clkdiv_int_frac(div, mod);
+        PWMCluster::set_clkdiv_in_sync(shards, shard_count, div, mod);
 
-        success = true;
+        success = PWMCluster::enable_in_sync(shards, shard_count);
       }
     }
 
@@ -81,15 +125,15 @@ namespace servo {
   }
 
   uint8_t ServoCluster::count() const {
-    return pwms.get_chan_count();
+    return servo_count;
   }
 
   uint8_t ServoCluster::pin(uint8_t servo) const {
-    return pwms.get_chan_pin(servo);
+    return shards[servo_shard[servo]]->get_chan_pin(servo_channel[servo]);
   }
 
   void ServoCluster::enable(uint8_t servo, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].enable_with_return();
     apply_pulse(servo, new_pulse, load);
   }
@@ -100,7 +144,7 @@ namespace servo {
       enable(servos[i], false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::enable(std::initializer_list<uint8_t> servos, bool load) {
@@ -108,20 +152,19 @@ namespace servo {
       enable(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::enable_all(bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       enable(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::disable(uint8_t servo, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].disable_with_return();
     apply_pulse(servo, new_pulse, load);
   }
@@ -132,7 +175,7 @@ namespace servo {
       disable(servos[i], false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::disable(std::initializer_list<uint8_t> servos, bool load) {
@@ -140,41 +183,48 @@ namespace servo {
       disable(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::disable_all(bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       disable(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   bool ServoCluster::is_enabled(uint8_t servo) const {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return states[servo].is_enabled();
   }
 
   float ServoCluster::pulse(uint8_t servo) const {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return states[servo].get_pulse();
   }
 
   void ServoCluster::pulse(uint8_t servo, float pulse, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].set_pulse_with_return(pulse);
     apply_pulse(servo, new_pulse, load);
   }
 
+  void ServoCluster::pulse_q16(uint8_t servo, int32_t pulse, bool load) {
+    assert(servo < servo_count);
+    int32_t new_pulse = states[servo].set_pulse_q16_with_return(pulse);
+    shards[servo_shard[servo]]->set_chan_level(servo_channel[servo], ServoState::pulse_q16_to_level(new_pulse, pwm_level_scale), false);
+    if(load)
+      this->load();
+  }
+
   void ServoCluster::pulse(const uint8_t *servos, uint8_t length, float pulse, bool load) {
     assert(servos != nullptr);
     for(uint8_t i = 0; i < length; i++) {
       this->pulse(servos[i], pulse, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::pulse(std::initializer_list<uint8_t> servos, float pulse, bool load) {
@@ -182,36 +232,43 @@ namespace servo {
       this->pulse(servo, pulse, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::all_to_pulse(float pulse, bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       this->pulse(servo, pulse, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   float ServoCluster::value(uint8_t servo) const {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return states[servo].get_value();
   }
 
   void ServoCluster::value(uint8_t servo, float value, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].set_value_with_return(value);
     apply_pulse(servo, new_pulse, load);
   }
 
+  void ServoCluster::value_q16(uint8_t servo, int32_t value, bool load) {
+    assert(servo < servo_count);
+    int32_t new_pulse = states[servo].set_value_q16_with_return(value);
+    shards[servo_shard[servo]]->set_chan_level(servo_channel[servo], ServoState::pulse_q16_to_level(new_pulse, pwm_level_scale), false);
+    if(load)
+      this->load();
+  }
+
   void ServoCluster::value(const uint8_t *servos, uint8_t length, float value, bool load) {
     assert(servos != nullptr);
     for(uint8_t i = 0; i < length; i++) {
       this->value(servos[i], value, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::value(std::initializer_list<uint8_t> servos, float value, bool load) {
@@ -219,27 +276,28 @@ namespace servo {
       this->value(servo, value, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::all_to_value(float value, bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       this->value(servo, value, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   float ServoCluster::phase(uint8_t servo) const {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return servo_phases[servo];
   }
 
   void ServoCluster::phase(uint8_t servo, float phase, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     servo_phases[servo] = MIN(MAX(phase, 0.0f), 1.0f);
-    pwms.set_chan_offset(servo, (uint32_t)(servo_phases[servo] * (float)pwms.get_wrap()), load);
+    shards[servo_shard[servo]]->set_chan_offset(servo_channel[servo], (uint32_t)(servo_phases[servo] * (float)pwm_period), false);
+    if(load)
+      this->load();
   }
 
   void ServoCluster::phase(const uint8_t *servos, uint8_t length, float phase, bool load) {
@@ -248,7 +306,7 @@ namespace servo {
       this->phase(servos[i], phase, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::phase(std::initializer_list<uint8_t> servos, float phase, bool load) {
@@ -256,16 +314,15 @@ namespace servo {
       this->phase(servo, phase, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::all_to_phase(float phase, bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       this->phase(servo, phase, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   float ServoCluster::frequency() const {
@@ -281,24 +338,28 @@ namespace servo {
       if(pimoroni::PWMCluster::calculate_pwm_factors(freq, period, div256)) {
 
         pwm_period = period;
+        pwm_div256 = div256;
         pwm_frequency = freq;
+        pwm_level_scale = ServoState::level_scale_q24(pwm_period, pwm_frequency);
 
         // Update the pwm before setting the new wrap
-        uint8_t servo_count = pwms.get_chan_count();
         for(uint servo = 0; servo < servo_count; servo++) {
           if(states[servo].is_enabled()) {
             apply_pulse(servo, states[servo].get_pulse(), false);
           }
-          pwms.set_chan_offset(servo, (uint32_t)(servo_phases[servo] * (float)pwm_period), false);
+          shards[servo_shard[servo]]->set_chan_offset(servo_channel[servo], (uint32_t)(servo_phases[servo] * (float)pwm_period), false);
         }
 
         // Set the new wrap (should be 1 less than the period to get full 0 to 100%)
-        pwms.set_wrap(pwm_period, true);
+        for(uint8_t shard = 0; shard < shard_count; shard++) {
+          shards[shard]->set_wrap(pwm_period, false);
+        }
+        load();
 
         // Apply the new divider
         uint16_t div = div256 >> 8;
         uint8_t mod = div256 % 256;
-        pwms.set_clkdiv_int_frac(div, mod);
+        PWMCluster::set_clkdiv_in_sync(shards, shard_count, div, mod);
 
         success = true;
       }
@@ -307,22 +368,22 @@ namespace servo {
   }
 
   float ServoCluster::min_value(uint8_t servo) const {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return states[servo].get_min_value();
   }
 
   float ServoCluster::mid_value(uint8_t servo) const {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return states[servo].get_mid_value();
   }
 
   float ServoCluster::max_value(uint8_t servo) const {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return states[servo].get_max_value();
   }
 
   void ServoCluster::to_min(uint8_t servo, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].to_min_with_return();
     apply_pulse(servo, new_pulse, load);
   }
@@ -333,7 +394,7 @@ namespace servo {
       to_min(servos[i], false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_min(std::initializer_list<uint8_t> servos, bool load) {
@@ -341,20 +402,19 @@ namespace servo {
       to_min(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::all_to_min(bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       to_min(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_mid(uint8_t servo, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].to_mid_with_return();
     apply_pulse(servo, new_pulse, load);
   }
@@ -365,7 +425,7 @@ namespace servo {
       to_mid(servos[i], false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_mid(std::initializer_list<uint8_t> servos, bool load) {
@@ -373,20 +433,19 @@ namespace servo {
       to_mid(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::all_to_mid(bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       to_mid(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_max(uint8_t servo, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].to_max_with_return();
     apply_pulse(servo, new_pulse, load);
   }
@@ -397,7 +456,7 @@ namespace servo {
       to_max(servos[i], false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_max(std::initializer_list<uint8_t> servos, bool load) {
@@ -405,20 +464,19 @@ namespace servo {
       to_max(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::all_to_max(bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       to_max(servo, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_percent(uint8_t servo, float in, float in_min, float in_max, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].to_percent_with_return(in, in_min, in_max);
     apply_pulse(servo, new_pulse, load);
   }
@@ -429,7 +487,7 @@ namespace servo {
       to_percent(servos[i], in, in_min, in_max, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_percent(std::initializer_list<uint8_t> servos, float in, float in_min, float in_max, bool load) {
@@ -437,20 +495,19 @@ namespace servo {
       to_percent(servo, in, in_min, in_max, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::all_to_percent(float in, float in_min, float in_max, bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       to_percent(servo, in, in_min, in_max, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_percent(uint8_t servo, float in, float in_min, float in_max, float value_min, float value_max, bool load) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     float new_pulse = states[servo].to_percent_with_return(in, in_min, in_max, value_min, value_max);
     apply_pulse(servo, new_pulse, load);
   }
@@ -461,7 +518,7 @@ namespace servo {
       to_percent(servos[i], in, in_min, in_max, value_min, value_max, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::to_percent(std::initializer_list<uint8_t> servos, float in, float in_min, float in_max, float value_min, float value_max, bool load) {
@@ -469,38 +526,203 @@ namespace servo {
       to_percent(servo, in, in_min, in_max, value_min, value_max, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   void ServoCluster::all_to_percent(float in, float in_min, float in_max, float value_min, float value_max, bool load) {
-    uint8_t servo_count = pwms.get_chan_count();
     for(uint8_t servo = 0; servo < servo_count; servo++) {
       to_percent(servo, in, in_min, in_max, value_min, value_max, false);
     }
     if(load)
-      pwms.load_pwm();
+      this->load();
   }
 
   Calibration& ServoCluster::calibration(uint8_t servo) {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return states[servo].calibration();
   }
 
   const Calibration& ServoCluster::calibration(uint8_t servo) const {
-    assert(servo < pwms.get_chan_count());
+    assert(servo < servo_count);
     return states[servo].calibration();
   }
 
+  // Only the shards with changes get new sequences, and those are handed over together so they go live in the same period
   void ServoCluster::load() {
-    pwms.load_pwm();
+    PWMCluster* dirty[MAX_SHARDS];
+    uint dirty_count = 0;
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      if(shards[shard]->is_dirty()) {
+        commit_loads[shard] = shards[shard]->get_load_count() + 1;
+        dirty[dirty_count++] = shards[shard];
+      }
+    }
+
+    // Counted before the sequences are handed over, so the live callback cannot miss them
+    commit_count++;
+    PWMCluster::load_pwm_in_sync(dirty, dirty_count);
+  }
+
+  // The sequences written to every shard, so how much loading work has been done
+  uint32_t ServoCluster::load_count() const {
+    uint32_t loads = 0;
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      loads += shards[shard]->get_load_count();
+    }
+    return loads;
+  }
+
+  // Loads everything staged so far as one sequence, that goes live in full at the start of the next PWM period.
+  // Returns a number that can be passed to wait_for_commit() or is_committed()
+  uint32_t ServoCluster::commit() {
+    load();
+    return commit_count;
+  }
+
+  bool ServoCluster::wait_for_commit(uint32_t commit, uint32_t timeout_us) {
+    absolute_time_t timeout = make_timeout_time_us(timeout_us);
+    while(!is_committed(commit)) {
+      if(time_reached(timeout))
+        return false;
+      tight_loop_contents();
+    }
+    return true;
+  }
+
+  // Only the loads of the latest commit are kept, so an earlier commit is reported live once the
+  // latest one is. That can only make waiting for it take longer
+  bool ServoCluster::is_committed(uint32_t commit) const {
+    if((int32_t)(commit_count - commit) < 0)
+      return false;
+
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      if(!shards[shard]->is_load_live(commit_loads[shard]))
+        return false;
+    }
+    return true;
+  }
+
+  // The shards run in step, so any of them can count the frames
+  uint32_t ServoCluster::frame_count() const {
+    return shards[0]->get_frame_count();
+  }
+
+  // Loops the PWM with a second DMA channel, so only commits interrupt the CPU. Call before init()
+  bool ServoCluster::set_chained_dma(bool chained) {
+    bool success = true;
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      success &= shards[shard]->set_chained_dma(chained);
+    }
+    return success;
+  }
+
+  // Called from the DMA interrupt with the commit count once the latest commit is live on every shard.
+  // Commits that change nothing are live straight away, so are not reported
+  void ServoCluster::on_commit_live(PWMCluster::LiveCallback callback, void *context) {
+    live_callback = callback;
+    live_callback_context = context;
+    reported_commit = commit_count;
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      shards[shard]->set_live_callback((callback != nullptr) ? shard_load_live : nullptr, this);
+    }
+  }
+
+  // Compares the pulses each servo has requested with what the loaded PWM sequence will really
+  // output, accounting for level rounding and the achievable PIO clock divider.
+  bool ServoCluster::timing_report(TimingReport *reports_out, uint8_t length, float &period_out) const {
+    assert(reports_out != nullptr);
+    uint8_t report_count = MIN(length, servo_count);
+    if(report_count == 0)
+      return false;
+
+    // Each shard measures its own servos, which are consecutive. They share a period, so the first one's is used
+    PWMCluster::ChannelTiming timings[NUM_BANK0_GPIOS];
+    uint64_t period_cycles = 0;
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      uint64_t shard_cycles;
+      if(!shards[shard]->measure_loop_sequence(&timings[shard_first[shard]], shards[shard]->get_chan_count(), shard_cycles))
+        return false;
+      if(shard == 0)
+        period_cycles = shard_cycles;
+    }
+
+    // How long a single PIO cycle takes with the divider that was actually applied
+    const float us_per_cycle = ((float)pwm_div256 / 256.0f) * (1000000.0f / (float)clock_get_hz(clk_sys));
+
+    for(uint8_t servo = 0; servo < report_count; servo++) {
+      TimingReport &report = reports_out[servo];
+      report.requested_pulse = states[servo].is_enabled() ? states[servo].get_pulse() : 0.0f;
+      report.level = shards[servo_shard[servo]]->get_chan_level(servo_channel[servo]);
+      report.level_pulse = ((float)report.level * 1000000.0f) / ((float)pwm_period * pwm_frequency);
+      report.measured_pulse = (float)timings[servo].active_cycles * us_per_cycle;
+      report.rise_time = (float)timings[servo].rise_cycle * us_per_cycle;
+      report.error = report.measured_pulse - report.requested_pulse;
+    }
+
+    period_out = (float)period_cycles * us_per_cycle;
+    return true;
+  }
+
+  // Spreads the servos evenly over as many consecutive state machines as their number calls for,
+  // within max_shards, MAX_SHARDS and the state machines the PIO has left from the one given
+  void ServoCluster::create_shards(PIO pio, uint sm, const uint8_t *pins, uint32_t length, uint8_t max_shards) {
+    uint32_t wanted = MAX(1u, (length + SHARD_SERVOS - 1) / SHARD_SERVOS);
+    uint32_t available = (sm < NUM_PIO_STATE_MACHINES) ? NUM_PIO_STATE_MACHINES - sm : 1;
+    uint32_t allowed = MIN((uint32_t)MAX(max_shards, (uint8_t)1), (uint32_t)MAX_SHARDS);
+    shard_count = (uint8_t)MIN(wanted, MIN(available, allowed));
+
+    // Each shard's state machine outputs to every pin from its lowest to its highest, and the PIO's pins
+    // are shared, so shards whose pins interleave would drive each other's. Those stay as one cluster
+    uint32_t spans = 0;
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      uint32_t start = (length * shard) / shard_count;
+      uint32_t end = (length * (shard + 1)) / shard_count;
+      uint8_t lowest = UINT8_MAX, highest = 0;
+      for(uint32_t i = start; i < end; i++) {
+        lowest = MIN(lowest, pins[i]);
+        highest = MAX(highest, pins[i]);
+      }
+      uint32_t span = (end > start && highest < 32) ? (((2u << highest) - 1) & ~((1u << lowest) - 1)) : 0;
+      if(spans & span) {
+        shard_count = 1;
+        break;
+      }
+      spans |= span;
+    }
+
+    for(uint8_t shard = 0; shard < shard_count; shard++) {
+      uint32_t start = (length * shard) / shard_count;
+      uint32_t end = (length * (shard + 1)) / shard_count;
+      shards[shard] = new PWMCluster(pio, sm + shard, pins + start, end - start);
+      shard_first[shard] = servo_count;
+
+      // Pins the cluster rejected get no channel, so map from what it actually took
+      uint8_t channels = shards[shard]->get_chan_count();
+      for(uint8_t channel = 0; channel < channels; channel++) {
+        servo_shard[servo_count] = shard;
+        servo_channel[servo_count] = channel;
+        servo_count++;
+      }
+    }
   }
 
   void ServoCluster::apply_pulse(uint8_t servo, float pulse, bool load) {
-    pwms.set_chan_level(servo, ServoState::pulse_to_level(pulse, pwm_period, pwm_frequency), load);
+    shards[servo_shard[servo]]->set_chan_level(servo_channel[servo], ServoState::pulse_to_level(pulse, pwm_period, pwm_frequency), false);
+    if(load)
+      this->load();
+  }
+
+  void ServoCluster::shard_load_live(uint32_t load, void *context) {
+    ServoCluster *cluster = static_cast<ServoCluster*>(context);
+    uint32_t commit = cluster->commit_count;
+    if(commit != cluster->reported_commit && cluster->is_committed(commit)) {
+      cluster->reported_commit = commit;
+      if(cluster->live_callback != nullptr)
+        cluster->live_callback(commit, cluster->live_callback_context);
+    }
   }
 
   void ServoCluster::create_servo_states(CalibrationType default_type, bool auto_phase) {
-    uint8_t servo_count = pwms.get_chan_count();
     if(servo_count > 0) {
       states = new ServoState[servo_count];
       servo_phases = new float[servo_count];
@@ -513,7 +735,6 @@ namespace servo {
   }
 
   void ServoCluster::create_servo_states(const Calibration& calibration, bool auto_phase) {
-    uint8_t servo_count = pwms.get_chan_count();
     if(servo_count > 0) {
       states = new ServoState[servo_count];
       servo_phases = new float[servo_count];
@@ -8,14 +8,64 @@ using namespace pimoroni;
 
 namespace servo {
 
+  // By default a cluster drives all its servos from the one state machine it is given. Passing a max_shards
+  // above 1 opts in to spreading them over up to that many PWM clusters (never more than MAX_SHARDS), one
+  // for every SHARD_SERVOS servos, on consecutive state machines. It can then claim state machines sm to
+  // sm + max_shards - 1 of the PIO, so leave those free of other programs. Each sequence stays short and a
+  // change only reloads the cluster its servo is on. The clusters are started and clocked together, so
+  // every servo's period still begins at the same time. Each shard takes a run of the pins in the order
+  // given, and a cluster whose shards' pins would interleave is not sharded
   class ServoCluster {
+    //--------------------------------------------------
+    // Constants
+    //--------------------------------------------------
+  public:
+    static const uint8_t MAX_SHARDS = 4;      // The most state machines a cluster spreads its servos over
+    static const uint8_t SHARD_SERVOS = 6;    // How many servos a state machine takes before another is used
+
+
+    //--------------------------------------------------
+    // Substructures
+    //--------------------------------------------------
+  public:
+    struct TimingReport {
+      //--------------------------------------------------
+      // Variables
+      //--------------------------------------------------
+      float requested_pulse;  // The pulse the servo state asked for, in microseconds
+      uint32_t level;         // The PWM level that pulse was converted to
+      float level_pulse;      // The pulse that level represents at the requested frequency
+      float measured_pulse;   // The pulse the PIO program will actually output
+      float rise_time;        // When in the period the pulse starts, in microseconds
+      float error;            // measured_pulse - requested_pulse
+
+
+      //--------------------------------------------------
+      // Constructors/Destructor
+      //--------------------------------------------------
+      TimingReport() : requested_pulse(0.0f), level(0), level_pulse(0.0f), measured_pulse(0.0f), rise_time(0.0f), error(0.0f) {};
+    };
+
+
     //--------------------------------------------------
     // Variables
     //--------------------------------------------------
   private:
-    PWMCluster pwms;
+    PWMCluster* shards[MAX_SHARDS] = { nullptr };
+    uint8_t shard_count = 0;
+    uint8_t shard_first[MAX_SHARDS] = { 0 };          // The first servo on each shard
+    uint8_t servo_count = 0;
+    uint8_t servo_shard[NUM_BANK0_GPIOS];
+    uint8_t servo_channel[NUM_BANK0_GPIOS];           // The servo's channel within its shard
+    volatile uint32_t commit_count = 0;
+    uint32_t commit_loads[MAX_SHARDS] = { 0 };        // The load each shard needs live for the latest commit to be
+    uint32_t reported_commit = 0;
+    PWMCluster::LiveCallback live_callback = nullptr;
+    void *live_callback_context = nullptr;
     uint32_t pwm_period;
+    uint32_t pwm_div256;
     float pwm_frequency;
+    uint32_t pwm_level_scale;   // Levels per microsecond in Q8.24, for the fixed point pulse path
     ServoState* states;
     float* servo_phases;
 
@@ -24,15 +74,15 @@ namespace servo {
     // Constructors/Destructor
     //--------------------------------------------------
   public:
-    ServoCluster(PIO pio, uint sm, uint pin_mask, CalibrationType default_type = ANGULAR, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true);
-    ServoCluster(PIO pio, uint sm, uint pin_base, uint pin_count, CalibrationType default_type = ANGULAR, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true);
-    ServoCluster(PIO pio, uint sm, const uint8_t *pins, uint32_t length, CalibrationType default_type = ANGULAR, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true);
-    ServoCluster(PIO pio, uint sm, std::initializer_list<uint8_t> pins, CalibrationType default_type = ANGULAR, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true);
-
-    ServoCluster(PIO pio, uint sm, uint pin_mask, const Calibration& calibration, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true);
-    ServoCluster(PIO pio, uint sm, uint pin_base, uint pin_count, const Calibration& calibration, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true);
-    ServoCluster(PIO pio, uint sm, const uint8_t *pins, uint32_t length, const Calibration& calibration, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true);
-    ServoCluster(PIO pio, uint sm, std::initializer_list<uint8_t> pins, const Calibration& calibration, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true);
+    ServoCluster(PIO pio, uint sm, uint pin_mask, CalibrationType default_type = ANGULAR, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true, uint8_t max_shards = 1);
+    ServoCluster(PIO pio, uint sm, uint pin_base, uint pin_count, CalibrationType default_type = ANGULAR, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true, uint8_t max_shards = 1);
+    ServoCluster(PIO pio, uint sm, const uint8_t *pins, uint32_t length, CalibrationType default_type = ANGULAR, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true, uint8_t max_shards = 1);
+    ServoCluster(PIO pio, uint sm, std::initializer_list<uint8_t> pins, CalibrationType default_type = ANGULAR, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true, uint8_t max_shards = 1);
+
+    ServoCluster(PIO pio, uint sm, uint pin_mask, const Calibration& calibration, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true, uint8_t max_shards = 1);
+    ServoCluster(PIO pio, uint sm, uint pin_base, uint pin_count, const Calibration& calibration, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true, uint8_t max_shards = 1);
+    ServoCluster(PIO pio, uint sm, const uint8_t *pins, uint32_t length, const Calibration& calibration, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true, uint8_t max_shards = 1);
+    ServoCluster(PIO pio, uint sm, std::initializer_list<uint8_t> pins, const Calibration& calibration, float freq = ServoState::DEFAULT_FREQUENCY, bool auto_phase = true, uint8_t max_shards = 1);
     ~ServoCluster();
 
 
@@ -59,12 +109,14 @@ namespace servo {
 
     float pulse(uint8_t servo) const;
     void pulse(uint8_t servo, float pulse, bool load = true);
+    void pulse_q16(uint8_t servo, int32_t pulse, bool load = true);
     void pulse(const uint8_t *servos, uint8_t length, float pulse, bool load = true);
     void pulse(std::initializer_list<uint8_t> servos, float pulse, bool load = true);
     void all_to_pulse(float pulse, bool load = true);
 
     float value(uint8_t servo) const;
     void value(uint8_t servo, float value, bool load = true);
+    void value_q16(uint8_t servo, int32_t value, bool load = true);
     void value(const uint8_t *servos, uint8_t length, float value, bool load = true);
     void value(std::initializer_list<uint8_t> servos, float value, bool load = true);
     void all_to_value(float value, bool load = true);
@@ -112,12 +164,23 @@ namespace servo {
     const Calibration& calibration(uint8_t servo) const;
 
     void load();
+    uint32_t load_count() const;
+    uint32_t commit();
+    bool wait_for_commit(uint32_t commit, uint32_t timeout_us);
+    bool is_committed(uint32_t commit) const;
+    uint32_t frame_count() const;
+    bool set_chained_dma(bool chained);
+    void on_commit_live(PWMCluster::LiveCallback callback, void *context = nullptr);
+
+    bool timing_report(TimingReport *reports_out, uint8_t length, float &period_out) const;
 
     //--------------------------------------------------
   private:
+    void create_shards(PIO pio, uint sm, const uint8_t *pins, uint32_t length, uint8_t max_shards);
     void apply_pulse(uint8_t servo, float pulse, bool load);
     void create_servo_states(CalibrationType default_type, bool auto_phase);
     void create_servo_states(const Calibration& calibration, bool auto_phase);
+    static void shard_load_live(uint32_t load, void *context);
   };
 
 }
\ No newline at end of file
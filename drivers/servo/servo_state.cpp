@@ -66,6 +66,38 @@ namespace servo {
     return disable_with_return();
   }
 
+  int32_t ServoState::set_pulse_q16_with_return(int32_t pulse) {
+    if(pulse >= MIN_VALID_PULSE_Q16) {
+      int32_t value_out, pulse_out;
+      if(calib.pulse_to_value_q16(pulse, value_out, pulse_out)) {
+        servo_value = (float)value_out / (float)Calibration::Q16_ONE;
+        last_enabled_pulse = (float)pulse_out / (float)Calibration::Q16_ONE;
+        enabled = true;
+        return pulse_out;
+      }
+
+      // Fall back to the float version for calibrations the fixed point table cannot hold
+      float pulse_f = set_pulse_with_return((float)pulse / (float)Calibration::Q16_ONE);
+      return (int32_t)(pulse_f * (float)Calibration::Q16_ONE);
+    }
+    disable_with_return();
+    return 0; // A zero pulse
+  }
+
+  int32_t ServoState::set_value_q16_with_return(int32_t value) {
+    int32_t pulse_out, value_out;
+    if(calib.value_to_pulse_q16(value, pulse_out, value_out)) {
+      last_enabled_pulse = (float)pulse_out / (float)Calibration::Q16_ONE;
+      servo_value = (float)value_out / (float)Calibration::Q16_ONE;
+      enabled = true;
+      return pulse_out;
+    }
+
+    // Fall back to the float version for calibrations the fixed point table cannot hold
+    float pulse_f = set_value_with_return((float)value / (float)Calibration::Q16_ONE);
+    return (int32_t)(pulse_f * (float)Calibration::Q16_ONE);
+  }
+
   float ServoState::get_min_value() const {
     float value = 0.0f;
     if(calib.size() > 0) {
@@ -130,4 +162,18 @@ namespace servo {
     return level;
   }
 
+  // The number of levels per microsecond, in Q8.24. Calculated once whenever the resolution or frequency
+  // changes, so that pulse_q16_to_level() needs only a multiply and a shift
+  uint32_t ServoState::level_scale_q24(uint32_t resolution, float freq) {
+    return (uint32_t)((((float)resolution * freq) / 1000000) * (float)(1 << LEVEL_SCALE_SHIFT));
+  }
+
+  uint32_t ServoState::pulse_q16_to_level(int32_t pulse, uint32_t level_scale) {
+    uint32_t level = 0;
+    if(pulse >= MIN_VALID_PULSE_Q16) {
+      level = (uint32_t)(((uint64_t)pulse * level_scale) >> (Calibration::Q16_SHIFT + LEVEL_SCALE_SHIFT));
+    }
+    return level;
+  }
+
 };
\ No newline at end of file
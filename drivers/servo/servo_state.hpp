@@ -19,6 +19,8 @@ namespace servo {
 
   private:
     static constexpr float MIN_VALID_PULSE = 1.0f;
+    static const int32_t MIN_VALID_PULSE_Q16 = Calibration::Q16_ONE;
+    static const uint LEVEL_SCALE_SHIFT = 24;
 
 
     //--------------------------------------------------
@@ -56,6 +58,10 @@ namespace servo {
     float get_value() const;
     float set_value_with_return(float value);
 
+    // Q16.16 versions of the above, that stay in integer math unless the calibration has no fixed point table
+    int32_t set_pulse_q16_with_return(int32_t pulse);
+    int32_t set_value_q16_with_return(int32_t value);
+
     //--------------------------------------------------
     float get_min_value() const;
     float get_mid_value() const;
@@ -72,6 +78,8 @@ namespace servo {
 
     //--------------------------------------------------
     static uint32_t pulse_to_level(float pulse, uint32_t resolution, float freq);
+    static uint32_t level_scale_q24(uint32_t resolution, float freq);
+    static uint32_t pulse_q16_to_level(int32_t pulse, uint32_t level_scale);
   };
 
 }
\ No newline at end of file
@@ -0,0 +1,265 @@
+// Runs a master and slaves over loopback transports, checking how the master slices packets between
+// the boards, that each frame takes the right number of hops, and that slaves reject corrupted frames
+// and pick the stream back up after them
+
+#include "host_test.hpp"
+#include "chain.h"
+
+namespace {
+  // The master and three slaves, each link a loopback standing in for the UART between two boards
+  struct Chain {
+    chainLoopback loops[3];
+    chainTransport transports[3];
+    chainLink master;
+    chainLink slaves[3];
+
+    Chain() {
+      for(unsigned int loop = 0; loop < 3; loop++) {
+        chain_loopback_init(&loops[loop], &transports[loop]);
+      }
+      chain_init(&master, nullptr, &transports[0]);
+      chain_init(&slaves[0], &transports[0], &transports[1]);
+      chain_init(&slaves[1], &transports[1], &transports[2]);
+      chain_init(&slaves[2], &transports[2], nullptr);
+    }
+  };
+
+  cmdPkt make_packet(hexapodCmds cmd, unsigned int start, unsigned int count) {
+    cmdPkt pkt = {};
+    pkt.cmd = cmd;
+    pkt.startIdx = start;
+    pkt.count = count;
+    for(unsigned int idx = 0; idx < count; idx++) {
+      pkt.valueBuff[idx] = 1000 + (start + idx) * 7;
+    }
+    return pkt;
+  }
+
+  unsigned int pending(const chainLoopback &loop) {
+    return loop.head - loop.tail;
+  }
+
+  // The byte a frame still waiting in the loopback has at the given offset from its sync
+  uint8_t peek(const chainLoopback &loop, unsigned int offset) {
+    return loop.data[(loop.tail + offset) & (CHAIN_LOOPBACK_SIZE - 1)];
+  }
+
+  // Reads everything the slave has waiting, returning how many packets were for it
+  unsigned int receive_all(chainLink &slave, cmdPkt *pkts_out, unsigned int max) {
+    unsigned int count = 0;
+    cmdPkt pkt;
+    while(chain_receive(&slave, &pkt)) {
+      if(count < max)
+        pkts_out[count] = pkt;
+      count++;
+    }
+    return count;
+  }
+
+  void check_slice(const cmdPkt &sent, const cmdPkt &received, unsigned int first, unsigned int count) {
+    CHECK_EQUAL(sent.cmd, received.cmd);
+    CHECK_EQUAL((sent.startIdx + first) % CHAIN_NODE_PINS, received.startIdx);
+    CHECK_EQUAL(count, received.count);
+    CHECK_EQUAL(CHICA_PROTOCOL_V2, received.protocol);
+    for(unsigned int idx = 0; idx < count; idx++) {
+      CHECK_EQUAL(sent.valueBuff[first + idx], received.valueBuff[idx]);
+    }
+  }
+
+  // A SET spanning three boards leaves the master its own slice, and each slave gets its slice with
+  // indexes local to it, the frame for the second slave taking two hops and being relayed by the first
+  void test_slices_and_hops() {
+    Chain chain;
+    const cmdPkt sent = make_packet(set, 20, 60);  // 20 to 31 on the master, 32 to 63 and 64 to 79 on the slaves
+    cmdPkt pkt = sent;
+
+    CHECK_EQUAL(2, chain_forward(&chain.master, &pkt));
+    CHECK_EQUAL(12, pkt.count);
+    CHECK_EQUAL(20, pkt.startIdx);
+    CHECK_EQUAL(2, chain.master.stats.forwarded);
+
+    // The first slave's frame is one hop away and the second's two
+    CHECK_EQUAL(CHAIN_SYNC, peek(chain.loops[0], 0));
+    CHECK_EQUAL((1 << 4) | CHAIN_TYPE_SET, peek(chain.loops[0], 1));
+    unsigned int first_frame = 5 + peek(chain.loops[0], 2);
+    CHECK_EQUAL((2 << 4) | CHAIN_TYPE_SET, peek(chain.loops[0], first_frame + 1));
+
+    cmdPkt received[4];
+    CHECK_EQUAL(1, receive_all(chain.slaves[0], received, 4));
+    check_slice(sent, received[0], 12, 32);
+    CHECK_EQUAL(1, chain.slaves[0].stats.received);
+    CHECK_EQUAL(1, chain.slaves[0].stats.relayed);
+
+    // Relayed with a hop taken off, so the second slave sees it as its own
+    CHECK_EQUAL((1 << 4) | CHAIN_TYPE_SET, peek(chain.loops[1], 1));
+    CHECK_EQUAL(1, receive_all(chain.slaves[1], received, 4));
+    check_slice(sent, received[0], 44, 16);
+    CHECK_EQUAL(0, chain.slaves[1].stats.relayed);
+
+    CHECK_EQUAL(0, pending(chain.loops[2]));
+    CHECK_EQUAL(0, receive_all(chain.slaves[2], received, 4));
+  }
+
+  // Three hops to the last slave, relayed by both in front of it, with a KEY's easing and duration intact
+  void test_key_to_last_slave() {
+    Chain chain;
+    cmdPkt sent = make_packet(key, 96, 18);
+    sent.easing = 3;
+    sent.durationMs = 40000;
+    cmdPkt pkt = sent;
+
+    CHECK_EQUAL(1, chain_forward(&chain.master, &pkt));
+    CHECK_EQUAL(0, pkt.count);  // Nothing left for the master, but it still runs to close its batch
+    CHECK_EQUAL((3 << 4) | CHAIN_TYPE_KEY, peek(chain.loops[0], 1));
+
+    cmdPkt received[4];
+    CHECK_EQUAL(0, receive_all(chain.slaves[0], received, 4));
+    CHECK_EQUAL((2 << 4) | CHAIN_TYPE_KEY, peek(chain.loops[1], 1));
+    CHECK_EQUAL(0, receive_all(chain.slaves[1], received, 4));
+    CHECK_EQUAL((1 << 4) | CHAIN_TYPE_KEY, peek(chain.loops[2], 1));
+    CHECK_EQUAL(1, receive_all(chain.slaves[2], received, 4));
+
+    check_slice(sent, received[0], 0, 18);
+    CHECK_EQUAL(3, received[0].easing);
+    CHECK_EQUAL(40000, received[0].durationMs);
+    CHECK_EQUAL(1, chain.slaves[0].stats.relayed);
+    CHECK_EQUAL(1, chain.slaves[1].stats.relayed);
+  }
+
+  // Only SET and KEY are sliced. Indexes past the last node are dropped, and a frame for a board past
+  // the end of the chain is dropped by the last slave
+  void test_unforwarded() {
+    Chain chain;
+    cmdPkt pkt = make_packet(get, 40, 4);
+    CHECK_EQUAL(0, chain_forward(&chain.master, &pkt));
+    CHECK_EQUAL(4, pkt.count);
+    CHECK_EQUAL(0, pending(chain.loops[0]));
+
+    pkt = make_packet(set, (CHAIN_MAX_NODES * CHAIN_NODE_PINS) - 4, 8);
+    CHECK_EQUAL(1, chain_forward(&chain.master, &pkt));
+    CHECK_EQUAL(1, chain.master.stats.dropped);
+    CHECK_EQUAL(0, pkt.count);
+
+    cmdPkt received[4];
+    receive_all(chain.slaves[0], received, 4);
+    receive_all(chain.slaves[1], received, 4);
+    CHECK_EQUAL(0, receive_all(chain.slaves[2], received, 4));
+    CHECK_EQUAL(1, chain.slaves[2].stats.dropped);
+  }
+
+  // A link without room for a whole frame takes none of it
+  void test_back_pressure() {
+    Chain chain;
+    unsigned int frames = 0;
+    for(unsigned int attempt = 0; attempt < 8; attempt++) {
+      cmdPkt pkt = make_packet(set, 32, 32);
+      frames += chain_forward(&chain.master, &pkt);
+    }
+    CHECK(frames > 0 && frames < 8);
+    CHECK_EQUAL(frames, chain.master.stats.forwarded);
+    CHECK_EQUAL(8 - frames, chain.master.stats.dropped);
+
+    cmdPkt received[8];
+    CHECK_EQUAL(frames, receive_all(chain.slaves[0], received, 8));
+    CHECK_EQUAL(0, chain.slaves[0].stats.crcErrors);
+  }
+
+  // Corrupts one byte of the frame waiting at the front of the loopback
+  void corrupt(chainLoopback &loop, unsigned int offset, uint8_t value) {
+    loop.data[(loop.tail + offset) & (CHAIN_LOOPBACK_SIZE - 1)] = value;
+  }
+
+  void write_bytes(chainTransport &transport, const uint8_t *bytes, unsigned int size) {
+    CHECK(transport.write(transport.context, bytes, size));
+  }
+
+  // A frame with a bad byte in its payload or CRC is counted and thrown away, a length too long for any
+  // frame is given up on at once, and in each case the next frame is received
+  void test_crc_and_resync() {
+    const cmdPkt sent = make_packet(set, 32, 6);
+    struct Corruption {
+      unsigned int offset;
+      uint8_t value;
+      bool crc_error;
+    };
+    const Corruption corruptions[] = {
+      { 1, (1 << 4) | CHAIN_TYPE_KEY, true },  // Header
+      { 3, 0x55, true },                        // Payload
+      { 3 + 2 + 12, 0x00, true },               // CRC low byte, after the 14 byte payload
+      { 3 + 2 + 12 + 1, 0x00, true },           // CRC high byte
+      { 2, 0xFF, false }                        // Length, past CHAIN_MAX_PAYLOAD
+    };
+
+    for(const Corruption &corruption : corruptions) {
+      Chain chain;
+      cmdPkt pkt = sent;
+      chain_forward(&chain.master, &pkt);
+      if(peek(chain.loops[0], corruption.offset) == corruption.value)
+        continue;
+      corrupt(chain.loops[0], corruption.offset, corruption.value);
+      pkt = sent;
+      chain_forward(&chain.master, &pkt);
+
+      cmdPkt received[4];
+      CHECK_EQUAL(1, receive_all(chain.slaves[0], received, 4));
+      check_slice(sent, received[0], 0, 6);
+      CHECK_EQUAL(corruption.crc_error ? 1 : 0, chain.slaves[0].stats.crcErrors);
+      CHECK_EQUAL(1, chain.slaves[0].stats.received);
+    }
+  }
+
+  // Noise on the line before a frame, such as a slave powering up part way through one, is skipped
+  void test_garbage_before_sync() {
+    Chain chain;
+    const uint8_t noise[] = { 0x00, 0x13, 0xFF, 0x7E, 0x20, 0x01, 0x02 };
+    write_bytes(chain.transports[0], noise, sizeof(noise));
+
+    const cmdPkt sent = make_packet(set, 40, 10);
+    cmdPkt pkt = sent;
+    chain_forward(&chain.master, &pkt);
+
+    cmdPkt received[4];
+    CHECK_EQUAL(1, receive_all(chain.slaves[0], received, 4));
+    check_slice(sent, received[0], 0, 10);
+    CHECK_EQUAL(0, chain.slaves[0].stats.crcErrors);
+  }
+
+  // A frame arriving a byte at a time decodes the same as one read whole
+  void test_split_reads() {
+    Chain chain;
+    const cmdPkt sent = make_packet(key, 33, 20);
+    cmdPkt pkt = sent;
+    chain_forward(&chain.master, &pkt);
+
+    // Move the frame over a byte at a time, as a slow UART would deliver it
+    chainLoopback trickle;
+    chainTransport trickle_transport;
+    chain_loopback_init(&trickle, &trickle_transport);
+    chainLink slave;
+    chain_init(&slave, &trickle_transport, nullptr);
+
+    cmdPkt received;
+    unsigned int decoded = 0;
+    uint8_t byte;
+    while(chain.transports[0].read(chain.transports[0].context, &byte)) {
+      write_bytes(trickle_transport, &byte, 1);
+      if(chain_receive(&slave, &received)) {
+        decoded++;
+        CHECK_EQUAL(0, pending(chain.loops[0]));  // Only once the last byte is in
+      }
+    }
+    CHECK_EQUAL(1, decoded);
+    check_slice(sent, received, 0, 20);
+  }
+}
+
+int main() {
+  test_slices_and_hops();
+  test_key_to_last_slave();
+  test_unforwarded();
+  test_back_pressure();
+  test_crc_and_resync();
+  test_garbage_before_sync();
+  test_split_reads();
+  return host_test_result("chain_test");
+}
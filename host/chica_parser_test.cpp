@@ -0,0 +1,209 @@
+// Replays byte streams in the legacy framing through the resumable parser, split into reads every way
+// it could arrive over USB, and checks each split emits exactly the packets the whole stream does
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "host_test.hpp"
+#include "chica_parser.h"
+
+namespace {
+  typedef std::vector<uint8_t> Bytes;
+
+  // Packets as the Chica server sends them, 14-bit values split into two 7-bit bytes, low first
+  void append_values(Bytes &stream, const std::vector<unsigned int> &values) {
+    for(unsigned int value : values) {
+      stream.push_back(value & 0x7F);
+      stream.push_back((value >> 7) & 0x7F);
+    }
+  }
+
+  void append_set(Bytes &stream, uint8_t start, const std::vector<unsigned int> &values) {
+    stream.push_back(SET_CMD);
+    stream.push_back(start);
+    stream.push_back((uint8_t)values.size());
+    append_values(stream, values);
+  }
+
+  void append_get(Bytes &stream, uint8_t start, uint8_t count) {
+    stream.push_back(GET_CMD);
+    stream.push_back(start);
+    stream.push_back(count);
+  }
+
+  void append_key(Bytes &stream, uint8_t start, uint8_t easing, unsigned int duration_ms, const std::vector<unsigned int> &values) {
+    stream.push_back(KEY_CMD);
+    stream.push_back(start);
+    stream.push_back((uint8_t)values.size());
+    stream.push_back(easing);
+    stream.push_back(duration_ms & 0x7F);
+    stream.push_back((duration_ms >> 7) & 0x7F);
+    append_values(stream, values);
+  }
+
+  void append_proto(Bytes &stream, uint8_t version) {
+    stream.push_back(PROTO_CMD);
+    stream.push_back(version);
+  }
+
+  std::vector<unsigned int> pulses(unsigned int count, unsigned int first, unsigned int step) {
+    std::vector<unsigned int> values;
+    for(unsigned int i = 0; i < count; i++) {
+      values.push_back(first + (i * step));
+    }
+    return values;
+  }
+
+  // A stretch of a session: the handshake, a stand up over keyframes, then a stream of poses and reads
+  Bytes recorded_session() {
+    Bytes stream;
+    append_proto(stream, CHICA_PROTOCOL_LEGACY);
+    append_get(stream, 0, 18);
+    append_key(stream, 0, 2, 750, pulses(18, 1500, 0));
+    append_key(stream, 0, 1, 16383, pulses(18, 1200, 25));
+    append_key(stream, 18, 0, 0, {});
+    for(unsigned int frame = 0; frame < 20; frame++) {
+      append_set(stream, 0, pulses(18, 1000 + (frame * 40), frame + 1));
+      if(frame % 4 == 0)
+        append_get(stream, 0, 21);
+    }
+    append_set(stream, 18, pulses(3, 500, 1000));
+    append_set(stream, 5, {});
+    append_set(stream, 0, pulses(MAX_COUNT_VALUE, 0, 129));
+    append_set(stream, 20, { 0, 0x3FFF });
+    return stream;
+  }
+
+  // Garbage the way a reset link shows it: data with nothing in front of it, a command byte the parser
+  // does not know, and a packet cut off by the next command
+  Bytes garbage() {
+    Bytes stream = { 0x00, 0x12, 0x7F, 0x45, 0x01 };
+    stream.push_back(0xFF);
+    stream.push_back(0x03);
+    stream.push_back(SET_CMD);
+    stream.push_back(0);
+    stream.push_back(18);
+    stream.push_back(0x2C);
+    return stream;
+  }
+
+  // Feeds each read to the parser in turn, as vcp_task() does, keeping the packet between reads
+  std::vector<cmdPkt> parse(chicaParser &parser, const Bytes &stream, const std::vector<size_t> &read_sizes) {
+    std::vector<cmdPkt> packets;
+    cmdPkt pkt;
+    size_t position = 0;
+    for(size_t read = 0; position < stream.size(); read++) {
+      size_t size = (read < read_sizes.size()) ? read_sizes[read] : stream.size() - position;
+      size_t end = std::min(stream.size(), position + size);
+      for(; position < end; position++) {
+        if(chica_parser_feed(&parser, stream[position], &pkt))
+          packets.push_back(pkt);
+      }
+    }
+    return packets;
+  }
+
+  std::vector<cmdPkt> parse(const Bytes &stream, const std::vector<size_t> &read_sizes) {
+    chicaParser parser;
+    chica_parser_reset(&parser);
+    return parse(parser, stream, read_sizes);
+  }
+
+  // Only the fields the packet's command carries are compared, the rest are left over from earlier packets
+  void check_packets(const std::vector<cmdPkt> &expected, const std::vector<cmdPkt> &actual) {
+    CHECK_EQUAL(expected.size(), actual.size());
+    for(size_t p = 0; p < std::min(expected.size(), actual.size()); p++) {
+      const cmdPkt &e = expected[p];
+      const cmdPkt &a = actual[p];
+      CHECK_EQUAL(e.cmd, a.cmd);
+      CHECK_EQUAL(e.startIdx, a.startIdx);
+      CHECK_EQUAL(e.count, a.count);
+      CHECK_EQUAL(e.protocol, a.protocol);
+      CHECK_EQUAL(e.batchMore, a.batchMore);
+      if(e.cmd == key) {
+        CHECK_EQUAL(e.easing, a.easing);
+        CHECK_EQUAL(e.durationMs, a.durationMs);
+      }
+      unsigned int values = (e.cmd == get) ? 0 : e.count;
+      for(unsigned int v = 0; v < values; v++) {
+        CHECK_EQUAL(e.valueBuff[v], a.valueBuff[v]);
+      }
+    }
+  }
+
+  // The one-shot parse decodes what was encoded
+  void test_one_shot(const std::vector<cmdPkt> &packets) {
+    CHECK_EQUAL(1 + 1 + 3 + 20 + 5 + 4, packets.size());
+    if(packets.size() < 6)
+      return;
+
+    CHECK_EQUAL(proto, packets[0].cmd);
+    CHECK_EQUAL(CHICA_PROTOCOL_LEGACY, packets[0].valueBuff[0]);
+    CHECK_EQUAL(get, packets[1].cmd);
+    CHECK_EQUAL(18, packets[1].count);
+    CHECK_EQUAL(key, packets[3].cmd);
+    CHECK_EQUAL(1, packets[3].easing);
+    CHECK_EQUAL(16383, packets[3].durationMs);
+    CHECK_EQUAL(1200 + (17 * 25), packets[3].valueBuff[17]);
+    CHECK_EQUAL(0, packets[4].count);
+    CHECK_EQUAL(set, packets[5].cmd);
+    CHECK_EQUAL(1000, packets[5].valueBuff[0]);
+
+    const cmdPkt &last = packets.back();
+    CHECK_EQUAL(20, last.startIdx);
+    CHECK_EQUAL(0x3FFF, last.valueBuff[1]);
+  }
+
+  // Reads of every size from a byte at a time up to a whole USB packet
+  void test_fixed_reads(const Bytes &stream, const std::vector<cmdPkt> &expected) {
+    for(size_t size = 1; size <= 64; size++) {
+      check_packets(expected, parse(stream, std::vector<size_t>(stream.size(), size)));
+    }
+  }
+
+  // Two reads, split at every byte, so the break lands in every field of every packet
+  void test_every_split(const Bytes &stream, const std::vector<cmdPkt> &expected) {
+    for(size_t split = 0; split <= stream.size(); split++) {
+      check_packets(expected, parse(stream, { split }));
+    }
+  }
+
+  void test_random_reads(const Bytes &stream, const std::vector<cmdPkt> &expected) {
+    std::srand(2040);
+    for(unsigned int run = 0; run < 200; run++) {
+      std::vector<size_t> read_sizes;
+      for(size_t total = 0; total < stream.size();) {
+        size_t size = (std::rand() % 4 == 0) ? 0 : 1 + (std::rand() % 70);  // Empty reads happen too
+        read_sizes.push_back(size);
+        total += size;
+      }
+      check_packets(expected, parse(stream, read_sizes));
+    }
+  }
+
+  // Whatever comes before the first command byte, the parser picks the stream up from there
+  void test_garbage_before_sync(const Bytes &stream, const std::vector<cmdPkt> &expected) {
+    Bytes noisy = garbage();
+    noisy.insert(noisy.end(), stream.begin(), stream.end());
+
+    for(size_t size = 1; size <= 64; size++) {
+      chicaParser parser;
+      chica_parser_reset(&parser);
+      check_packets(expected, parse(parser, noisy, std::vector<size_t>(noisy.size(), size)));
+      CHECK_EQUAL(1, parser.badCmdCount);
+      CHECK_EQUAL(1, parser.resyncCount);
+    }
+  }
+}
+
+int main() {
+  Bytes stream = recorded_session();
+  std::vector<cmdPkt> expected = parse(stream, {});
+
+  test_one_shot(expected);
+  test_fixed_reads(stream, expected);
+  test_every_split(stream, expected);
+  test_random_reads(stream, expected);
+  test_garbage_before_sync(stream, expected);
+  return host_test_result("chica_parser_test");
+}
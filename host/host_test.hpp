@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdio>
+
+// Checks for the host tests. A failed check is reported with where it was and the test carries on,
+// so one run shows every failure. main() returns host_test_result(), which is non-zero after any
+namespace host_test {
+  inline int failures = 0;
+  inline int checks = 0;
+}
+
+#define CHECK(condition) \
+  do { \
+    host_test::checks++; \
+    if(!(condition)) { \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      host_test::failures++; \
+    } \
+  } while(0)
+
+#define CHECK_EQUAL(expected, actual) \
+  do { \
+    host_test::checks++; \
+    long long expected_value = (long long)(expected); \
+    long long actual_value = (long long)(actual); \
+    if(expected_value != actual_value) { \
+      std::printf("%s:%d: CHECK_EQUAL(%s, %s) failed, expected %lld but was %lld\n", \
+                  __FILE__, __LINE__, #expected, #actual, expected_value, actual_value); \
+      host_test::failures++; \
+    } \
+  } while(0)
+
+inline int host_test_result(const char *name) {
+  std::printf("%s: %d checks, %d failed\n", name, host_test::checks, host_test::failures);
+  return (host_test::failures == 0) ? 0 : 1;
+}
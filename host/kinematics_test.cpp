@@ -0,0 +1,245 @@
+// Checks the fixed point inverse kinematics against a double precision solution of the same geometry,
+// over feet placed by sweeping each leg's joints through its reachable workspace at random body poses.
+// Also checks the Q2.30 sine and cosine over the whole Q16.16 angle range, the ends and ±180 included
+
+#include <cmath>
+#include <cstdlib>
+#include <initializer_list>
+#include "host_test.hpp"
+#include "kinematics.h"
+
+namespace {
+  // Joint angles within this of the double solution, and the foot they put down within this of its target,
+  // a tenth of the 0.012mm the solver was first written to
+  const double ANGLE_TOLERANCE_DEG = 0.002;
+  const double FOOT_TOLERANCE_MM = 0.0012;
+  const double SIN_TOLERANCE = 5e-7;
+
+  const double Q16_ONE = 65536.0;
+  const double Q30_ONE = 1073741824.0;
+
+  double radians(double degrees) {
+    return degrees * M_PI / 180.0;
+  }
+
+  double degrees(double radians) {
+    return radians * 180.0 / M_PI;
+  }
+
+  int32_t q16(double value) {
+    return (int32_t)std::lround(value * Q16_ONE);
+  }
+
+  double from_q16(int64_t value) {
+    return (double)value / Q16_ONE;
+  }
+
+  double random_between(double low, double high) {
+    return low + ((high - low) * ((double)std::rand() / (double)RAND_MAX));
+  }
+
+  // The difference between two angles, taken the short way round
+  double angle_error(double a, double b) {
+    return std::fabs(std::remainder(a - b, 360.0));
+  }
+
+  struct Vec {
+    double x, y, z;
+  };
+
+  struct Pose {
+    Vec translation;
+    double roll, pitch, yaw;
+  };
+
+  // R = Rz(yaw) Ry(pitch) Rx(roll), as kinematics.h has it
+  void rotation(const Pose &pose, double r[3][3]) {
+    double sr = std::sin(radians(pose.roll)), cr = std::cos(radians(pose.roll));
+    double sp = std::sin(radians(pose.pitch)), cp = std::cos(radians(pose.pitch));
+    double sy = std::sin(radians(pose.yaw)), cy = std::cos(radians(pose.yaw));
+    double m[3][3] = {
+      { cy * cp, (cy * sp * sr) - (sy * cr), (cy * sp * cr) + (sy * sr) },
+      { sy * cp, (sy * sp * sr) + (cy * cr), (sy * sp * cr) - (cy * sr) },
+      { -sp, cp * sr, cp * cr }
+    };
+    for(int row = 0; row < 3; row++) {
+      for(int col = 0; col < 3; col++) {
+        r[row][col] = m[row][col];
+      }
+    }
+  }
+
+  struct Leg {
+    Vec mount;
+    double mount_yaw, coxa, femur, tibia;
+  };
+
+  Leg leg_geometry(const ikLegConfig &config) {
+    return { { from_q16(config.mount.x), from_q16(config.mount.y), from_q16(config.mount.z) },
+             from_q16(config.mountYaw), from_q16(config.length[IK_COXA]),
+             from_q16(config.length[IK_FEMUR]), from_q16(config.length[IK_TIBIA]) };
+  }
+
+  // Where the joint angles put the foot, in the ground frame with the body at pose
+  Vec forward(const Leg &leg, const Pose &pose, const double angle[IK_JOINTS]) {
+    double coxa = radians(angle[IK_COXA]);
+    double femur = radians(angle[IK_FEMUR]);
+    double tibia = radians(angle[IK_TIBIA]);
+
+    double outward = leg.coxa + (leg.femur * std::cos(femur)) + (leg.tibia * std::sin(femur + tibia));
+    double up = (leg.femur * std::sin(femur)) - (leg.tibia * std::cos(femur + tibia));
+    double heading = coxa + radians(leg.mount_yaw);
+    Vec body = { leg.mount.x + (outward * std::cos(heading)), leg.mount.y + (outward * std::sin(heading)), leg.mount.z + up };
+
+    double r[3][3];
+    rotation(pose, r);
+    return { (r[0][0] * body.x) + (r[0][1] * body.y) + (r[0][2] * body.z) + pose.translation.x,
+             (r[1][0] * body.x) + (r[1][1] * body.y) + (r[1][2] * body.z) + pose.translation.y,
+             (r[2][0] * body.x) + (r[2][1] * body.y) + (r[2][2] * body.z) + pose.translation.z };
+  }
+
+  // The double precision solution, knee up like the fixed point one
+  bool inverse(const Leg &leg, const Pose &pose, const Vec &foot, double angle_out[IK_JOINTS]) {
+    double r[3][3];
+    rotation(pose, r);
+    double d[3] = { foot.x - pose.translation.x, foot.y - pose.translation.y, foot.z - pose.translation.z };
+    double body[3];
+    for(int row = 0; row < 3; row++) {
+      body[row] = (r[0][row] * d[0]) + (r[1][row] * d[1]) + (r[2][row] * d[2]);
+    }
+
+    double x = body[0] - leg.mount.x, y = body[1] - leg.mount.y, z = body[2] - leg.mount.z;
+    double yaw = radians(leg.mount_yaw);
+    double px = (x * std::cos(yaw)) + (y * std::sin(yaw));
+    double py = (y * std::cos(yaw)) - (x * std::sin(yaw));
+
+    double outward = std::hypot(px, py) - leg.coxa;
+    double reach = std::hypot(outward, z);
+    double femur_to_foot = ((leg.femur * leg.femur) + (reach * reach) - (leg.tibia * leg.tibia)) / (2 * leg.femur * reach);
+    double knee = ((leg.femur * leg.femur) + (leg.tibia * leg.tibia) - (reach * reach)) / (2 * leg.femur * leg.tibia);
+    if(reach == 0 || std::fabs(femur_to_foot) > 1 || std::fabs(knee) > 1)
+      return false;
+
+    angle_out[IK_COXA] = degrees(std::atan2(py, px));
+    angle_out[IK_FEMUR] = degrees(std::atan2(z, outward) + std::acos(femur_to_foot));
+    angle_out[IK_TIBIA] = degrees(std::acos(knee)) - 90.0;
+    return true;
+  }
+
+  ikPose to_ik(const Pose &pose) {
+    return { { q16(pose.translation.x), q16(pose.translation.y), q16(pose.translation.z) },
+             q16(pose.roll), q16(pose.pitch), q16(pose.yaw) };
+  }
+
+  double worst_angle = 0.0;
+  double worst_foot = 0.0;
+
+  // Solves a foot both ways and checks the fixed point angles, and where they put the foot
+  void check_solution(ikModel &model, unsigned int leg, const Pose &pose, const Vec &foot) {
+    Leg geometry = leg_geometry(model.leg[leg]);
+    double expected[IK_JOINTS];
+    bool reachable = inverse(geometry, pose, foot, expected);
+    CHECK(reachable);
+
+    ikPose ik_pose = to_ik(pose);
+    ikVec ik_foot = { q16(foot.x), q16(foot.y), q16(foot.z) };
+    int32_t values[IK_JOINTS];
+    bool solved_leg = ik_solve_leg(&model, leg, &ik_pose, &ik_foot, values);
+    CHECK(solved_leg);
+    if(!reachable || !solved_leg)
+      return;
+
+    double solved[IK_JOINTS];
+    for(unsigned int joint = 0; joint < IK_JOINTS; joint++) {
+      solved[joint] = from_q16(values[joint]);
+      double error = angle_error(expected[joint], solved[joint]);
+      worst_angle = std::fmax(worst_angle, error);
+      CHECK(error <= ANGLE_TOLERANCE_DEG);
+    }
+
+    Vec landed = forward(geometry, pose, solved);
+    double miss = std::sqrt(((landed.x - foot.x) * (landed.x - foot.x)) + ((landed.y - foot.y) * (landed.y - foot.y)) +
+                            ((landed.z - foot.z) * (landed.z - foot.z)));
+    worst_foot = std::fmax(worst_foot, miss);
+    CHECK(miss <= FOOT_TOLERANCE_MM);
+  }
+
+  // Feet placed by stepping every leg's joints through their range, with the knee kept clear of
+  // straight and fully folded where the angles stop depending smoothly on the foot. Feet that would
+  // sit over or behind the coxa axis are left out, as the solver turns the coxa round to reach those
+  void test_workspace_sweep() {
+    ikModel model;
+    ik_init_default(&model);
+    std::srand(2040);
+
+    for(unsigned int leg = 0; leg < IK_LEGS; leg++) {
+      Leg geometry = leg_geometry(model.leg[leg]);
+      for(double coxa = -75.0; coxa <= 75.0; coxa += 7.5) {
+        for(double femur = -80.0; femur <= 80.0; femur += 8.0) {
+          for(double tibia = -70.0; tibia <= 70.0; tibia += 7.0) {
+            Pose pose = { { random_between(-30.0, 30.0), random_between(-30.0, 30.0), random_between(-20.0, 60.0) },
+                          random_between(-15.0, 15.0), random_between(-15.0, 15.0), random_between(-180.0, 180.0) };
+            double angle[IK_JOINTS] = { coxa, femur, tibia };
+            double outward = geometry.coxa + (geometry.femur * std::cos(radians(femur))) +
+                             (geometry.tibia * std::sin(radians(femur + tibia)));
+            if(outward < 10.0)
+              continue;
+            check_solution(model, leg, pose, forward(geometry, pose, angle));
+          }
+        }
+      }
+    }
+  }
+
+  // Yaws either side of ±180 degrees, and coxa angles that put the foot behind the leg, where the
+  // angles wrap round
+  void test_near_half_turn() {
+    ikModel model;
+    ik_init_default(&model);
+
+    const double offsets[] = { -0.01, -0.0001, 0.0, 0.0001, 0.01 };
+    for(unsigned int leg = 0; leg < IK_LEGS; leg++) {
+      Leg geometry = leg_geometry(model.leg[leg]);
+      for(double offset : offsets) {
+        for(double half_turn : { -180.0, 180.0 }) {
+          Pose pose = { { 5.0, -5.0, 40.0 }, 3.0, -2.0, half_turn + offset };
+          double angle[IK_JOINTS] = { 30.0, 10.0, -20.0 };
+          check_solution(model, leg, pose, forward(geometry, pose, angle));
+
+          Pose level = { { 0.0, 0.0, 0.0 }, 0.0, 0.0, 0.0 };
+          double behind[IK_JOINTS] = { half_turn - offset, 20.0, 10.0 };
+          check_solution(model, leg, level, forward(geometry, level, behind));
+        }
+      }
+    }
+  }
+
+  void check_sin_cos(int32_t angle) {
+    double a = radians(from_q16(angle));
+    CHECK(std::fabs((ik_sin_q30(angle) / Q30_ONE) - std::sin(a)) <= SIN_TOLERANCE);
+    CHECK(std::fabs((ik_cos_q30(angle) / Q30_ONE) - std::cos(a)) <= SIN_TOLERANCE);
+  }
+
+  // The whole Q16.16 range, which reaches some 32768 degrees either way, including its very ends
+  void test_sin_cos() {
+    for(int64_t angle = INT32_MIN; angle <= INT32_MAX; angle += 65521) {
+      check_sin_cos((int32_t)angle);
+    }
+    const int32_t ends[] = { INT32_MIN, INT32_MIN + 1, INT32_MAX - q16(90), INT32_MAX - q16(90) + 1, INT32_MAX - 1, INT32_MAX };
+    for(int32_t angle : ends) {
+      check_sin_cos(angle);
+    }
+    for(int32_t step = -64; step <= 64; step++) {
+      check_sin_cos(q16(180.0) + step);
+      check_sin_cos(q16(-180.0) + step);
+    }
+  }
+}
+
+int main() {
+  test_sin_cos();
+  test_workspace_sweep();
+  test_near_half_turn();
+  std::printf("Worst joint angle error %.6f degrees, worst foot placement %.6f mm\n", worst_angle, worst_foot);
+  return host_test_result("kinematics_test");
+}
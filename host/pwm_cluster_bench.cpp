@@ -0,0 +1,100 @@
+// Times PWMCluster::load_pwm() for an 18 channel cluster at the servo period, with from 1 to 18 channels
+// changed since the last load, against the full rebuild it does after a wrap change. load_pwm() patches
+// the changed channels in up to a quarter of them, and rebuilds past that. The cycles are the host's, so
+// only the ratios carry over to the RP2040. Not a test, run it by hand:
+//   ./pwm_cluster_bench
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "host_sdk.h"
+#include "pwm_cluster.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace pimoroni;
+
+namespace {
+  const uint CHANNELS = 18;
+  const uint UPDATES = 4000;
+
+  // The TSC where there is one, otherwise nanoseconds
+  uint64_t timestamp() {
+  #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+  #else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  #endif
+  }
+
+  // Loads UPDATES times, each with the given number of channels moved to a new level, and returns
+  // the median cost of a load. A full rebuild is forced by setting the wrap again before each load
+  uint64_t time_loads(PWMCluster &cluster, uint32_t period, uint changed, bool full_rebuild) {
+    std::vector<uint64_t> samples;
+    samples.reserve(UPDATES);
+
+    uint first = 0;
+    for(uint update = 0; update < UPDATES; update++) {
+      // Walk the levels through the servo range, about 0.5ms to 2.5ms of the 20ms period
+      uint32_t level = (period / 40) + ((update * 37) % (period / 10));
+      for(uint c = 0; c < changed; c++) {
+        cluster.set_chan_level((first + c) % CHANNELS, level, false);
+      }
+      first = (first + changed) % CHANNELS;
+      if(full_rebuild)
+        cluster.set_wrap(period, false);
+
+      uint64_t start = timestamp();
+      cluster.load_pwm();
+      samples.push_back(timestamp() - start);
+
+      // Let the DMA pick the load up, as it would between updates on the board
+      host_pio_run_sequence(pio0, 0);
+      host_pio_model(pio0, 0)->clear_edges();
+      host_pio_clear_edges(pio0);
+    }
+
+    std::nth_element(samples.begin(), samples.begin() + (samples.size() / 2), samples.end());
+    return samples[samples.size() / 2];
+  }
+}
+
+int main() {
+  uint32_t period, div256;
+  if(!PWMCluster::calculate_pwm_factors(50.0f, period, div256))
+    return 1;
+
+  PWMCluster cluster(pio0, 0, 0u, CHANNELS);
+  if(!cluster.init())
+    return 1;
+  cluster.set_wrap(period, false);
+
+  // Spread over the period the way ServoCluster phases its servos
+  for(uint c = 0; c < CHANNELS; c++) {
+    cluster.set_chan_level(c, period / 13, false);
+    cluster.set_chan_offset(c, (c * period) / CHANNELS, false);
+  }
+  cluster.load_pwm();
+
+#if defined(__x86_64__) || defined(__i386__)
+  const char *unit = "TSC cycles";
+#else
+  const char *unit = "ns";
+#endif
+#ifdef PWM_CLUSTER_COMPACT
+  std::printf("pwm_cluster_compact_bench: %u channels, wrap %u, median %s per load_pwm()\n", CHANNELS, (uint)period, unit);
+#else
+  std::printf("pwm_cluster_bench: %u channels, wrap %u, median %s per load_pwm()\n", CHANNELS, (uint)period, unit);
+#endif
+  std::printf("changed   load_pwm()  full rebuild\n");
+  const uint changes[] = { 1, 2, 4, 5, 6, 12, 18 };
+  for(uint changed : changes) {
+    uint64_t loaded = time_loads(cluster, period, changed, false);
+    uint64_t full = time_loads(cluster, period, changed, true);
+    std::printf("%7u  %11llu  %12llu\n", changed, (unsigned long long)loaded, (unsigned long long)full);
+  }
+  return 0;
+}
@@ -0,0 +1,363 @@
+// Runs PWMCluster and ServoCluster on the stub SDK, whose state machines play whatever the DMA feeds
+// them through PWMClusterModel onto their PIO's shared pins, and checks the reconstructed pin waveforms
+// against the levels set. Built once with each PWMCluster encoding
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "host_sdk.h"
+#include "host_test.hpp"
+#include "pwm_cluster.hpp"
+#include "servo_cluster.hpp"
+
+using namespace pimoroni;
+using namespace servo;
+
+namespace {
+  const uint64_t CYCLES_PER_LEVEL = PWM_CLUSTER_CYCLES;
+
+  // The edges a PIO's pins make, across every period run through its state machines
+  class Trace {
+  public:
+    Trace(PIO pio) : pio(pio), pins(NUM_BANK0_GPIOS) {
+      host_pio_clear_edges(pio);
+      initial_states = host_pio_pin_states(pio);
+    }
+
+    // Plays the sequence the state machine's DMA is on, and returns the cycle its period started on.
+    // Its edges only show on the pins once every running state machine of the PIO has been played as far
+    uint64_t run_period(uint sm) {
+      PWMClusterModel *model = host_pio_model(pio, sm);
+      CHECK(model != nullptr);
+      if(model == nullptr)
+        return 0;
+      uint64_t start = model->get_cycles();
+      CHECK(host_pio_run_sequence(pio, sm));
+      CHECK_EQUAL(0, model->get_edges_dropped());
+      model->clear_edges();
+      for(const PWMClusterModel::Edge &edge : host_pio_edges(pio)) {
+        pins[edge.pin].push_back(edge);
+      }
+      host_pio_clear_edges(pio);
+      return start;
+    }
+
+    // The pin's state once every edge up to and including the cycle has happened
+    bool state(uint8_t pin, uint64_t cycle) const {
+      const std::vector<PWMClusterModel::Edge> &edges = pins[pin];
+      auto after = std::upper_bound(edges.begin(), edges.end(), cycle,
+                                    [](uint64_t c, const PWMClusterModel::Edge &edge) { return c < edge.cycle; });
+      if(after == edges.begin())
+        return ((initial_states >> pin) & 0b1) != 0;
+      return (after - 1)->state;
+    }
+
+    // The first edge of the pin to the given state at or after the cycle, or UINT64_MAX if none
+    uint64_t next_edge(uint8_t pin, bool to_state, uint64_t cycle) const {
+      for(const PWMClusterModel::Edge &edge : pins[pin]) {
+        if(edge.cycle >= cycle && edge.state == to_state)
+          return edge.cycle;
+      }
+      return UINT64_MAX;
+    }
+
+    // Whether the pin has changed at all
+    bool any_edges(uint8_t pin) const {
+      return !pins[pin].empty();
+    }
+
+  private:
+    PIO pio;
+    uint32_t initial_states;
+    std::vector<std::vector<PWMClusterModel::Edge>> pins;
+  };
+
+  struct Channel {
+    uint32_t level;
+    uint32_t offset;
+    bool polarity;
+  };
+
+  // Whether a channel's pin is high at a level of a period, once its settings have been output for a full one
+  bool steady_state(const Channel &channel, uint32_t wrap, uint32_t level) {
+    bool active = (channel.level >= wrap) || (((level + wrap - channel.offset) % wrap) < channel.level);
+    return active != channel.polarity;
+  }
+
+  uint32_t random_below(uint32_t limit) {
+    return (uint32_t)(std::rand() % limit);
+  }
+
+  // Loads random levels, offsets and polarities into a cluster, checking the period each load goes live
+  // in and the one after. Channels whose pulses run past the wrap exercise the overrun handling
+  void test_random_loads(bool chained) {
+    const uint CHANNELS = 6;
+    const uint PIN_BASE = 2;
+    const uint32_t WRAP = 400;
+
+    PWMCluster cluster(pio0, 1, PIN_BASE, CHANNELS);
+    CHECK(cluster.set_chained_dma(chained));
+    CHECK(cluster.init());
+    cluster.set_wrap(WRAP, false);
+
+    Channel channels[CHANNELS];
+    for(uint8_t c = 0; c < CHANNELS; c++) {
+      channels[c] = { WRAP / 4, c * (WRAP / CHANNELS), c == 3 };
+      cluster.set_chan_level(c, channels[c].level, false);
+      cluster.set_chan_offset(c, channels[c].offset, false);
+      cluster.set_chan_polarity(c, channels[c].polarity, false);
+    }
+    cluster.load_pwm();
+
+    Trace trace(pio0);
+    trace.run_period(1);
+    trace.run_period(1);
+
+    std::srand(2040);
+    for(uint iteration = 0; iteration < 200; iteration++) {
+      // Change anything from one channel to all of them, with the odd load overwritten before it goes live
+      bool polarity_changed[CHANNELS] = { false };
+      uint loads = (random_below(8) == 0) ? 2 : 1;
+      for(uint load = 0; load < loads; load++) {
+        uint changes = 1 + random_below(CHANNELS);
+        for(uint change = 0; change < changes; change++) {
+          // Mostly levels, with offsets and polarities changed on their own as well as alongside them
+          uint8_t c = random_below(CHANNELS);
+          if(random_below(8) != 0) {
+            channels[c].level = (random_below(10) == 0) ? ((random_below(2) == 0) ? 0 : WRAP) : random_below(WRAP);
+            cluster.set_chan_level(c, channels[c].level, false);
+          }
+          if(random_below(4) == 0) {
+            channels[c].offset = random_below(WRAP);
+            cluster.set_chan_offset(c, channels[c].offset, false);
+          }
+          if(random_below(16) == 0) {
+            channels[c].polarity = !channels[c].polarity;
+            polarity_changed[c] = true;
+            cluster.set_chan_polarity(c, channels[c].polarity, false);
+          }
+        }
+        cluster.load_pwm();
+      }
+      uint32_t load = cluster.get_load_count();
+
+      // The period already under way finishes first, then the new sequence goes live
+      trace.run_period(1);
+      CHECK(cluster.is_load_live(load));
+      uint64_t live = trace.run_period(1);
+      uint64_t looping = trace.run_period(1);
+
+      for(uint8_t c = 0; c < CHANNELS; c++) {
+        uint8_t pin = PIN_BASE + c;
+
+        // Where a pulse from before the load ran on, the live period only follows the new settings from the offset
+        if(!polarity_changed[c]) {
+          for(uint32_t level = channels[c].offset; level < WRAP; level++) {
+            uint64_t cycle = live + (level * CYCLES_PER_LEVEL) + PWMClusterModel::OUT_CYCLE;
+            CHECK_EQUAL(steady_state(channels[c], WRAP, level), trace.state(pin, cycle));
+          }
+        }
+        for(uint32_t level = 0; level < WRAP; level++) {
+          uint64_t cycle = looping + (level * CYCLES_PER_LEVEL) + PWMClusterModel::OUT_CYCLE;
+          CHECK_EQUAL(steady_state(channels[c], WRAP, level), trace.state(pin, cycle));
+        }
+      }
+    }
+  }
+
+  // Two clusters on neighbouring pins of the same PIO, as ServoCluster shards are, with their pulses
+  // overlapping. Each state machine's transitions must leave the other's pins, and a pin another program
+  // drives just past them, as they are
+  void test_neighbouring_clusters() {
+    const uint CHANNELS = 6;
+    const uint32_t WRAP = 400;
+    const uint8_t OTHER_PIN = 2 * CHANNELS;
+
+    // Held high by a program on another state machine
+    pio_sm_set_pins_with_mask(pio0, 3, 1u << OTHER_PIN, 1u << OTHER_PIN);
+    pio_sm_set_pindirs_with_mask(pio0, 3, 1u << OTHER_PIN, 1u << OTHER_PIN);
+
+    PWMCluster first(pio0, 0, 0u, CHANNELS);
+    PWMCluster second(pio0, 1, CHANNELS, CHANNELS);
+    PWMCluster *clusters[2] = { &first, &second };
+
+    Channel channels[2 * CHANNELS];
+    for(uint k = 0; k < 2; k++) {
+      CHECK(clusters[k]->init());
+      clusters[k]->set_wrap(WRAP, false);
+      for(uint8_t c = 0; c < CHANNELS; c++) {
+        Channel &channel = channels[(k * CHANNELS) + c];
+        channel = { (WRAP / 3) + (c * 20), ((k * CHANNELS) + c) * (WRAP / (3 * CHANNELS)), k == 1 && c == 2 };
+        clusters[k]->set_chan_level(c, channel.level, false);
+        clusters[k]->set_chan_offset(c, channel.offset, false);
+        clusters[k]->set_chan_polarity(c, channel.polarity, false);
+      }
+      clusters[k]->load_pwm();
+    }
+
+    Trace trace(pio0);
+    uint64_t looping = 0;
+    for(uint run = 0; run < 4; run++) {
+      looping = trace.run_period(0);
+      CHECK_EQUAL(looping, trace.run_period(1));
+    }
+    // The last period only reaches the pins once both have been run past it
+    trace.run_period(0);
+    trace.run_period(1);
+
+    for(uint8_t pin = 0; pin < 2 * CHANNELS; pin++) {
+      for(uint32_t level = 0; level < WRAP; level++) {
+        uint64_t cycle = looping + (level * CYCLES_PER_LEVEL) + PWMClusterModel::OUT_CYCLE;
+        CHECK_EQUAL(steady_state(channels[pin], WRAP, level), trace.state(pin, cycle));
+      }
+    }
+    CHECK(trace.state(OTHER_PIN, looping));
+    CHECK(!trace.any_edges(OTHER_PIN));
+
+    pio_sm_set_pindirs_with_mask(pio0, 3, 0, 1u << OTHER_PIN);
+    pio_sm_set_pins_with_mask(pio0, 3, 0, 1u << OTHER_PIN);
+  }
+
+  // Every servo's pulse, measured from its pin, matches the level its pulse converts to and starts
+  // at its phase. Each state machine the cluster uses is run in step, as the PIO would. Without
+  // opting in to shards the cluster keeps to the one state machine it was given
+  void test_servo_cluster_pulses(uint8_t max_shards) {
+    const uint SERVOS = 18;
+    ServoCluster servos(pio0, 0, 0u, SERVOS, ANGULAR, ServoState::DEFAULT_FREQUENCY, true, max_shards);
+    CHECK(servos.init());
+    CHECK_EQUAL(SERVOS, servos.count());
+
+    uint32_t period, div256;
+    CHECK(PWMCluster::calculate_pwm_factors(ServoState::DEFAULT_FREQUENCY, period, div256));
+
+    Trace trace(pio0);
+    std::vector<uint> sms;
+    for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+      if(host_pio_model(pio0, sm) != nullptr)
+        sms.push_back(sm);
+    }
+    CHECK_EQUAL(max_shards, sms.size());
+
+    for(uint8_t servo = 0; servo < SERVOS; servo++) {
+      servos.pulse(servo, 1000.0f + (servo * 50.0f), false);
+    }
+    uint32_t commit = servos.commit();
+
+    uint64_t starts[4] = { 0 };
+    for(uint run = 0; run < 4; run++) {
+      for(size_t s = 0; s < sms.size(); s++) {
+        uint64_t start = trace.run_period(sms[s]);
+        if(s == 0)
+          starts[run] = start;
+        else
+          CHECK_EQUAL(starts[run], start);  // Every state machine's period starts on the same cycle
+      }
+    }
+    CHECK(servos.is_committed(commit));
+
+    const float us_per_cycle = ((float)div256 / 256.0f) / 125.0f;
+    for(uint8_t servo = 0; servo < SERVOS; servo++) {
+      uint8_t pin = servos.pin(servo);
+      float pulse = servos.pulse(servo);
+      uint32_t level = ServoState::pulse_to_level(pulse, period, ServoState::DEFAULT_FREQUENCY);
+      uint32_t offset = (uint32_t)(((float)servo / (float)SERVOS) * (float)period);
+
+      uint64_t rise = trace.next_edge(pin, true, starts[2]);
+      uint64_t fall = trace.next_edge(pin, false, rise);
+      CHECK_EQUAL(starts[2] + (offset * CYCLES_PER_LEVEL) + PWMClusterModel::OUT_CYCLE, rise);
+      CHECK_EQUAL(level * CYCLES_PER_LEVEL, fall - rise);
+
+      // Within a level of what was asked for
+      float measured = (float)(fall - rise) * us_per_cycle;
+      float level_us = 1000000.0f / (ServoState::DEFAULT_FREQUENCY * (float)period);
+      CHECK(measured > pulse - level_us && measured < pulse + level_us);
+    }
+  }
+
+  // The firmware's auxiliary servos, on pio1 state machine 1 and GPIO 19 to 21, with the WS2812 on state
+  // machine 0 driving the LED bar's data pin just below them. The servos pulse as set, and the data pin
+  // is never touched
+  void test_aux_servos_beside_led() {
+    const uint LED_DATA = 18;
+    const uint AUX_PIN = 19;
+    const uint AUX_SERVOS = 3;
+
+    pio_sm_set_pins_with_mask(pio1, 0, 1u << LED_DATA, 1u << LED_DATA);
+    pio_sm_set_pindirs_with_mask(pio1, 0, 1u << LED_DATA, 1u << LED_DATA);
+
+    ServoCluster servos(pio1, 1, AUX_PIN, AUX_SERVOS);
+    CHECK(servos.init());
+    for(uint8_t servo = 0; servo < AUX_SERVOS; servo++) {
+      servos.pulse(servo, 1200.0f + (servo * 400.0f), false);
+    }
+    servos.commit();
+
+    uint32_t period, div256;
+    CHECK(PWMCluster::calculate_pwm_factors(ServoState::DEFAULT_FREQUENCY, period, div256));
+
+    Trace trace(pio1);
+    uint64_t starts[4] = { 0 };
+    for(uint run = 0; run < 4; run++) {
+      starts[run] = trace.run_period(1);
+    }
+
+    for(uint8_t servo = 0; servo < AUX_SERVOS; servo++) {
+      uint32_t level = ServoState::pulse_to_level(servos.pulse(servo), period, ServoState::DEFAULT_FREQUENCY);
+      uint64_t rise = trace.next_edge(AUX_PIN + servo, true, starts[2]);
+      uint64_t fall = trace.next_edge(AUX_PIN + servo, false, rise);
+      CHECK(rise != UINT64_MAX);
+      CHECK_EQUAL(level * CYCLES_PER_LEVEL, fall - rise);
+    }
+    CHECK(trace.state(LED_DATA, starts[3]));
+    CHECK(!trace.any_edges(LED_DATA));
+
+    pio_sm_set_pindirs_with_mask(pio1, 0, 0, 1u << LED_DATA);
+    pio_sm_set_pins_with_mask(pio1, 0, 0, 1u << LED_DATA);
+  }
+
+  // Whole microsecond pulses too large for Q16.16, such as a v2 SET of 0xFFFF, clamp to the upper hard
+  // limit rather than wrapping negative and turning the servo off. A zero pulse still turns it off
+  void test_pulse_us_clamped() {
+    CHECK_EQUAL(1500 << Calibration::Q16_SHIFT, Calibration::pulse_us_to_q16(1500));
+    CHECK_EQUAL(2600 << Calibration::Q16_SHIFT, Calibration::pulse_us_to_q16(0xFFFF));
+    CHECK_EQUAL(2600 << Calibration::Q16_SHIFT, Calibration::pulse_us_to_q16(UINT32_MAX));
+
+    ServoCluster servos(pio0, 0, 0u, 3);
+    CHECK(servos.init());
+    servos.pulse_q16(0, Calibration::pulse_us_to_q16(0xFFFF), false);
+    servos.pulse_q16(1, Calibration::pulse_us_to_q16(2600), false);
+    servos.pulse_q16(2, Calibration::pulse_us_to_q16(0), false);
+    servos.commit();
+    CHECK(servos.is_enabled(0));
+    CHECK(servos.pulse(0) == servos.pulse(1));
+    CHECK(!servos.is_enabled(2));
+  }
+
+  // Pins given out of order, such that splitting them in two would leave each shard's span across the
+  // other's, keep to the one state machine
+  void test_interleaved_pins_not_sharded() {
+    const uint8_t pins[] = { 0, 6, 1, 7, 2, 8, 3, 9, 4, 10, 5, 11 };
+    ServoCluster servos(pio0, 0, pins, sizeof(pins), ANGULAR, ServoState::DEFAULT_FREQUENCY, true, 2);
+    CHECK(servos.init());
+    CHECK_EQUAL(sizeof(pins), servos.count());
+    CHECK(host_pio_model(pio0, 0) != nullptr);
+    CHECK(host_pio_model(pio0, 1) == nullptr);
+  }
+}
+
+int main() {
+  test_random_loads(false);
+  test_random_loads(true);
+  test_neighbouring_clusters();
+  test_servo_cluster_pulses(1);
+  test_servo_cluster_pulses(2);
+  test_servo_cluster_pulses(3);
+  test_interleaved_pins_not_sharded();
+  test_pulse_us_clamped();
+  test_aux_servos_beside_led();
+#ifdef PWM_CLUSTER_COMPACT
+  return host_test_result("pwm_cluster_compact_test");
+#else
+  return host_test_result("pwm_cluster_test");
+#endif
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+enum clock_index { clk_gpout0 = 0, clk_gpout1, clk_gpout2, clk_gpout3, clk_ref, clk_sys, clk_peri, clk_usb, clk_adc, clk_rtc };
+
+// The system clock runs at the SDK's default 125MHz
+uint32_t clock_get_hz(enum clock_index clk_index);
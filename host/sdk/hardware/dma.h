@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+typedef struct {
+  io_rw_32 read_addr;
+  io_rw_32 write_addr;
+  io_rw_32 transfer_count;
+  io_rw_32 ctrl_trig;
+  io_rw_32 al1_ctrl;
+  io_rw_32 al1_read_addr;
+  io_rw_32 al1_write_addr;
+  io_rw_32 al1_transfer_count_trig;
+  io_rw_32 al2_ctrl;
+  io_rw_32 al2_transfer_count;
+  io_rw_32 al2_read_addr;
+  io_rw_32 al2_write_addr_trig;
+  io_rw_32 al3_ctrl;
+  io_rw_32 al3_write_addr;
+  io_rw_32 al3_transfer_count;
+  io_rw_32 al3_read_addr_trig;
+} dma_channel_hw_t;
+
+// Plain memory, so unlike the hardware a write to ints does not clear its bits, it sets them. The
+// stub only ever has one completion pending, so it overwrites ints with that channel's bit while the
+// handlers run and zeroes it afterwards
+typedef struct {
+  dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+  io_rw_32 intr;
+  io_rw_32 inte0;
+  io_rw_32 intf0;
+  io_rw_32 ints0;
+  io_rw_32 inte1;
+  io_rw_32 intf1;
+  io_rw_32 ints1;
+  io_rw_32 abort;
+} dma_hw_t;
+
+extern dma_hw_t *dma_hw;
+
+#define DMA_CH0_CTRL_TRIG_BUSY_BITS     0x01000000u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS 0x00007800u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB  11
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct {
+  uint32_t ctrl;
+} dma_channel_config;
+
+// Only the chain is kept, as the rest makes no difference to the stub
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_bswap(dma_channel_config *c, bool bswap);
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+typedef struct {
+  io_rw_32 txf[NUM_PIO_STATE_MACHINES];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+extern pio_hw_t *const host_pio0;
+extern pio_hw_t *const host_pio1;
+#define pio0 host_pio0
+#define pio1 host_pio1
+
+typedef struct pio_program {
+  const uint16_t *instructions;
+  uint8_t length;
+  int8_t origin;
+} pio_program_t;
+
+typedef struct {
+  uint32_t clkdiv256;
+  uint out_base;
+  uint out_count;
+} pio_sm_config;
+
+enum pio_fifo_join { PIO_FIFO_JOIN_NONE = 0, PIO_FIFO_JOIN_TX = 1, PIO_FIFO_JOIN_RX = 2 };
+
+static inline uint pio_get_index(PIO pio) { return (pio == pio1) ? 1 : 0; }
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) { return (pio_get_index(pio) << 3) | (is_tx ? 0 : 4) | sm; }
+
+static inline pio_sm_config pio_get_default_sm_config(void) { return pio_sm_config{256, 0, 32}; }
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count) { c->out_base = out_base; c->out_count = out_count; }
+static inline void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base) { (void)c; (void)sideset_base; }
+static inline void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) { (void)c; (void)shift_right; (void)autopull; (void)pull_threshold; }
+static inline void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) { (void)c; (void)join; }
+static inline void sm_config_set_clkdiv(pio_sm_config *c, float div) { c->clkdiv256 = (uint32_t)(div * 256.0f); }
+
+uint pio_add_program(PIO pio, const pio_program_t *program);
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset);
+void pio_sm_claim(PIO pio, uint sm);
+void pio_sm_unclaim(PIO pio, uint sm);
+bool pio_sm_is_claimed(PIO pio, uint sm);
+void pio_gpio_init(PIO pio, uint pin);
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask);
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask);
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask);
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac);
+void pio_clkdiv_restart_sm_mask(PIO pio, uint32_t mask);
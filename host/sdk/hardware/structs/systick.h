@@ -0,0 +1,16 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+typedef struct {
+  io_rw_32 csr;
+  io_rw_32 rvr;
+  io_rw_32 cvr;
+  io_rw_32 calib;
+} systick_hw_t;
+
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004u
+#define M0PLUS_SYST_CSR_ENABLE_BITS    0x00000001u
+
+// Never counts, so the interrupt timing reads as zero cycles
+extern systick_hw_t *systick_hw;
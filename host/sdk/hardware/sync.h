@@ -0,0 +1,8 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+// A host has no interrupts to mask, as the stub only raises them from the calling thread
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void)status; }
+static inline void __dmb(void) {}
@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <vector>
+#include "host_sdk.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/structs/systick.h"
+#include "pwm_cluster.pio.h"
+
+using namespace pimoroni;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// PROGRAMS
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Only the lengths match pwm_cluster.pio, as the programs themselves are modelled
+static const uint16_t pwm_cluster_instructions[6] = { 0 };
+static const uint16_t debug_pwm_cluster_instructions[6] = { 0 };
+static const uint16_t pwm_cluster_compact_instructions[5] = { 0 };
+
+const pio_program_t pwm_cluster_program = { pwm_cluster_instructions, 6, -1 };
+const pio_program_t debug_pwm_cluster_program = { debug_pwm_cluster_instructions, 6, -1 };
+const pio_program_t pwm_cluster_compact_program = { pwm_cluster_compact_instructions, 5, -1 };
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// STATE
+////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace {
+  const uint PIO_INSTRUCTION_COUNT = 32;
+  const uint IRQ_COUNT = 32;
+  const uint MAX_SHARED_HANDLERS = 4;
+
+  struct StateMachine {
+    bool claimed = false;
+    bool enabled = false;
+    const pio_program_t *program = nullptr;
+    pio_sm_config config = pio_get_default_sm_config();
+    PWMClusterModel *model = nullptr;
+  };
+
+  // An OUT to the pins by one state machine, which sets those in its window and leaves the rest
+  struct PinWrite {
+    uint64_t cycle;
+    uint sm;
+    uint32_t window;
+    uint32_t states;
+  };
+
+  // The output levels and directions belong to the PIO, not its state machines, so every state machine
+  // writes the same pins. Writes wait in pending until every running state machine has been played past
+  // them, then go to the pins in cycle order. Where two land on the same cycle the higher numbered state
+  // machine's is applied last, and so wins, as on the RP2040
+  struct PioBlock {
+    pio_hw_t hw;
+    StateMachine sms[NUM_PIO_STATE_MACHINES];
+    const pio_program_t *programs[PIO_INSTRUCTION_COUNT] = { nullptr };  // Indexed by the offset each was added at
+    uint used_instructions = 0;
+    uint32_t pin_dirs = 0;
+    uint32_t pin_values = 0;
+    std::vector<PinWrite> pending;
+    std::vector<PWMClusterModel::Edge> edges;
+  };
+
+  // The registers only hold 32 bits, so the addresses the DMA works with are kept here in full
+  struct DmaChannel {
+    bool claimed = false;
+    bool busy = false;
+    const volatile void *read_addr = nullptr;
+    volatile void *write_addr = nullptr;
+    uint32_t trans_count = 0;
+  };
+
+  struct Irq {
+    bool enabled = false;
+    irq_handler_t handlers[MAX_SHARED_HANDLERS] = { nullptr };
+  };
+
+  PioBlock pio_blocks[NUM_PIOS];
+  DmaChannel dma_channels[NUM_DMA_CHANNELS];
+  dma_hw_t dma_registers;
+  systick_hw_t systick_registers;
+  Irq irqs[IRQ_COUNT];
+  bool gpio_values[NUM_BANK0_GPIOS];
+  uint64_t now_us = 0;
+
+  PioBlock &pio_block(PIO pio) {
+    return pio_blocks[pio_get_index(pio)];
+  }
+
+  StateMachine &state_machine(PIO pio, uint sm) {
+    assert(sm < NUM_PIO_STATE_MACHINES);
+    return pio_block(pio).sms[sm];
+  }
+
+  uint32_t rotate_left(uint32_t value, uint shift) {
+    shift &= 31;
+    return (shift == 0) ? value : (value << shift) | (value >> (32 - shift));
+  }
+
+  // The pins a state machine's OUT reaches, from its base and wrapping round past pin 31
+  uint32_t out_window(const pio_sm_config &config) {
+    uint32_t count_mask = (config.out_count >= 32) ? UINT32_MAX : ((1u << config.out_count) - 1);
+    return rotate_left(count_mask, config.out_base);
+  }
+
+  // Queues the pin writes a sequence makes, from the cycle the state machine is on
+  void queue_writes(PioBlock &block, uint sm, const uint32_t *words, uint32_t word_count) {
+    const StateMachine &machine = block.sms[sm];
+    const uint32_t window = out_window(machine.config);
+    const bool compact = (machine.program == &pwm_cluster_compact_program);
+    uint64_t cycle = machine.model->get_cycles();
+
+    for(uint32_t i = 0; compact ? (i < word_count) : (i + 1 < word_count); i += compact ? 1 : 2) {
+      uint32_t value = compact ? (words[i] >> PWMClusterModel::COMPACT_DELAY_BITS) : words[i];
+      uint32_t delay = compact ? (words[i] & ((1u << PWMClusterModel::COMPACT_DELAY_BITS) - 1)) : words[i + 1];
+      block.pending.push_back({ cycle + PWMClusterModel::OUT_CYCLE, sm, window,
+                                rotate_left(value, machine.config.out_base) & window });
+      cycle += PWMClusterModel::transition_cycles(delay);
+    }
+  }
+
+  // Applies the writes no running state machine can still write ahead of
+  void apply_writes(PioBlock &block) {
+    uint64_t horizon = UINT64_MAX;
+    for(const StateMachine &machine : block.sms) {
+      if(machine.enabled && machine.model != nullptr)
+        horizon = std::min(horizon, machine.model->get_cycles() + PWMClusterModel::OUT_CYCLE);
+    }
+
+    std::stable_sort(block.pending.begin(), block.pending.end(), [](const PinWrite &a, const PinWrite &b) {
+      return (a.cycle != b.cycle) ? (a.cycle < b.cycle) : (a.sm < b.sm);
+    });
+    size_t applied = 0;
+    for(; applied < block.pending.size() && block.pending[applied].cycle < horizon; applied++) {
+      const PinWrite &write = block.pending[applied];
+      uint32_t states = (block.pin_values & ~write.window) | write.states;
+      uint32_t changed = (states ^ block.pin_values) & block.pin_dirs;
+      for(uint8_t pin = 0; pin < NUM_BANK0_GPIOS; pin++) {
+        if(changed & (1u << pin))
+          block.edges.push_back(PWMClusterModel::Edge(write.cycle, pin, (states & (1u << pin)) != 0));
+      }
+      block.pin_values = states;
+    }
+    block.pending.erase(block.pending.begin(), block.pending.begin() + applied);
+  }
+
+  uint chain_to(uint channel) {
+    return (dma_registers.ch[channel].al1_ctrl & DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) >> DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB;
+  }
+
+  void raise_irq(uint num) {
+    if(irqs[num].enabled) {
+      for(uint i = 0; i < MAX_SHARED_HANDLERS; i++) {
+        if(irqs[num].handlers[i] != nullptr)
+          irqs[num].handlers[i]();
+      }
+    }
+  }
+
+  // Ends a channel's transfer, then triggers whatever it chains to and raises its interrupt
+  void complete_dma(uint channel) {
+    DmaChannel &ch = dma_channels[channel];
+    ch.busy = false;
+
+    // A channel chained to a control channel has its read address rewritten from the word the control
+    // channel reads. That only holds the low 32 bits of the address, so the rest comes from the old one
+    uint next = chain_to(channel);
+    if(next != channel && dma_channels[next].write_addr == &dma_registers.ch[channel].al3_read_addr_trig) {
+      uint32_t low = *(const volatile uint32_t *)dma_channels[next].read_addr;
+      uintptr_t high = (uintptr_t)ch.read_addr & ~(uintptr_t)UINT32_MAX;
+      ch.read_addr = (const volatile void *)(high | low);
+      ch.busy = true;
+    }
+
+    const uint32_t bit = 1u << channel;
+    if(dma_registers.inte0 & bit) {
+      dma_registers.ints0 = bit;
+      raise_irq(DMA_IRQ_0);
+      dma_registers.ints0 = 0;
+    }
+    if(dma_registers.inte1 & bit) {
+      dma_registers.ints1 = bit;
+      raise_irq(DMA_IRQ_1);
+      dma_registers.ints1 = 0;
+    }
+  }
+}
+
+pio_hw_t *const host_pio0 = &pio_blocks[0].hw;
+pio_hw_t *const host_pio1 = &pio_blocks[1].hw;
+dma_hw_t *dma_hw = &dma_registers;
+systick_hw_t *systick_hw = &systick_registers;
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// TEST CONTROLS
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void host_time_advance_us(uint64_t us) {
+  now_us += us;
+}
+
+bool host_pio_run_sequence(PIO pio, uint sm) {
+  PioBlock &block = pio_block(pio);
+  StateMachine &machine = state_machine(pio, sm);
+  if(!machine.enabled || machine.model == nullptr)
+    return false;
+
+  for(uint channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+    DmaChannel &ch = dma_channels[channel];
+    if(ch.claimed && ch.busy && ch.write_addr == &pio->txf[sm]) {
+      const uint32_t *words = (const uint32_t *)ch.read_addr;
+      queue_writes(block, sm, words, ch.trans_count);
+      if(machine.program == &pwm_cluster_compact_program)
+        machine.model->run_compact(words, ch.trans_count, machine.config.out_base);
+      else
+        machine.model->run(words, ch.trans_count, machine.config.out_base);
+      apply_writes(block);
+
+      complete_dma(channel);
+      return true;
+    }
+  }
+  return false;
+}
+
+PWMClusterModel *host_pio_model(PIO pio, uint sm) {
+  return state_machine(pio, sm).model;
+}
+
+uint32_t host_pio_pin_states(PIO pio) {
+  return pio_block(pio).pin_values;
+}
+
+const std::vector<PWMClusterModel::Edge> &host_pio_edges(PIO pio) {
+  return pio_block(pio).edges;
+}
+
+void host_pio_clear_edges(PIO pio) {
+  pio_block(pio).edges.clear();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// TIME
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t time_us_64(void) {
+  return now_us++;
+}
+
+uint32_t time_us_32(void) {
+  return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time(void) {
+  return time_us_64();
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t) {
+  return (uint32_t)(t / 1000);
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us) {
+  return time_us_64() + us;
+}
+
+bool time_reached(absolute_time_t t) {
+  return time_us_64() >= t;
+}
+
+void sleep_us(uint64_t us) {
+  now_us += us;
+}
+
+void sleep_ms(uint32_t ms) {
+  now_us += (uint64_t)ms * 1000;
+}
+
+void busy_wait_us_32(uint32_t delay_us) {
+  now_us += delay_us;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+  (void)clk_index;
+  return 125000000;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// GPIO
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void gpio_init(uint gpio) {
+  assert(gpio < NUM_BANK0_GPIOS);
+  gpio_values[gpio] = false;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+  assert(gpio < NUM_BANK0_GPIOS);
+  (void)fn;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+  assert(gpio < NUM_BANK0_GPIOS);
+  (void)out;
+}
+
+void gpio_put(uint gpio, bool value) {
+  assert(gpio < NUM_BANK0_GPIOS);
+  gpio_values[gpio] = value;
+}
+
+bool gpio_get(uint gpio) {
+  assert(gpio < NUM_BANK0_GPIOS);
+  return gpio_values[gpio];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// IRQ
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+  assert(num < IRQ_COUNT && irqs[num].handlers[0] == nullptr);
+  irqs[num].handlers[0] = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+  assert(num < IRQ_COUNT);
+  (void)order_priority;
+  for(uint i = 0; i < MAX_SHARED_HANDLERS; i++) {
+    if(irqs[num].handlers[i] == nullptr) {
+      irqs[num].handlers[i] = handler;
+      return;
+    }
+  }
+  assert(false);
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+  assert(num < IRQ_COUNT);
+  for(uint i = 0; i < MAX_SHARED_HANDLERS; i++) {
+    if(irqs[num].handlers[i] == handler)
+      irqs[num].handlers[i] = nullptr;
+  }
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+  assert(num < IRQ_COUNT);
+  irqs[num].enabled = enabled;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// PIO
+////////////////////////////////////////////////////////////////////////////////////////////////////
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+  PioBlock &block = pio_block(pio);
+  assert(block.used_instructions + program->length <= PIO_INSTRUCTION_COUNT);
+  uint offset = block.used_instructions;
+  block.programs[offset] = program;
+  block.used_instructions += program->length;
+  return offset;
+}
+
+// Space is only given back once the last program is removed, which is all the drivers here need
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset) {
+  PioBlock &block = pio_block(pio);
+  assert(block.programs[loaded_offset] == program);
+  block.programs[loaded_offset] = nullptr;
+
+  bool empty = true;
+  for(uint i = 0; i < PIO_INSTRUCTION_COUNT; i++) {
+    empty &= (block.programs[i] == nullptr);
+  }
+  if(empty)
+    block.used_instructions = 0;
+}
+
+void pio_sm_claim(PIO pio, uint sm) {
+  StateMachine &machine = state_machine(pio, sm);
+  assert(!machine.claimed);
+  machine.claimed = true;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+  StateMachine &machine = state_machine(pio, sm);
+  machine.claimed = false;
+  machine.enabled = false;
+  delete machine.model;
+  machine.model = nullptr;
+  apply_writes(pio_block(pio));
+}
+
+bool pio_sm_is_claimed(PIO pio, uint sm) {
+  return state_machine(pio, sm).claimed;
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+  gpio_set_function(pin, (pio_get_index(pio) == 0) ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1);
+}
+
+// The model covers the pins the state machine's OUT window reaches, starting from their levels before it.
+// It keeps the state machine's own view of its sequence, while the pins themselves are the PIO's
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+  PioBlock &block = pio_block(pio);
+  StateMachine &machine = state_machine(pio, sm);
+  assert(initial_pc < PIO_INSTRUCTION_COUNT && block.programs[initial_pc] != nullptr);
+  machine.program = block.programs[initial_pc];
+  machine.config = *config;
+  machine.enabled = false;
+  delete machine.model;
+  machine.model = new PWMClusterModel(out_window(machine.config), block.pin_values);
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+  state_machine(pio, sm).enabled = enabled;
+}
+
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask) {
+  for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+    if(mask & (1u << sm))
+      pio_sm_set_enabled(pio, sm, true);
+  }
+}
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask) {
+  (void)sm;
+  PioBlock &block = pio_block(pio);
+  block.pin_values = (block.pin_values & ~pin_mask) | (pin_values & pin_mask);
+}
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask) {
+  (void)sm;
+  PioBlock &block = pio_block(pio);
+  block.pin_dirs = (block.pin_dirs & ~pin_mask) | (pin_dirs & pin_mask);
+}
+
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+  uint32_t mask = ((1u << pin_count) - 1) << pin_base;
+  pio_sm_set_pindirs_with_mask(pio, sm, is_out ? mask : 0, mask);
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div) {
+  state_machine(pio, sm).config.clkdiv256 = (uint32_t)(div * 256.0f);
+}
+
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac) {
+  state_machine(pio, sm).config.clkdiv256 = ((uint32_t)div_int << 8) | div_frac;
+}
+
+void pio_clkdiv_restart_sm_mask(PIO pio, uint32_t mask) {
+  (void)pio;
+  (void)mask;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// DMA
+////////////////////////////////////////////////////////////////////////////////////////////////////
+dma_channel_config dma_channel_get_default_config(uint channel) {
+  dma_channel_config c = { 0 };
+  channel_config_set_chain_to(&c, channel);
+  return c;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+  (void)c;
+  (void)incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+  (void)c;
+  (void)incr;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+  (void)c;
+  (void)dreq;
+}
+
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) {
+  c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) | (chain_to << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+  (void)c;
+  (void)size;
+}
+
+void channel_config_set_bswap(dma_channel_config *c, bool bswap) {
+  (void)c;
+  (void)bswap;
+}
+
+int dma_claim_unused_channel(bool required) {
+  for(uint channel = 0; channel < NUM_DMA_CHANNELS; channel++) {
+    if(!dma_channels[channel].claimed) {
+      dma_channels[channel] = DmaChannel();
+      dma_channels[channel].claimed = true;
+      return channel;
+    }
+  }
+  assert(!required);
+  return -1;
+}
+
+void dma_channel_unclaim(uint channel) {
+  assert(channel < NUM_DMA_CHANNELS);
+  dma_channels[channel] = DmaChannel();
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+  assert(channel < NUM_DMA_CHANNELS);
+  dma_registers.ch[channel].al1_ctrl = config->ctrl;
+  dma_channels[channel].write_addr = write_addr;
+  dma_channels[channel].read_addr = read_addr;
+  dma_channels[channel].trans_count = transfer_count;
+  dma_channels[channel].busy |= trigger;
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+  assert(channel < NUM_DMA_CHANNELS);
+  dma_channels[channel].read_addr = read_addr;
+  dma_channels[channel].busy |= trigger;
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+  assert(channel < NUM_DMA_CHANNELS);
+  dma_channels[channel].trans_count = trans_count;
+  dma_channels[channel].busy |= trigger;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+  if(enabled)
+    hw_set_bits(&dma_registers.inte0, 1u << channel);
+  else
+    hw_clear_bits(&dma_registers.inte0, 1u << channel);
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled) {
+  if(enabled)
+    hw_set_bits(&dma_registers.inte1, 1u << channel);
+  else
+    hw_clear_bits(&dma_registers.inte1, 1u << channel);
+}
+
+void dma_channel_abort(uint channel) {
+  assert(channel < NUM_DMA_CHANNELS);
+  dma_channels[channel].busy = false;
+}
+
+bool dma_channel_is_busy(uint channel) {
+  assert(channel < NUM_DMA_CHANNELS);
+  return dma_channels[channel].busy;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Controls for host tests, over the state the stub SDK keeps in place of the hardware
+
+#include <vector>
+#include "hardware/pio.h"
+#include "pwm_cluster_model.hpp"
+
+// Moves the clock on, on top of the microsecond each read of it takes
+void host_time_advance_us(uint64_t us);
+
+// Streams the transfer the DMA has running into a state machine's TX FIFO through a model of its
+// program, then finishes it as the hardware would: following the channel's chain, and raising its
+// interrupt if enabled. Each call is one period of a PWM cluster. Returns false if the state machine
+// is not running, or has no transfer feeding it
+bool host_pio_run_sequence(PIO pio, uint sm);
+
+// The model of a state machine's program, holding the pin edges of every sequence run through it.
+// Null until the state machine is initialised
+pimoroni::PWMClusterModel *host_pio_model(PIO pio, uint sm);
+
+// The PIO's output levels, shared by all its state machines
+uint32_t host_pio_pin_states(PIO pio);
+
+// The edges of the PIO's output pins, in cycle order. A state machine's writes only reach the pins once
+// every running state machine on the PIO has been played past them, as any of them could still write
+// the same pins first
+const std::vector<pimoroni::PWMClusterModel::Edge> &host_pio_edges(PIO pio);
+void host_pio_clear_edges(PIO pio);
@@ -0,0 +1,47 @@
+#pragma once
+
+// A stand-in for the parts of the Pico SDK the drivers use, so they can be built and run on a host.
+// Only what the code in this repo calls is here, with the same names and signatures as the SDK
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef unsigned int uint;
+typedef volatile uint32_t io_rw_32;
+typedef uint64_t absolute_time_t;
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define NUM_BANK0_GPIOS         30
+#define NUM_DMA_CHANNELS        12
+#define NUM_PIOS                2
+#define NUM_PIO_STATE_MACHINES  4
+
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+
+static inline void tight_loop_contents(void) {}
+
+static inline void hw_set_bits(io_rw_32 *addr, uint32_t mask) { *addr |= mask; }
+static inline void hw_clear_bits(io_rw_32 *addr, uint32_t mask) { *addr &= ~mask; }
+
+// Every read of the clock moves it on a microsecond, so loops polling for a timeout always end
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+absolute_time_t get_absolute_time(void);
+uint32_t to_ms_since_boot(absolute_time_t t);
+absolute_time_t make_timeout_time_us(uint64_t us);
+bool time_reached(absolute_time_t t);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void busy_wait_us_32(uint32_t delay_us);
+
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
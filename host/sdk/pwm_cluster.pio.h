@@ -0,0 +1,30 @@
+#pragma once
+
+// Stands in for the header pioasm generates from drivers/pwm/pwm_cluster.pio. The host build reads the
+// .pio file's public defines into the compile definitions, so only the programs are declared here.
+// The stub PIO tells them apart by address, and runs them through PWMClusterModel rather than decoding them
+
+#include "hardware/pio.h"
+
+#if !defined(PWM_CLUSTER_CYCLES) || !defined(PWM_CLUSTER_COMPACT_PIN_BITS) || !defined(PWM_CLUSTER_COMPACT_DELAY_BITS)
+#error "The host build passes the defines from pwm_cluster.pio"
+#endif
+
+extern const pio_program_t pwm_cluster_program;
+extern const pio_program_t debug_pwm_cluster_program;
+extern const pio_program_t pwm_cluster_compact_program;
+
+static inline pio_sm_config pwm_cluster_program_get_default_config(uint offset) {
+  (void)offset;
+  return pio_get_default_sm_config();
+}
+
+static inline pio_sm_config debug_pwm_cluster_program_get_default_config(uint offset) {
+  (void)offset;
+  return pio_get_default_sm_config();
+}
+
+static inline pio_sm_config pwm_cluster_compact_program_get_default_config(uint offset) {
+  (void)offset;
+  return pio_get_default_sm_config();
+}